@@ -42,7 +42,7 @@ static object_t *boolobject_op_land (object_t *obj1, object_t *obj2);
 static object_t *boolobject_op_lor (object_t *obj1, object_t *obj2);
 static object_t *boolobject_op_eq (object_t *obj1, object_t *obj2);
 static object_t *boolobject_op_cmp (object_t *obj1, object_t *obj2);
-static object_t *boolobject_op_hash (object_t *obj);
+static uint64_t boolobject_op_hash (object_t *obj);
 static object_t *boolobject_op_binary (object_t *obj);
 
 static object_opset_t g_object_ops =
@@ -149,15 +149,10 @@ boolobject_op_cmp (object_t *obj1, object_t *obj2)
 }
 
 /* Hash. */
-static object_t *
-boolobject_op_hash(object_t *obj)
+static uint64_t
+boolobject_op_hash (object_t *obj)
 {
-	if (OBJECT_DIGEST (obj) == 0) {
-		OBJECT_DIGEST (obj) = object_integer_hash (object_get_integer (obj));
-	}
-
-	/* The digest is already computed. */
-	return uint64object_new (OBJECT_DIGEST (obj), NULL);
+	return object_integer_hash (object_get_integer (obj));
 }
 
 /* Binary. */
@@ -200,12 +195,6 @@ boolobject_load_buf (const char **buf, size_t *len)
 	return boolobject_new (val, NULL);
 }
 
-static uint64_t
-boolobject_digest_fun (void *obj)
-{
-	return object_integer_hash (object_get_integer ((object_t *) obj));
-}
-
 object_t *
 boolobject_new (bool val, void *udata)
 {
@@ -223,8 +212,7 @@ boolobject_new (bool val, void *udata)
 		fatal_error ("out of memory.");
 	}
 
-	OBJECT_NEW_INIT (obj, OBJECT_TYPE_BOOL, udata);
-	OBJECT_DIGEST_FUN (obj) = boolobject_digest_fun;
+	OBJECT_NEW_INIT (obj, OBJECT_TYPE_BOOL);
 
 	obj->val = val;
 
@@ -248,6 +236,8 @@ boolobject_init ()
 		return;
 	}
 
+	object_register_opset (OBJECT_TYPE_BOOL, &g_object_ops);
+
 	/* This two objects should never be freed. */
 	g_true_object = boolobject_new (true, NULL);
 	if (g_true_object == NULL) {
@@ -25,8 +25,17 @@
 #include "pool.h"
 #include "error.h"
 #include "thread.h"
+#include "gc.h"
+#include "chan.h"
+#include "sync.h"
+#include "coroutine.h"
+#include "event.h"
+#include "global.h"
 #include "vec.h"
+#include "boolobject.h"
+#include "nullobject.h"
 #include "longobject.h"
+#include "doubleobject.h"
 #include "vecobject.h"
 #include "dictobject.h"
 #include "strobject.h"
@@ -103,7 +112,15 @@ _builtin_append (object_t *args)
 	}
 
 	for (int i = 1; ARG (args, i) != NULL; i++) {
-		if (vecobject_append (vec, ARG (args, i)) == 0) {
+		object_t *element;
+
+		/* A strbuf stays with its variable. */
+		element = strobject_builder_store (ARG (args, i), 0);
+		if (vecobject_append (vec, element) == 0) {
+			if (element != ARG (args, i)) {
+				object_free (element);
+			}
+
 			return NULL;
 		}
 	}
@@ -192,44 +209,61 @@ _builtin_exit (object_t *args)
 	return DUMMY;
 }
 
+/* The arguments after the func, for calling it later. */
 static object_t *
-_builtin_thread_create (object_t *args)
+_builtin_call_args (object_t *args, const char *name)
 {
 	object_t *fun_obj;
-	object_t *thread_args;
+	object_t *call_args;
 	size_t size;
-	vec_t *thread_args_vec;
-	long th;
+	vec_t *call_args_vec;
 
 	size = ARG_SIZE (args);
 	if (ARG_SIZE (args) < 1) {
-		error ("missing func for thread_create.");
+		error ("missing func for %s.", name);
 
 		return NULL;
 	}
 
 	fun_obj = ARG (args, 0);
 	if (!OBJECT_IS_FUNC (fun_obj)) {
-		error ("the first argument of thread_create should be a func.");
+		error ("the first argument of %s should be a func.", name);
 
 		return NULL;
 	}
 
-	thread_args = vecobject_new (ARG_SIZE (args) - 1, NULL);
-	if (thread_args == NULL) {
+	call_args = vecobject_new (ARG_SIZE (args) - 1, NULL);
+	if (call_args == NULL) {
 		return NULL;
 	}
 
-	thread_args_vec = vecobject_get_value (thread_args);
+	call_args_vec = vecobject_get_value (call_args);
+	/* Argument vecs are stored in reverse order. */
 	for (integer_value_t i = 1; i < (integer_value_t) size; i++) {
 		object_t *arg;
+		object_t *prev;
 
 		arg = ARG (args, i);
-		UNUSED (vec_set (thread_args_vec, i - 1, (void *) arg));
+		prev = (object_t *) vec_set (call_args_vec, (integer_value_t) size - 1 - i, (void *) arg);
 		object_ref (arg);
+		object_unref (prev);
+	}
+
+	return call_args;
+}
+
+static object_t *
+_builtin_thread_create (object_t *args)
+{
+	object_t *thread_args;
+	long th;
+
+	thread_args = _builtin_call_args (args, "thread_create");
+	if (thread_args == NULL) {
+		return NULL;
 	}
 
-	th = thread_create (funcobject_get_value (fun_obj), thread_args);
+	th = thread_create (funcobject_get_value (ARG (args, 0)), thread_args);
 	object_free (thread_args);
 	if(th == 0) {
 		return NULL;
@@ -257,6 +291,95 @@ _builtin_thread_join (object_t *args)
 	return ret_obj;
 }
 
+/* The handles of threads in a vec, as a plain array. */
+static long *
+_builtin_thread_list (object_t *vec_obj, size_t *n)
+{
+	vec_t *v;
+	long *ths;
+	object_t *arg;
+
+	if (!OBJECT_IS_VEC (vec_obj)) {
+		error ("expect a vec of threads.");
+
+		return NULL;
+	}
+
+	v = vecobject_get_value (vec_obj);
+	*n = vec_size (v);
+	ths = (long *) calloc (*n + 1, sizeof (long));
+	if (ths == NULL) {
+		fatal_error ("out of memory.");
+	}
+
+	for (size_t i = 0; i < *n; i++) {
+		arg = object_cast ((object_t *) vec_pos (v, (integer_value_t) i), OBJECT_TYPE_LONG);
+		if (arg == NULL) {
+			free ((void *) ths);
+
+			return NULL;
+		}
+		ths[i] = longobject_get_value (arg);
+		object_free (arg);
+	}
+
+	return ths;
+}
+
+static object_t *
+_builtin_thread_wait_any (object_t *args)
+{
+	long *ths;
+	size_t n;
+	long th;
+
+	/* Gives the first child to finish, which is then joined as usual. */
+	ths = _builtin_thread_list (ARG (args, 0), &n);
+	if (ths == NULL) {
+		return NULL;
+	}
+
+	th = thread_wait_any (ths, n);
+
+	free ((void *) ths);
+	if (th == 0L) {
+		return NULL;
+	}
+
+	return longobject_new (th, NULL);
+}
+
+static object_t *
+_builtin_thread_wait_all (object_t *args)
+{
+	object_t *arg;
+	long *ths;
+	size_t n;
+	long timeout;
+	int res;
+
+	arg = object_cast (ARG (args, 1), OBJECT_TYPE_LONG);
+	if (arg == NULL) {
+		return NULL;
+	}
+	timeout = longobject_get_value (arg);
+	object_free (arg);
+
+	ths = _builtin_thread_list (ARG (args, 0), &n);
+	if (ths == NULL) {
+		return NULL;
+	}
+
+	res = thread_wait_all (ths, n, timeout);
+
+	free ((void *) ths);
+	if (res < 0) {
+		return NULL;
+	}
+
+	return boolobject_new (res, NULL);
+}
+
 static object_t *
 _builtin_thread_detach (object_t *args)
 {
@@ -295,6 +418,979 @@ _builtin_thread_cancel (object_t *args)
 	return ret_obj;
 }
 
+static object_t *
+_builtin_thread_pool_size (object_t *args)
+{
+	object_t *arg;
+	int ok;
+
+	arg = object_cast (ARG (args, 0), OBJECT_TYPE_LONG);
+	if (arg == NULL) {
+		return NULL;
+	}
+
+	ok = thread_set_pool_size (longobject_get_value (arg));
+
+	object_free (arg);
+
+	return ok? DUMMY: NULL;
+}
+
+static object_t *
+_builtin_chan_new (object_t *args)
+{
+	object_t *arg;
+	long ch;
+
+	arg = object_cast (ARG (args, 0), OBJECT_TYPE_LONG);
+	if (arg == NULL) {
+		return NULL;
+	}
+
+	ch = chan_new (longobject_get_value (arg));
+
+	object_free (arg);
+	if (ch == 0L) {
+		return NULL;
+	}
+
+	return longobject_new (ch, NULL);
+}
+
+static object_t *
+_builtin_chan_send (object_t *args)
+{
+	object_t *arg;
+	int ok;
+
+	arg = object_cast (ARG (args, 0), OBJECT_TYPE_LONG);
+	if (arg == NULL) {
+		return NULL;
+	}
+
+	ok = chan_send (longobject_get_value (arg), ARG (args, 1));
+
+	object_free (arg);
+
+	return ok? DUMMY: NULL;
+}
+
+static object_t *
+_builtin_chan_recv (object_t *args)
+{
+	object_t *arg;
+	object_t *res;
+
+	/* A closed and drained chan gives null. */
+	arg = object_cast (ARG (args, 0), OBJECT_TYPE_LONG);
+	if (arg == NULL) {
+		return NULL;
+	}
+
+	res = chan_recv (longobject_get_value (arg));
+
+	object_free (arg);
+
+	return res;
+}
+
+static object_t *
+_builtin_chan_close (object_t *args)
+{
+	object_t *arg;
+	int ok;
+
+	arg = object_cast (ARG (args, 0), OBJECT_TYPE_LONG);
+	if (arg == NULL) {
+		return NULL;
+	}
+
+	ok = chan_close (longobject_get_value (arg));
+
+	object_free (arg);
+
+	return ok? DUMMY: NULL;
+}
+
+static object_t *
+_builtin_chan_free (object_t *args)
+{
+	object_t *arg;
+	int ok;
+
+	arg = object_cast (ARG (args, 0), OBJECT_TYPE_LONG);
+	if (arg == NULL) {
+		return NULL;
+	}
+
+	ok = chan_free (longobject_get_value (arg));
+
+	object_free (arg);
+
+	return ok? DUMMY: NULL;
+}
+
+static object_t *
+_builtin_pmap (object_t *args)
+{
+	object_t *fun_obj;
+	object_t *vec_obj;
+
+	fun_obj = ARG (args, 0);
+	vec_obj = ARG (args, 1);
+	if (!OBJECT_IS_FUNC (fun_obj) || !OBJECT_IS_VEC (vec_obj)) {
+		error ("pmap expects a func and a vec.");
+
+		return NULL;
+	}
+
+	return thread_parallel_map (funcobject_get_value (fun_obj), vec_obj);
+}
+
+static object_t *
+_builtin_pfor (object_t *args)
+{
+	object_t *start;
+	object_t *end;
+	object_t *fun_obj;
+	int ok;
+
+	fun_obj = ARG (args, 2);
+	if (!OBJECT_IS_FUNC (fun_obj)) {
+		error ("the third argument of pfor should be a func.");
+
+		return NULL;
+	}
+
+	start = object_cast (ARG (args, 0), OBJECT_TYPE_LONG);
+	if (start == NULL) {
+		return NULL;
+	}
+	end = object_cast (ARG (args, 1), OBJECT_TYPE_LONG);
+	if (end == NULL) {
+		object_free (start);
+
+		return NULL;
+	}
+
+	ok = thread_parallel_for (funcobject_get_value (fun_obj),
+							  longobject_get_value (start),
+							  longobject_get_value (end));
+
+	object_free (start);
+	object_free (end);
+
+	return ok? DUMMY: NULL;
+}
+
+static object_t *
+_builtin_preduce (object_t *args)
+{
+	object_t *fun_obj;
+	object_t *vec_obj;
+
+	fun_obj = ARG (args, 0);
+	vec_obj = ARG (args, 1);
+	if (!OBJECT_IS_FUNC (fun_obj) || !OBJECT_IS_VEC (vec_obj)) {
+		error ("preduce expects a func, a vec and an initial value.");
+
+		return NULL;
+	}
+
+	return thread_parallel_reduce (funcobject_get_value (fun_obj), vec_obj, ARG (args, 2));
+}
+
+static object_t *
+_builtin_share (object_t *args)
+{
+	object_t *name;
+
+	/* The global is named by a str, like share("counter"). */
+	name = ARG (args, 0);
+	if (!OBJECT_IS_STR (name)) {
+		error ("the argument of share should be the name of a global.");
+
+		return NULL;
+	}
+
+	return global_share (name)? DUMMY: NULL;
+}
+
+static int
+_builtin_integer_arg (object_t *args, int pos, integer_value_t *val)
+{
+	object_t *arg;
+
+	arg = object_cast (ARG (args, pos), OBJECT_TYPE_LONG);
+	if (arg == NULL) {
+		return 0;
+	}
+
+	*val = longobject_get_value (arg);
+	object_free (arg);
+
+	return 1;
+}
+
+static object_t *
+_builtin_handle_new (long id)
+{
+	return id != 0L? longobject_new (id, NULL): NULL;
+}
+
+/* Runs op on the handle given by the first argument. */
+static object_t *
+_builtin_handle_op (object_t *args, int (*op) (long))
+{
+	integer_value_t id;
+
+	if (!_builtin_integer_arg (args, 0, &id)) {
+		return NULL;
+	}
+
+	return op ((long) id)? DUMMY: NULL;
+}
+
+static object_t *
+_builtin_mutex_new (object_t *args)
+{
+	UNUSED (args);
+
+	return _builtin_handle_new (sync_mutex_new ());
+}
+
+static object_t *
+_builtin_mutex_lock (object_t *args)
+{
+	return _builtin_handle_op (args, sync_mutex_lock);
+}
+
+static object_t *
+_builtin_mutex_unlock (object_t *args)
+{
+	return _builtin_handle_op (args, sync_mutex_unlock);
+}
+
+static object_t *
+_builtin_mutex_trylock (object_t *args)
+{
+	integer_value_t id;
+	bool locked;
+
+	if (!_builtin_integer_arg (args, 0, &id)) {
+		return NULL;
+	}
+
+	if (!sync_mutex_trylock ((long) id, &locked)) {
+		return NULL;
+	}
+
+	return boolobject_new (locked, NULL);
+}
+
+static object_t *
+_builtin_mutex_free (object_t *args)
+{
+	return _builtin_handle_op (args, sync_mutex_free);
+}
+
+static object_t *
+_builtin_rwlock_new (object_t *args)
+{
+	UNUSED (args);
+
+	return _builtin_handle_new (sync_rwlock_new ());
+}
+
+static object_t *
+_builtin_rwlock_rdlock (object_t *args)
+{
+	return _builtin_handle_op (args, sync_rwlock_rdlock);
+}
+
+static object_t *
+_builtin_rwlock_wrlock (object_t *args)
+{
+	return _builtin_handle_op (args, sync_rwlock_wrlock);
+}
+
+static object_t *
+_builtin_rwlock_unlock (object_t *args)
+{
+	return _builtin_handle_op (args, sync_rwlock_unlock);
+}
+
+static object_t *
+_builtin_rwlock_free (object_t *args)
+{
+	return _builtin_handle_op (args, sync_rwlock_free);
+}
+
+static object_t *
+_builtin_cond_new (object_t *args)
+{
+	UNUSED (args);
+
+	return _builtin_handle_new (sync_cond_new ());
+}
+
+static object_t *
+_builtin_cond_wait (object_t *args)
+{
+	integer_value_t cond;
+	integer_value_t mutex;
+
+	/* Like cond_wait(c, m), m must be locked by the caller. */
+	if (!_builtin_integer_arg (args, 0, &cond) || !_builtin_integer_arg (args, 1, &mutex)) {
+		return NULL;
+	}
+
+	return sync_cond_wait ((long) cond, (long) mutex)? DUMMY: NULL;
+}
+
+static object_t *
+_builtin_cond_signal (object_t *args)
+{
+	return _builtin_handle_op (args, sync_cond_signal);
+}
+
+static object_t *
+_builtin_cond_broadcast (object_t *args)
+{
+	return _builtin_handle_op (args, sync_cond_broadcast);
+}
+
+static object_t *
+_builtin_cond_free (object_t *args)
+{
+	return _builtin_handle_op (args, sync_cond_free);
+}
+
+static object_t *
+_builtin_atomic_new (object_t *args, object_type_t type)
+{
+	integer_value_t val;
+
+	if (!_builtin_integer_arg (args, 0, &val)) {
+		return NULL;
+	}
+
+	return _builtin_handle_new (sync_atomic_new (type, val));
+}
+
+static object_t *
+_builtin_atomic_int (object_t *args)
+{
+	return _builtin_atomic_new (args, OBJECT_TYPE_INT);
+}
+
+static object_t *
+_builtin_atomic_long (object_t *args)
+{
+	return _builtin_atomic_new (args, OBJECT_TYPE_LONG);
+}
+
+static object_t *
+_builtin_atomic_load (object_t *args)
+{
+	integer_value_t id;
+
+	if (!_builtin_integer_arg (args, 0, &id)) {
+		return NULL;
+	}
+
+	return sync_atomic_load ((long) id);
+}
+
+static object_t *
+_builtin_atomic_store (object_t *args)
+{
+	integer_value_t id;
+	integer_value_t val;
+
+	if (!_builtin_integer_arg (args, 0, &id) || !_builtin_integer_arg (args, 1, &val)) {
+		return NULL;
+	}
+
+	return sync_atomic_store ((long) id, val)? DUMMY: NULL;
+}
+
+static object_t *
+_builtin_atomic_add (object_t *args)
+{
+	integer_value_t id;
+	integer_value_t delta;
+
+	/* Gives the new value. */
+	if (!_builtin_integer_arg (args, 0, &id) || !_builtin_integer_arg (args, 1, &delta)) {
+		return NULL;
+	}
+
+	return sync_atomic_add ((long) id, delta);
+}
+
+static object_t *
+_builtin_atomic_cas (object_t *args)
+{
+	integer_value_t id;
+	integer_value_t expected;
+	integer_value_t desired;
+	bool swapped;
+
+	if (!_builtin_integer_arg (args, 0, &id)
+		|| !_builtin_integer_arg (args, 1, &expected)
+		|| !_builtin_integer_arg (args, 2, &desired)) {
+		return NULL;
+	}
+
+	if (!sync_atomic_cas ((long) id, expected, desired, &swapped)) {
+		return NULL;
+	}
+
+	return boolobject_new (swapped, NULL);
+}
+
+static object_t *
+_builtin_atomic_free (object_t *args)
+{
+	return _builtin_handle_op (args, sync_atomic_free);
+}
+
+static object_t *
+_builtin_coroutine_create (object_t *args)
+{
+	object_t *co_args;
+	long co;
+
+	co_args = _builtin_call_args (args, "coroutine_create");
+	if (co_args == NULL) {
+		return NULL;
+	}
+
+	co = coroutine_create (funcobject_get_value (ARG (args, 0)), co_args);
+	object_free (co_args);
+	if (co == 0L) {
+		return NULL;
+	}
+
+	return longobject_new (co, NULL);
+}
+
+static object_t *
+_builtin_yield (object_t *args)
+{
+	object_t *value;
+
+	/* The value is given to resume, like yield(v). */
+	if (ARG_SIZE (args) > 1) {
+		error ("yield takes at most one argument.");
+
+		return NULL;
+	}
+
+	value = ARG_SIZE (args) == 1? ARG (args, 0): nullobject_new (NULL);
+
+	return coroutine_yield (value)? DUMMY: NULL;
+}
+
+static object_t *
+_builtin_resume (object_t *args)
+{
+	object_t *arg;
+	object_t *value;
+	long co;
+
+	/* Like resume(co, v), v is the result of the yield it is suspended in. */
+	if (ARG_SIZE (args) < 1 || ARG_SIZE (args) > 2) {
+		error ("resume expects a coroutine and an optional value.");
+
+		return NULL;
+	}
+
+	arg = object_cast (ARG (args, 0), OBJECT_TYPE_LONG);
+	if (arg == NULL) {
+		return NULL;
+	}
+	co = longobject_get_value (arg);
+	object_free (arg);
+
+	value = ARG_SIZE (args) == 2? ARG (args, 1): nullobject_new (NULL);
+
+	return coroutine_resume (co, value);
+}
+
+static object_t *
+_builtin_coroutine_alive (object_t *args)
+{
+	object_t *arg;
+	int alive;
+
+	arg = object_cast (ARG (args, 0), OBJECT_TYPE_LONG);
+	if (arg == NULL) {
+		return NULL;
+	}
+
+	alive = coroutine_alive (longobject_get_value (arg));
+
+	object_free (arg);
+
+	return boolobject_new (alive, NULL);
+}
+
+static object_t *
+_builtin_coroutine_free (object_t *args)
+{
+	object_t *arg;
+	int ok;
+
+	arg = object_cast (ARG (args, 0), OBJECT_TYPE_LONG);
+	if (arg == NULL) {
+		return NULL;
+	}
+
+	ok = coroutine_free (longobject_get_value (arg));
+
+	object_free (arg);
+
+	return ok? DUMMY: NULL;
+}
+
+static object_t *
+_builtin_loop_spawn (object_t *args)
+{
+	object_t *co_args;
+	long co;
+
+	co_args = _builtin_call_args (args, "loop_spawn");
+	if (co_args == NULL) {
+		return NULL;
+	}
+
+	co = event_spawn (funcobject_get_value (ARG (args, 0)), co_args);
+	object_free (co_args);
+	if (co == 0L) {
+		return NULL;
+	}
+
+	return longobject_new (co, NULL);
+}
+
+static object_t *
+_builtin_loop_run (object_t *args)
+{
+	UNUSED (args);
+
+	/* Runs the spawned tasks until all of them end. */
+	return event_run ()? DUMMY: NULL;
+}
+
+static object_t *
+_builtin_sleep (object_t *args)
+{
+	object_t *arg;
+	long ms;
+
+	arg = object_cast (ARG (args, 0), OBJECT_TYPE_LONG);
+	if (arg == NULL) {
+		return NULL;
+	}
+	ms = longobject_get_value (arg);
+	object_free (arg);
+
+	/* In milliseconds. */
+	return event_sleep (ms);
+}
+
+static object_t *
+_builtin_fd_read (object_t *args)
+{
+	integer_value_t fd;
+	integer_value_t n;
+
+	if (!_builtin_integer_arg (args, 0, &fd) || !_builtin_integer_arg (args, 1, &n)) {
+		return NULL;
+	}
+
+	return event_read ((int) fd, (long) n);
+}
+
+static object_t *
+_builtin_fd_write (object_t *args)
+{
+	integer_value_t fd;
+
+	if (!OBJECT_IS_STR (ARG (args, 1))) {
+		error ("only str can be written to fd.");
+
+		return NULL;
+	}
+	if (!_builtin_integer_arg (args, 0, &fd)) {
+		return NULL;
+	}
+
+	return event_write ((int) fd, ARG (args, 1));
+}
+
+static object_t *
+_builtin_fd_close (object_t *args)
+{
+	integer_value_t fd;
+
+	if (!_builtin_integer_arg (args, 0, &fd)) {
+		return NULL;
+	}
+
+	return event_close ((int) fd)? DUMMY: NULL;
+}
+
+static object_t *
+_builtin_pipe (object_t *args)
+{
+	UNUSED (args);
+
+	return event_pipe (0);
+}
+
+static object_t *
+_builtin_socketpair (object_t *args)
+{
+	UNUSED (args);
+
+	return event_pipe (1);
+}
+
+static object_t *
+_builtin_intern (object_t *args)
+{
+	object_t *arg;
+
+	arg = ARG (args, 0);
+	if (!OBJECT_IS_STR (arg)) {
+		error ("the argument of intern must be str.");
+
+		return NULL;
+	}
+
+	return strobject_intern_obj (arg);
+}
+
+static object_t *
+_builtin_strbuf (object_t *args)
+{
+	UNUSED (args);
+
+	return strobject_builder_new ();
+}
+
+static object_t *
+_builtin_strbuf_append (object_t *args)
+{
+	object_t *sb;
+
+	sb = ARG (args, 0);
+	if (sb == NULL || !OBJECT_IS_STR (sb)) {
+		error ("the first argument of strbuf_append must be strbuf.");
+
+		return NULL;
+	}
+
+	for (int i = 1; ARG (args, i) != NULL; i++) {
+		if (!OBJECT_IS_STR (ARG (args, i))) {
+			error ("only str can be appended to strbuf.");
+
+			return NULL;
+		}
+		if (!strobject_builder_append (sb, ARG (args, i))) {
+			return NULL;
+		}
+	}
+
+	return DUMMY;
+}
+
+static object_t *
+_builtin_strbuf_finish (object_t *args)
+{
+	object_t *sb;
+
+	sb = ARG (args, 0);
+	if (!OBJECT_IS_STR (sb)) {
+		error ("the argument of strbuf_finish must be strbuf.");
+
+		return NULL;
+	}
+
+	return strobject_builder_finish (sb);
+}
+
+/* Check that the first n arguments are strs. */
+static int
+_builtin_str_args (object_t *args, int n, const char *name)
+{
+	for (int i = 0; i < n; i++) {
+		if (!OBJECT_IS_STR (ARG (args, i))) {
+			error ("the arguments of %s must be str.", name);
+
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static object_t *
+_builtin_find (object_t *args)
+{
+	integer_value_t pos;
+
+	if (!_builtin_str_args (args, 2, "find")) {
+		return NULL;
+	}
+
+	pos = str_find (strobject_get_value (ARG (args, 0)),
+					strobject_get_value (ARG (args, 1)), 0);
+
+	return longobject_new ((long) pos, NULL);
+}
+
+static object_t *
+_builtin_count (object_t *args)
+{
+	size_t n;
+
+	if (!_builtin_str_args (args, 2, "count")) {
+		return NULL;
+	}
+
+	n = str_count (strobject_get_value (ARG (args, 0)),
+				   strobject_get_value (ARG (args, 1)));
+
+	return longobject_new ((long) n, NULL);
+}
+
+static object_t *
+_builtin_split (object_t *args)
+{
+	size_t size;
+
+	size = ARG_SIZE (args);
+	if (size != 1 && size != 2) {
+		error ("split takes a str and an optional separator.");
+
+		return NULL;
+	}
+	if (!_builtin_str_args (args, (int) size, "split")) {
+		return NULL;
+	}
+
+	return strobject_split (ARG (args, 0), size == 2? ARG (args, 1): NULL);
+}
+
+static object_t *
+_builtin_replace (object_t *args)
+{
+	str_t *from;
+
+	if (!_builtin_str_args (args, 3, "replace")) {
+		return NULL;
+	}
+
+	from = strobject_get_value (ARG (args, 1));
+	if (str_len (from) == 0) {
+		error ("can't replace an empty str.");
+
+		return NULL;
+	}
+
+	return strobject_str_new (str_replace (strobject_get_value (ARG (args, 0)),
+										   from, strobject_get_value (ARG (args, 2))), NULL);
+}
+
+static object_t *
+_builtin_startswith (object_t *args)
+{
+	if (!_builtin_str_args (args, 2, "startswith")) {
+		return NULL;
+	}
+
+	return boolobject_new (str_starts_with (strobject_get_value (ARG (args, 0)),
+											strobject_get_value (ARG (args, 1))), NULL);
+}
+
+static object_t *
+_builtin_gc_set_pause (object_t *args)
+{
+	object_t *arg;
+	int ok;
+
+	/* Max pause in microseconds. */
+	arg = object_cast (ARG (args, 0), OBJECT_TYPE_LONG);
+	if (arg == NULL) {
+		return NULL;
+	}
+
+	ok = gc_set_max_pause (longobject_get_value (arg));
+
+	object_free (arg);
+	if (!ok) {
+		error ("gc pause should be positive.");
+
+		return NULL;
+	}
+
+	return DUMMY;
+}
+
+static object_t *
+_builtin_gc_set_threshold (object_t *args)
+{
+	object_t *gen;
+	object_t *threshold;
+	int ok;
+
+	gen = object_cast (ARG (args, 0), OBJECT_TYPE_LONG);
+	if (gen == NULL) {
+		return NULL;
+	}
+	threshold = object_cast (ARG (args, 1), OBJECT_TYPE_LONG);
+	if (threshold == NULL) {
+		object_free (gen);
+
+		return NULL;
+	}
+
+	ok = gc_set_threshold ((int) longobject_get_value (gen),
+						   (int) longobject_get_value (threshold));
+
+	object_free (gen);
+	object_free (threshold);
+	if (!ok) {
+		error ("invalid gc generation or threshold.");
+
+		return NULL;
+	}
+
+	return DUMMY;
+}
+
+static object_t *
+_builtin_gc_enable (object_t *args)
+{
+	UNUSED (args);
+	gc_enable ();
+
+	return DUMMY;
+}
+
+static object_t *
+_builtin_gc_disable (object_t *args)
+{
+	UNUSED (args);
+	gc_disable ();
+
+	return DUMMY;
+}
+
+static object_t *
+_builtin_gc_collect (object_t *args)
+{
+	UNUSED (args);
+	gc_collect_full ();
+
+	return DUMMY;
+}
+
+static int
+_builtin_stats_set (object_t *dict, const char *name, object_t *value)
+{
+	object_t *key;
+
+	key = strobject_new (name, strlen (name), 1, NULL);
+	if (key == NULL || value == NULL) {
+		return 0;
+	}
+
+	return object_ipindex (dict, key, value) != NULL;
+}
+
+static object_t *
+_builtin_alloc_stats (object_t *args)
+{
+	static const char *freelist_names[FREELIST_NUM] = {"int", "double", "str"};
+	pool_stats_t stats;
+	object_t *res;
+	int ok;
+
+	UNUSED (args);
+	pool_get_stats (&stats);
+	res = dictobject_new (NULL);
+	if (res == NULL) {
+		return NULL;
+	}
+
+	ok = _builtin_stats_set (res, "alloc", longobject_new ((long) stats.alloc, NULL)) &&
+		_builtin_stats_set (res, "free", longobject_new ((long) stats.free, NULL)) &&
+		_builtin_stats_set (res, "large_alloc", longobject_new ((long) stats.large_alloc, NULL));
+	for (int i = 0; ok && i < FREELIST_NUM; i++) {
+		char name[64];
+		size_t total;
+		double rate;
+
+		total = stats.freelist_hit[i] + stats.freelist_miss[i];
+		rate = total == 0? 0.0: (double) stats.freelist_hit[i] / (double) total;
+		snprintf (name, sizeof (name), "%s_freelist_size", freelist_names[i]);
+		ok = _builtin_stats_set (res, name, longobject_new ((long) stats.freelist_size[i], NULL));
+		snprintf (name, sizeof (name), "%s_freelist_hit_rate", freelist_names[i]);
+		ok = ok && _builtin_stats_set (res, name, doubleobject_new (rate, NULL));
+	}
+	if (!ok) {
+		object_free (res);
+		error ("failed to collect allocator stats.");
+
+		return NULL;
+	}
+
+	return res;
+}
+
+static object_t *
+_builtin_gc_stats (object_t *args)
+{
+	gc_stats_t stats;
+	object_t *res;
+	int ok;
+
+	UNUSED (args);
+	gc_get_stats (&stats);
+	res = dictobject_new (NULL);
+	if (res == NULL) {
+		return NULL;
+	}
+
+	ok = _builtin_stats_set (res, "enabled", longobject_new ((long) stats.enabled, NULL)) &&
+		_builtin_stats_set (res, "scanned", longobject_new ((long) stats.scanned, NULL)) &&
+		_builtin_stats_set (res, "freed", longobject_new ((long) stats.freed, NULL)) &&
+		_builtin_stats_set (res, "pauses", longobject_new ((long) stats.pauses, NULL)) &&
+		_builtin_stats_set (res, "total_pause", longobject_new (stats.total_pause, NULL)) &&
+		_builtin_stats_set (res, "max_pause", longobject_new (stats.max_pause, NULL));
+	for (int i = 0; ok && i < GC_GEN_NUM; i++) {
+		char name[64];
+
+		snprintf (name, sizeof (name), "gen%d_collections", i);
+		ok = _builtin_stats_set (res, name, longobject_new ((long) stats.collections[i], NULL));
+		snprintf (name, sizeof (name), "gen%d_threshold", i);
+		ok = ok && _builtin_stats_set (res, name, longobject_new ((long) stats.threshold[i], NULL));
+	}
+	if (!ok) {
+		object_free (res);
+		error ("failed to collect gc stats.");
+
+		return NULL;
+	}
+
+	return res;
+}
+
 typedef struct builtin_slot_s
 {
 	int id;
@@ -318,6 +1414,69 @@ static builtin_slot_t g_builtin_slot_list[] =
 	{9, "thread_join", _builtin_thread_join, 0, 1, {OBJECT_TYPE_ALL}},
 	{10, "thread_detach", _builtin_thread_detach, 0, 1, {OBJECT_TYPE_ALL}},
 	{11, "thread_cancel", _builtin_thread_cancel, 0, 1, {OBJECT_TYPE_ALL}},
+	{12, "alloc_stats", _builtin_alloc_stats, 0, 0, {}},
+	{13, "gc_set_pause", _builtin_gc_set_pause, 0, 1, {OBJECT_TYPE_ALL}},
+	{14, "gc_set_threshold", _builtin_gc_set_threshold, 0, 2, {OBJECT_TYPE_ALL, OBJECT_TYPE_ALL}},
+	{15, "gc_enable", _builtin_gc_enable, 0, 0, {}},
+	{16, "gc_disable", _builtin_gc_disable, 0, 0, {}},
+	{17, "gc_collect", _builtin_gc_collect, 0, 0, {}},
+	{18, "gc_stats", _builtin_gc_stats, 0, 0, {}},
+	{19, "thread_pool_size", _builtin_thread_pool_size, 0, 1, {OBJECT_TYPE_ALL}},
+	{20, "chan_new", _builtin_chan_new, 0, 1, {OBJECT_TYPE_ALL}},
+	{21, "chan_send", _builtin_chan_send, 0, 2, {OBJECT_TYPE_ALL, OBJECT_TYPE_ALL}},
+	{22, "chan_recv", _builtin_chan_recv, 0, 1, {OBJECT_TYPE_ALL}},
+	{23, "chan_close", _builtin_chan_close, 0, 1, {OBJECT_TYPE_ALL}},
+	{24, "pmap", _builtin_pmap, 0, 2, {OBJECT_TYPE_ALL, OBJECT_TYPE_ALL}},
+	{25, "pfor", _builtin_pfor, 0, 3, {OBJECT_TYPE_ALL, OBJECT_TYPE_ALL, OBJECT_TYPE_ALL}},
+	{26, "preduce", _builtin_preduce, 0, 3, {OBJECT_TYPE_ALL, OBJECT_TYPE_ALL, OBJECT_TYPE_ALL}},
+	{27, "share", _builtin_share, 0, 1, {OBJECT_TYPE_ALL}},
+	{28, "mutex_new", _builtin_mutex_new, 0, 0, {}},
+	{29, "mutex_lock", _builtin_mutex_lock, 0, 1, {OBJECT_TYPE_ALL}},
+	{30, "mutex_unlock", _builtin_mutex_unlock, 0, 1, {OBJECT_TYPE_ALL}},
+	{31, "mutex_trylock", _builtin_mutex_trylock, 0, 1, {OBJECT_TYPE_ALL}},
+	{32, "rwlock_new", _builtin_rwlock_new, 0, 0, {}},
+	{33, "rwlock_rdlock", _builtin_rwlock_rdlock, 0, 1, {OBJECT_TYPE_ALL}},
+	{34, "rwlock_wrlock", _builtin_rwlock_wrlock, 0, 1, {OBJECT_TYPE_ALL}},
+	{35, "rwlock_unlock", _builtin_rwlock_unlock, 0, 1, {OBJECT_TYPE_ALL}},
+	{36, "cond_new", _builtin_cond_new, 0, 0, {}},
+	{37, "cond_wait", _builtin_cond_wait, 0, 2, {OBJECT_TYPE_ALL, OBJECT_TYPE_ALL}},
+	{38, "cond_signal", _builtin_cond_signal, 0, 1, {OBJECT_TYPE_ALL}},
+	{39, "cond_broadcast", _builtin_cond_broadcast, 0, 1, {OBJECT_TYPE_ALL}},
+	{40, "atomic_int", _builtin_atomic_int, 0, 1, {OBJECT_TYPE_ALL}},
+	{41, "atomic_long", _builtin_atomic_long, 0, 1, {OBJECT_TYPE_ALL}},
+	{42, "atomic_load", _builtin_atomic_load, 0, 1, {OBJECT_TYPE_ALL}},
+	{43, "atomic_store", _builtin_atomic_store, 0, 2, {OBJECT_TYPE_ALL, OBJECT_TYPE_ALL}},
+	{44, "atomic_add", _builtin_atomic_add, 0, 2, {OBJECT_TYPE_ALL, OBJECT_TYPE_ALL}},
+	{45, "atomic_cas", _builtin_atomic_cas, 0, 3, {OBJECT_TYPE_ALL, OBJECT_TYPE_ALL, OBJECT_TYPE_ALL}},
+	{46, "thread_wait_any", _builtin_thread_wait_any, 0, 1, {OBJECT_TYPE_ALL}},
+	{47, "thread_wait_all", _builtin_thread_wait_all, 0, 2, {OBJECT_TYPE_ALL, OBJECT_TYPE_ALL}},
+	{48, "coroutine_create", _builtin_coroutine_create, 1, 0, {}},
+	{49, "yield", _builtin_yield, 1, 0, {}},
+	{50, "resume", _builtin_resume, 1, 0, {}},
+	{51, "coroutine_alive", _builtin_coroutine_alive, 0, 1, {OBJECT_TYPE_ALL}},
+	{52, "loop_spawn", _builtin_loop_spawn, 1, 0, {}},
+	{53, "loop_run", _builtin_loop_run, 0, 0, {}},
+	{54, "sleep", _builtin_sleep, 0, 1, {OBJECT_TYPE_ALL}},
+	{55, "fd_read", _builtin_fd_read, 0, 2, {OBJECT_TYPE_ALL, OBJECT_TYPE_ALL}},
+	{56, "fd_write", _builtin_fd_write, 0, 2, {OBJECT_TYPE_ALL, OBJECT_TYPE_ALL}},
+	{57, "fd_close", _builtin_fd_close, 0, 1, {OBJECT_TYPE_ALL}},
+	{58, "pipe", _builtin_pipe, 0, 0, {}},
+	{59, "socketpair", _builtin_socketpair, 0, 0, {}},
+	{60, "intern", _builtin_intern, 0, 1, {OBJECT_TYPE_ALL}},
+	{61, "strbuf", _builtin_strbuf, 0, 0, {}},
+	{62, "strbuf_append", _builtin_strbuf_append, 1, 0, {}},
+	{63, "strbuf_finish", _builtin_strbuf_finish, 0, 1, {OBJECT_TYPE_ALL}},
+	{64, "find", _builtin_find, 0, 2, {OBJECT_TYPE_ALL, OBJECT_TYPE_ALL}},
+	{65, "count", _builtin_count, 0, 2, {OBJECT_TYPE_ALL, OBJECT_TYPE_ALL}},
+	{66, "split", _builtin_split, 1, 0, {}},
+	{67, "replace", _builtin_replace, 0, 3, {OBJECT_TYPE_ALL, OBJECT_TYPE_ALL, OBJECT_TYPE_ALL}},
+	{68, "startswith", _builtin_startswith, 0, 2, {OBJECT_TYPE_ALL, OBJECT_TYPE_ALL}},
+	{69, "chan_free", _builtin_chan_free, 0, 1, {OBJECT_TYPE_ALL}},
+	{70, "mutex_free", _builtin_mutex_free, 0, 1, {OBJECT_TYPE_ALL}},
+	{71, "rwlock_free", _builtin_rwlock_free, 0, 1, {OBJECT_TYPE_ALL}},
+	{72, "cond_free", _builtin_cond_free, 0, 1, {OBJECT_TYPE_ALL}},
+	{73, "atomic_free", _builtin_atomic_free, 0, 1, {OBJECT_TYPE_ALL}},
+	{74, "coroutine_free", _builtin_coroutine_free, 0, 1, {OBJECT_TYPE_ALL}},
 	{0, NULL, NULL, 0, 0, {}}
 };
 
@@ -473,7 +1632,7 @@ builtin_init ()
 		object_t *func;
 		object_t *suc;
 
-		word = strobject_new (slot->name, strlen (slot->name), 0, NULL);
+		word = strobject_intern (slot->name, strlen (slot->name));
 		if (word == NULL) {
 			fatal_error ("failed to generate the reserved word dict.");
 		}
@@ -0,0 +1,382 @@
+/*
+ * chan.c
+ * This file is part of koa
+ *
+ * Copyright (C) 2018 - Gordon Li
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "chan.h"
+#include "handle.h"
+#include "thread.h"
+#include "nullobject.h"
+#include "error.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_PTHREAD_H
+#include "thread_pthread.h"
+#else
+#endif
+
+#define CACHE_LINE 64
+
+/* A chan is a bounded MPMC ring, each cell has a sequence number that
+ * tells whether it is ready to be written or read at a given position.
+ * Both ends claim positions with a CAS, and only sleep on the lock when
+ * the ring is full or empty. */
+
+typedef struct chan_cell_s
+{
+	_Atomic size_t seq;
+	packed_object_t value;
+} chan_cell_t;
+
+typedef struct chan_s
+{
+	_Alignas (CACHE_LINE) _Atomic size_t head; /* Next position to receive. */
+	_Alignas (CACHE_LINE) _Atomic size_t tail; /* Next position to send. */
+	_Alignas (CACHE_LINE) size_t capacity;
+	chan_cell_t *cells;
+	_Atomic int closed;
+	_Atomic int sleepers;
+	_thread_mutex_t lock;
+	_thread_cond_t cond;
+} chan_t;
+
+/* Chan ops pin the chan, so that it is only freed once the last of them
+ * is done. Every found chan needs a handle_put. */
+static chan_t *
+chan_find (long id)
+{
+	chan_t *chan;
+
+	chan = (chan_t *) handle_acquire (id, HANDLE_CHAN);
+	if (chan == NULL) {
+		error ("invalid chan: %ld.", id);
+
+		return NULL;
+	}
+
+	return chan;
+}
+
+static int
+chan_try_send (chan_t *chan, packed_object_t *value)
+{
+	chan_cell_t *cell;
+	size_t pos;
+
+	pos = atomic_load_explicit (&chan->tail, memory_order_relaxed);
+	for (;;) {
+		intptr_t diff;
+
+		cell = &chan->cells[pos % chan->capacity];
+		diff = (intptr_t) atomic_load_explicit (&cell->seq, memory_order_acquire) - (intptr_t) pos;
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit (&chan->tail, &pos, pos + 1,
+													   memory_order_relaxed,
+													   memory_order_relaxed)) {
+				break;
+			}
+		}
+		else if (diff < 0) {
+			/* Full. */
+			return 0;
+		}
+		else {
+			pos = atomic_load_explicit (&chan->tail, memory_order_relaxed);
+		}
+	}
+
+	cell->value = *value;
+	atomic_store_explicit (&cell->seq, pos + 1, memory_order_release);
+
+	return 1;
+}
+
+static int
+chan_try_recv (chan_t *chan, packed_object_t *value)
+{
+	chan_cell_t *cell;
+	size_t pos;
+
+	pos = atomic_load_explicit (&chan->head, memory_order_relaxed);
+	for (;;) {
+		intptr_t diff;
+
+		cell = &chan->cells[pos % chan->capacity];
+		diff = (intptr_t) atomic_load_explicit (&cell->seq, memory_order_acquire) - (intptr_t) (pos + 1);
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit (&chan->head, &pos, pos + 1,
+													   memory_order_relaxed,
+													   memory_order_relaxed)) {
+				break;
+			}
+		}
+		else if (diff < 0) {
+			/* Empty. */
+			return 0;
+		}
+		else {
+			pos = atomic_load_explicit (&chan->head, memory_order_relaxed);
+		}
+	}
+
+	*value = cell->value;
+	atomic_store_explicit (&cell->seq, pos + chan->capacity, memory_order_release);
+
+	return 1;
+}
+
+static int
+chan_is_full (chan_t *chan)
+{
+	size_t pos;
+
+	pos = atomic_load (&chan->tail);
+
+	return atomic_load (&chan->cells[pos % chan->capacity].seq) != pos;
+}
+
+static int
+chan_is_empty (chan_t *chan)
+{
+	size_t pos;
+
+	pos = atomic_load (&chan->head);
+
+	return atomic_load (&chan->cells[pos % chan->capacity].seq) != pos + 1;
+}
+
+/* Sleep until the other end makes progress. Sleepers are counted before
+ * the ring is checked again, and wakers read the count after they made
+ * progress, so no wakeup can be lost between the two. */
+static void
+chan_wait (chan_t *chan, int sending)
+{
+	thread_block_begin ();
+	_thread_mutex_lock (&chan->lock);
+	atomic_fetch_add (&chan->sleepers, 1);
+	while (!atomic_load (&chan->closed) &&
+		   (sending? chan_is_full (chan): chan_is_empty (chan))) {
+		_thread_cond_wait (&chan->cond, &chan->lock);
+	}
+	atomic_fetch_sub (&chan->sleepers, 1);
+	_thread_mutex_unlock (&chan->lock);
+	thread_block_end ();
+}
+
+static void
+chan_wake (chan_t *chan)
+{
+	atomic_thread_fence (memory_order_seq_cst);
+	if (atomic_load (&chan->sleepers) > 0) {
+		_thread_mutex_lock (&chan->lock);
+		_thread_cond_broadcast (&chan->cond);
+		_thread_mutex_unlock (&chan->lock);
+	}
+}
+
+/* Run by whoever drops the last pin, values still in the ring are not
+ * going to be received anymore. */
+static void
+chan_destroy (void *ptr)
+{
+	chan_t *chan;
+	size_t pos;
+	size_t tail;
+
+	chan = (chan_t *) ptr;
+	tail = atomic_load (&chan->tail);
+	for (pos = atomic_load (&chan->head); pos != tail; pos++) {
+		object_pack_free (&chan->cells[pos % chan->capacity].value);
+	}
+	free ((void *) chan->cells);
+	_thread_mutex_destroy (&chan->lock);
+	_thread_cond_destroy (&chan->cond);
+	free ((void *) chan);
+}
+
+long
+chan_new (long capacity)
+{
+	chan_t *chan;
+	long id;
+
+	if (capacity <= 0) {
+		error ("chan capacity should be positive.");
+
+		return 0L;
+	}
+
+	chan = (chan_t *) aligned_alloc (CACHE_LINE, sizeof (chan_t));
+	if (chan == NULL) {
+		fatal_error ("out of memory.");
+	}
+	memset ((void *) chan, 0, sizeof (chan_t));
+	chan->capacity = (size_t) capacity;
+	chan->cells = (chan_cell_t *) calloc (chan->capacity, sizeof (chan_cell_t));
+	if (chan->cells == NULL) {
+		fatal_error ("out of memory.");
+	}
+	for (size_t i = 0; i < chan->capacity; i++) {
+		atomic_init (&chan->cells[i].seq, i);
+	}
+	_thread_mutex_init (&chan->lock);
+	_thread_cond_init (&chan->cond);
+
+	id = handle_new (HANDLE_CHAN, (void *) chan, chan_destroy);
+	if (id == 0L) {
+		chan_destroy ((void *) chan);
+	}
+
+	return id;
+}
+
+int
+chan_send (long id, object_t *obj)
+{
+	chan_t *chan;
+	packed_object_t value;
+
+	chan = chan_find (id);
+	if (chan == NULL) {
+		return 0;
+	}
+	if (atomic_load (&chan->closed)) {
+		handle_put (id);
+		error ("send on a closed chan.");
+
+		return 0;
+	}
+
+	if (!object_pack (obj, &value)) {
+		handle_put (id);
+
+		return 0;
+	}
+	while (!chan_try_send (chan, &value)) {
+		if (atomic_load (&chan->closed)) {
+			object_pack_free (&value);
+			handle_put (id);
+			error ("send on a closed chan.");
+
+			return 0;
+		}
+		chan_wait (chan, 1);
+	}
+	chan_wake (chan);
+	handle_put (id);
+
+	return 1;
+}
+
+object_t *
+chan_recv (long id)
+{
+	chan_t *chan;
+	packed_object_t value;
+	object_t *obj;
+
+	chan = chan_find (id);
+	if (chan == NULL) {
+		return NULL;
+	}
+
+	while (!chan_try_recv (chan, &value)) {
+		/* Values sent before closing are still delivered. */
+		if (atomic_load (&chan->closed)) {
+			if (chan_try_recv (chan, &value)) {
+				break;
+			}
+			handle_put (id);
+
+			return nullobject_new (NULL);
+		}
+		chan_wait (chan, 0);
+	}
+	chan_wake (chan);
+	handle_put (id);
+
+	obj = object_unpack (&value);
+	object_pack_free (&value);
+
+	return obj;
+}
+
+static int
+chan_shut (chan_t *chan)
+{
+	int expected;
+
+	expected = 0;
+	if (!atomic_compare_exchange_strong (&chan->closed, &expected, 1)) {
+		return 0;
+	}
+
+	_thread_mutex_lock (&chan->lock);
+	_thread_cond_broadcast (&chan->cond);
+	_thread_mutex_unlock (&chan->lock);
+
+	return 1;
+}
+
+int
+chan_close (long id)
+{
+	chan_t *chan;
+	int ok;
+
+	chan = chan_find (id);
+	if (chan == NULL) {
+		return 0;
+	}
+
+	ok = chan_shut (chan);
+	handle_put (id);
+	if (!ok) {
+		error ("close of a closed chan.");
+	}
+
+	return ok;
+}
+
+/* Closes the chan if needed, so blocked ends give up, and releases the
+ * handle. Memory goes away once they are all out, later uses of id are
+ * errors. */
+int
+chan_free (long id)
+{
+	chan_t *chan;
+
+	chan = chan_find (id);
+	if (chan == NULL) {
+		return 0;
+	}
+
+	chan_shut (chan);
+	handle_release (id, HANDLE_CHAN);
+	handle_put (id);
+
+	return 1;
+}
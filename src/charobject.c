@@ -53,7 +53,7 @@ static object_t *charobject_op_land (object_t *obj1, object_t *obj2);
 static object_t *charobject_op_lor (object_t *obj1, object_t *obj2);
 static object_t *charobject_op_eq (object_t *obj1, object_t *obj2);
 static object_t *charobject_op_cmp (object_t *obj1, object_t *obj2);
-static object_t *charobject_op_hash (object_t *obj);
+static uint64_t charobject_op_hash (object_t *obj);
 static object_t *charobject_op_binary (object_t *obj);
 
 static object_opset_t g_object_ops =
@@ -160,15 +160,10 @@ charobject_op_cmp (object_t *obj1, object_t *obj2)
 }
 
 /* Hash. */
-static object_t *
-charobject_op_hash(object_t *obj)
+static uint64_t
+charobject_op_hash (object_t *obj)
 {
-	if (OBJECT_DIGEST (obj) == 0) {
-		OBJECT_DIGEST (obj) = object_integer_hash (object_get_integer (obj));
-	}
-
-	/* The digest is already computed. */
-	return uint64object_new (OBJECT_DIGEST (obj), NULL);
+	return object_integer_hash (object_get_integer (obj));
 }
 
 /* Binary. */
@@ -211,12 +206,6 @@ charobject_load_buf (const char **buf, size_t *len)
 	return charobject_new (val, NULL);
 }
 
-static uint64_t
-charobject_digest_fun (void *obj)
-{
-	return object_integer_hash (object_get_integer ((object_t *) obj));
-}
-
 object_t *
 charobject_new (char val, void *udata)
 {
@@ -232,8 +221,7 @@ charobject_new (char val, void *udata)
 		fatal_error ("out of memory.");
 	}
 
-	OBJECT_NEW_INIT (obj, OBJECT_TYPE_CHAR, udata);
-	OBJECT_DIGEST_FUN (obj) = charobject_digest_fun;
+	OBJECT_NEW_INIT (obj, OBJECT_TYPE_CHAR);
 
 	obj->val = val;
 
@@ -257,9 +245,11 @@ charobject_init ()
 		return;
 	}
 
+	object_register_opset (OBJECT_TYPE_CHAR, &g_object_ops);
+
 	/* Make char cache. */
-	for (char i = CHAR_CACHE_MIN; i <= CHAR_CACHE_MAX; i++) {
-		g_char_cache[CHAR_CACHE_INDEX (i)] = charobject_new (i, NULL);
+	for (int i = CHAR_CACHE_MIN; i <= CHAR_CACHE_MAX; i++) {
+		g_char_cache[CHAR_CACHE_INDEX (i)] = charobject_new ((char) i, NULL);
 		if (g_char_cache[CHAR_CACHE_INDEX (i)] == NULL) {
 			fatal_error ("failed to init object system.");
 
@@ -267,6 +257,6 @@ charobject_init ()
 		}
 
 		/* Should never be freed. */
-		object_ref (g_char_cache[CHAR_CACHE_INDEX (i)]);
+		object_set_const (g_char_cache[CHAR_CACHE_INDEX (i)]);
 	}
 }
@@ -350,7 +350,7 @@ code_push_const (code_t *code, object_t *var, int *exist)
 
 	*exist = 0;
 
-	object_set_const (var);
+	object_freeze (var);
 
 	/* Return the index of this new var. */
 	return vec_size (code->consts) - 1;
@@ -370,22 +370,16 @@ code_push_varname (code_t *code, const char *var, object_type_t type, int para)
 		return -1;
 	}
 
-	name = strobject_new (var, strlen (var), 0, NULL);
-	if (name == NULL) {
-		return -1;
-	}
+	/* Names are interned, so lookups mostly compare addresses. */
+	name = strobject_intern (var, strlen (var));
 
 	/* Check whether there is already a var. */
 	if (type == OBJECT_TYPE_VOID && (pos = vec_find (code->varnames,
 		(void *) name, code_var_find_fun)) != -1) {
-		object_free (name);
-
 		return pos;
 	}
 
 	if (!vec_push_back (code->varnames, (void *) name)) {
-		object_free (name);
-
 		return -1;
 	}
 
@@ -614,7 +608,7 @@ code_object_to_binary (vec_t *vec)
 	res = object_binary (obj);
 	gc_untrack (obj);
 	/* Data can not be freed. */
-	pool_free ((void *) obj);
+	gc_free ((void *) obj);
 
 	return res;
 }
@@ -956,7 +950,7 @@ code_binary_to_object (FILE *f)
 	for (integer_value_t i = 0; i < (integer_value_t) size; i++) {
 		gc_untrack ((object_t *) vec_pos(vec, i));
 	}
-	pool_free ((void *) obj);
+	gc_free ((void *) obj);
 
 	return vec;
 }
@@ -978,7 +972,7 @@ code_buf_to_object (const char **buf, size_t *len)
 	for (integer_value_t i = 0; i < (integer_value_t) size; i++) {
 		gc_untrack ((object_t *) vec_pos(vec, i));
 	}
-	pool_free ((void *) obj);
+	gc_free ((void *) obj);
 
 	return vec;
 }
@@ -1054,8 +1048,10 @@ code_binary_to_str (FILE *f)
 	if (obj == NULL) {
 		return NULL;
 	}
+	/* Short strs keep their str_t in the object. */
 	str = strobject_get_value (obj);
-	pool_free ((void *) obj);
+	str = str_new (str_c_str (str), str_len (str));
+	object_free (obj);
 
 	return str;
 }
@@ -1070,8 +1066,10 @@ code_buf_to_str (const char **buf, size_t *len)
 	if (obj == NULL) {
 		return NULL;
 	}
+	/* Short strs keep their str_t in the object. */
 	str = strobject_get_value (obj);
-	pool_free ((void *) obj);
+	str = str_new (str_c_str (str), str_len (str));
+	object_free (obj);
 
 	return str;
 }
@@ -1096,6 +1094,37 @@ code_load_header (FILE *f)
 	return 1;
 }
 
+/* Replace the loaded str at pos with its interned one. */
+static void
+code_intern_pos (vec_t *vec, integer_value_t pos)
+{
+	object_t *obj;
+
+	obj = (object_t *) vec_pos (vec, pos);
+	UNUSED (vec_set (vec, pos, (void *) strobject_intern_obj (obj)));
+	object_unref (obj);
+}
+
+/* Loaded code is shared by threads like parsed one. */
+static void
+code_freeze (code_t *code)
+{
+	for (integer_value_t i = 0; i < (integer_value_t) vec_size (code->consts); i++) {
+		object_t *obj;
+
+		obj = (object_t *) vec_pos (code->consts, i);
+		if (OBJECT_IS_STR (obj)) {
+			code_intern_pos (code->consts, i);
+		}
+		else {
+			object_freeze (obj);
+		}
+	}
+	for (integer_value_t i = 0; i < (integer_value_t) vec_size (code->varnames); i++) {
+		code_intern_pos (code->varnames, i);
+	}
+}
+
 code_t *
 code_load_binary (const char *path, FILE *f)
 {
@@ -1176,6 +1205,7 @@ code_load_binary (const char *path, FILE *f)
 	if (f == NULL) {
 		UNUSED (fclose (b));
 	}
+	code_freeze (code);
 
 	return code;
 }
@@ -1232,6 +1262,7 @@ code_load_buf (const char **buf, size_t *len)
 
 		return NULL;
 	}
+	code_freeze (code);
 
 	return code;
 }
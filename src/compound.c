@@ -21,9 +21,23 @@
 #include <string.h>
 
 #include "compound.h"
+#include "strobject.h"
 #include "pool.h"
 #include "error.h"
 
+/* Field names are interned, the same names come from the code looking
+ * them up. */
+static str_t *
+compound_intern (str_t *str)
+{
+	str_t *interned;
+
+	interned = strobject_get_value (strobject_intern (str_c_str (str), str_len (str)));
+	str_free (str);
+
+	return interned;
+}
+
 compound_t *
 compound_new (const char *name)
 {
@@ -52,7 +66,6 @@ compound_free (compound_t *meta)
 
 		field = (field_t *) vec_pos (meta->fields, (integer_value_t) i);
 		if (field != NULL) {
-			str_free (field->name);
 			pool_free ((void *) field);
 		}
 	}
@@ -70,7 +83,7 @@ compound_push_field (compound_t *meta, const char *name, object_type_t type)
 		fatal_error ("out of memory.");
 	}
 
-	field->name = str_new (name, strlen (name));
+	field->name = strobject_get_value (strobject_intern (name, strlen (name)));
 	field->type = type;
 	if (!vec_push_back (meta->fields, (void *) field)) {
 		fatal_error ("failed to add field.");
@@ -168,10 +181,10 @@ compound_field_load_binary (FILE *f)
 
 		return NULL;
 	}
+	field->name = compound_intern (field->name);
 
 	/* Read type. */
 	if (fread (&field->type, sizeof (object_type_t), 1, f) != 1) {
-		str_free (field->name);
 		pool_free ((void *) field);
 		error ("failed to load type while load compound field.");
 
@@ -198,10 +211,10 @@ compound_field_load_buf (const char **buf, size_t *len)
 
 		return NULL;
 	}
+	field->name = compound_intern (field->name);
 
 	/* Read type. */
 	if (*len < sizeof (object_type_t)) {
-		str_free (field->name);
 		pool_free ((void *) field);
 		error ("failed to load type while load compound field.");
 
@@ -336,7 +349,7 @@ compound_to_binary (compound_t *meta)
 		field_t *field;
 
 		field = (field_t *) vec_pos (meta->fields, (integer_value_t) i);
-		total += sizeof (size_t) + str_len (field->name) + sizeof (int);
+		total += sizeof (size_t) + str_len (field->name) + sizeof (object_type_t);
 	}
 
 	buf = (char *) pool_alloc (total);
@@ -349,8 +362,8 @@ compound_to_binary (compound_t *meta)
 
 		field = (field_t *) vec_pos (meta->fields, (integer_value_t) i);
 		pos = compound_save_name (field->name, pos);
-		memcpy (pos, (void *) &field->type, (unsigned) sizeof (int));
-		pos += sizeof (int);
+		memcpy (pos, (void *) &field->type, (unsigned) sizeof (object_type_t));
+		pos += sizeof (object_type_t);
 	}
 
 	str = str_new (buf, total);
@@ -401,7 +414,7 @@ compound_find_field (compound_t *meta, str_t *name)
 		field_t *field;
 
 		field = (field_t *) vec_pos (meta->fields, (integer_value_t) i);
-		if (str_cmp (field->name, name) == 0) {
+		if (field->name == name || str_cmp (field->name, name) == 0) {
 			return (integer_value_t) i;
 		}
 	}
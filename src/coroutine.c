@@ -0,0 +1,246 @@
+/*
+ * coroutine.c
+ * This file is part of koa
+ *
+ * Copyright (C) 2018 - Gordon Li
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+
+#include "coroutine.h"
+#include "interpreter.h"
+#include "pool.h"
+#include "vecobject.h"
+#include "error.h"
+
+#define COROUTINE_ID(slot, gen) ((long) (((unsigned long) (gen) << 32) | ((unsigned long) (slot) + 1)))
+#define COROUTINE_SLOT(id) ((size_t) (((unsigned long) (id) & 0xffffffffUL) - 1))
+#define COROUTINE_GEN(id) ((unsigned int) ((unsigned long) (id) >> 32))
+
+/* Coroutines belong to the thread that creates them. Their slots are
+ * reused once they end, the generation in the handle tells a stale
+ * handle from the new owner of its slot. */
+typedef struct coroutine_slot_s
+{
+	coroutine_t *co;
+	unsigned int gen;
+	size_t next_free;
+} coroutine_slot_t;
+
+static __thread coroutine_slot_t *g_slots;
+
+static __thread size_t g_slot_num;
+
+static __thread size_t g_slot_cap;
+
+static __thread size_t g_free_slot; /* Plus one, 0 if none. */
+
+static coroutine_t *
+coroutine_find (long id)
+{
+	size_t slot;
+
+	slot = COROUTINE_SLOT (id);
+	if (id <= 0 || slot >= g_slot_num || g_slots[slot].co == NULL ||
+		g_slots[slot].gen != COROUTINE_GEN (id)) {
+		return NULL;
+	}
+
+	return g_slots[slot].co;
+}
+
+static void
+coroutine_destroy (coroutine_t *co)
+{
+	object_t *obj;
+
+	if (co->args != NULL) {
+		object_unref (co->args);
+	}
+	if (co->transfer != NULL) {
+		object_unref (co->transfer);
+	}
+	/* A suspended frame is not linked to any other. */
+	if (co->frame != NULL) {
+		UNUSED (frame_free (co->frame));
+	}
+	while (stack_get_sp (co->s) > 0) {
+		obj = (object_t *) stack_pop (co->s);
+		object_unref (obj);
+	}
+	stack_free (co->s);
+	pool_free ((void *) co);
+}
+
+static void
+coroutine_release (long id)
+{
+	size_t slot;
+
+	slot = COROUTINE_SLOT (id);
+	coroutine_destroy (g_slots[slot].co);
+	g_slots[slot].co = NULL;
+	g_slots[slot].gen++;
+	g_slots[slot].next_free = g_free_slot;
+	g_free_slot = slot + 1;
+}
+
+long
+coroutine_create (code_t *code, object_t *args)
+{
+	coroutine_t *co;
+	size_t slot;
+
+	if (!code_check_args (code, vecobject_get_value (args))) {
+		return 0L;
+	}
+
+	co = (coroutine_t *) pool_calloc (1, sizeof (coroutine_t));
+	if (co == NULL) {
+		fatal_error ("out of memory.");
+	}
+	co->s = stack_new ();
+	if (co->s == NULL) {
+		fatal_error ("out of memory.");
+	}
+	co->code = code;
+	co->args = args;
+	object_ref (args);
+	co->state = COROUTINE_CREATED;
+
+	if (g_free_slot != 0) {
+		slot = g_free_slot - 1;
+		g_free_slot = g_slots[slot].next_free;
+	}
+	else {
+		if (g_slot_num == g_slot_cap) {
+			coroutine_slot_t *slots;
+
+			g_slot_cap = g_slot_cap == 0? 16: g_slot_cap * 2;
+			slots = (coroutine_slot_t *) realloc (g_slots, g_slot_cap * sizeof (coroutine_slot_t));
+			if (slots == NULL) {
+				fatal_error ("out of memory.");
+			}
+			g_slots = slots;
+		}
+		slot = g_slot_num++;
+		g_slots[slot].gen = 1;
+	}
+	g_slots[slot].co = co;
+	co->id = COROUTINE_ID (slot, g_slots[slot].gen);
+
+	return co->id;
+}
+
+object_t *
+coroutine_resume (long id, object_t *value)
+{
+	coroutine_t *co;
+	object_t *res;
+
+	co = coroutine_find (id);
+	if (co == NULL) {
+		error ("invalid coroutine: %ld.", id);
+
+		return NULL;
+	}
+	if (co->state == COROUTINE_RUNNING) {
+		error ("coroutine is already running: %ld.", id);
+
+		return NULL;
+	}
+
+	res = interpreter_resume (co, value);
+	/* It is gone once it returns or fails. */
+	if (co->state == COROUTINE_DEAD) {
+		coroutine_release (id);
+	}
+
+	return res;
+}
+
+int
+coroutine_yield (object_t *value)
+{
+	return interpreter_yield (value);
+}
+
+int
+coroutine_alive (long id)
+{
+	return coroutine_find (id) != NULL;
+}
+
+long
+coroutine_current ()
+{
+	coroutine_t *co;
+
+	co = interpreter_get_coroutine ();
+
+	return co != NULL? co->id: 0L;
+}
+
+/* Drop a coroutine that is not run to its end, with its frame and
+ * whatever it holds. Running ones, the current one and its resumers,
+ * can't be freed. */
+int
+coroutine_free (long id)
+{
+	coroutine_t *co;
+
+	co = coroutine_find (id);
+	if (co == NULL) {
+		error ("invalid coroutine: %ld.", id);
+
+		return 0;
+	}
+	if (co->state == COROUTINE_RUNNING) {
+		error ("coroutine is running: %ld.", id);
+
+		return 0;
+	}
+
+	coroutine_release (id);
+
+	return 1;
+}
+
+/* Whether yield would suspend the running coroutine, rather than fail. */
+int
+coroutine_can_yield ()
+{
+	return interpreter_can_yield ();
+}
+
+void
+coroutine_cleanup ()
+{
+	for (size_t i = 0; i < g_slot_num; i++) {
+		if (g_slots[i].co != NULL) {
+			/* The frames of running ones are freed with the others. */
+			if (g_slots[i].co->state == COROUTINE_RUNNING) {
+				g_slots[i].co->frame = NULL;
+			}
+			coroutine_destroy (g_slots[i].co);
+		}
+	}
+	free ((void *) g_slots);
+	g_slots = NULL;
+	g_slot_num = 0;
+	g_slot_cap = 0;
+	g_free_slot = 0;
+}
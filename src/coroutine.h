@@ -0,0 +1,78 @@
+/*
+ * coroutine.h
+ * This file is part of koa
+ *
+ * Copyright (C) 2018 - Gordon Li
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+#include "koa.h"
+#include "code.h"
+#include "frame.h"
+#include "stack.h"
+#include "object.h"
+
+typedef enum coroutine_state_e
+{
+	COROUTINE_CREATED,
+	COROUTINE_SUSPENDED,
+	COROUTINE_RUNNING,
+	COROUTINE_DEAD
+} coroutine_state_t;
+
+/* A coroutine runs a func in a frame of its own, with its own operand
+ * stack. Suspending it only unlinks the frame from the chain of its
+ * resumer, no C stack is kept, so yield works in the body of the func
+ * but not in funcs it calls. */
+typedef struct coroutine_s
+{
+	code_t *code;
+	object_t *args; /* Bound on the first resume. */
+	frame_t *frame;
+	st_t *s;
+	coroutine_state_t state;
+	object_t *transfer; /* Given to yield, taken by resume. */
+	struct coroutine_s *resumer;
+	long id;
+} coroutine_t;
+
+long
+coroutine_create (code_t *code, object_t *args);
+
+object_t *
+coroutine_resume (long id, object_t *value);
+
+int
+coroutine_yield (object_t *value);
+
+int
+coroutine_alive (long id);
+
+int
+coroutine_free (long id);
+
+long
+coroutine_current ();
+
+int
+coroutine_can_yield ();
+
+void
+coroutine_cleanup ();
+
+#endif /* COROUTINE_H */
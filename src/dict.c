@@ -20,68 +20,155 @@
 
 #include <stdio.h>
 #include <string.h>
-#include <limits.h>
 
 #include "dict.h"
 #include "pool.h"
 #include "error.h"
 
-#define DICT_REQ_BUCKET 8 /* Initial allocation size. */
+#define DICT_INDEX_EMPTY (-1)
 
-#define MAX_DICT_BUCKET INT_MAX
+#define DICT_MIN_INDICES 8
 
-static uint64_t
-dict_hash_fun (void *data)
+/* Entries may take up to the load of the index table. As each entry
+ * takes one control byte at most until the next resize, the table
+ * always has empty slots to end probes. */
+#define DICT_USABLE(x) HASH_MAX_LOAD (x)
+
+/* Int keys are mixed, as the groups are picked by the high bits. */
+#define IDICT_HASH(x) (((uint64_t) (x) * 0x9e3779b97f4a7c15ULL) ^ ((uint64_t) (x) >> 32))
+
+/* The index slot holding key, whose entry is put in *index, or
+ * DICT_INDEX_EMPTY if key is missing. */
+static size_t
+dict_lookup (dict_t *dict, void *key, uint64_t hash, int32_t *index)
+{
+	hash_probe_t probe;
+	uint8_t h2;
+
+	h2 = HASH_H2 (hash);
+	hash_probe_start (&probe, hash, dict->mask + 1);
+	for (;;) {
+		const uint8_t *group;
+
+		group = dict->ctrl + probe.offset;
+		for (unsigned int m = hash_group_match (group, h2); m != 0; m &= m - 1) {
+			size_t i;
+			dict_entry_t *entry;
+
+			i = probe.offset + (size_t) __builtin_ctz (m);
+			entry = dict->entries + dict->indices[i];
+			if (entry->hash == hash && (entry->key == key || dict->tf (entry->key, key))) {
+				*index = dict->indices[i];
+
+				return i;
+			}
+		}
+		/* A probe never goes past a group with an empty slot. */
+		if (hash_group_match (group, HASH_CTRL_EMPTY) != 0) {
+			*index = DICT_INDEX_EMPTY;
+
+			return 0;
+		}
+		hash_probe_next (&probe);
+	}
+}
+
+/* A block of entries followed by n index slots and their control
+ * bytes, all empty. */
+static void *
+dict_alloc (size_t n, size_t entry_size, size_t *usable, int32_t **indices, uint8_t **ctrl)
 {
-	dict_node_t *node;
+	char *block;
 
-	node = (dict_node_t *) data;
+	if (n > (size_t) INT32_MAX) {
+		fatal_error ("dict is too large.");
+	}
 
-	return node->d->hf (node->first);
+	*usable = DICT_USABLE (n);
+	block = (char *) pool_alloc (*usable * entry_size + n * sizeof (int32_t) + HASH_CTRL_SIZE (n));
+	if (block == NULL) {
+		fatal_error ("out of memory.");
+	}
+	*indices = (int32_t *) (block + *usable * entry_size);
+	*ctrl = (uint8_t *) (*indices + n);
+	hash_ctrl_reset (*ctrl, n);
+
+	return (void *) block;
 }
 
-static int
-dict_hash_test_fun (void *value, void *hd)
+/* Index slots for size live entries, so that as many can be added
+ * before the next resize. */
+static size_t
+dict_grow_size (size_t size)
 {
-	dict_node_t *node;
+	size_t n;
 
-	node = (dict_node_t *) value;
+	for (n = DICT_MIN_INDICES; DICT_USABLE (n) < size * 2 + 1; n <<= 1) {
+	}
 
-	return node->d->tf (node->first, hd);
+	return n;
 }
 
 static void
-dict_hash_cleanup_fun (void *value)
+dict_index_set (int32_t *indices, uint8_t *ctrl, size_t n, uint64_t hash, int32_t ix)
 {
-	pool_free (value);
+	size_t i;
+
+	i = hash_find_free (ctrl, n, hash);
+	ctrl[i] = HASH_H2 (hash);
+	indices[i] = ix;
+}
+
+/* Move live entries to a block with n index slots, dropping removed
+ * ones and rebuilding the indices. */
+static void
+dict_resize (dict_t *dict, size_t n)
+{
+	dict_entry_t *entries;
+	size_t used;
+
+	entries = dict->entries;
+	used = dict->used;
+	dict->entries = (dict_entry_t *) dict_alloc (n, sizeof (dict_entry_t),
+												 &dict->usable, &dict->indices, &dict->ctrl);
+	dict->mask = n - 1;
+
+	dict->used = 0;
+	for (size_t i = 0; i < used; i++) {
+		if (entries[i].key == NULL) {
+			continue;
+		}
+		dict->entries[dict->used] = entries[i];
+		dict_index_set (dict->indices, dict->ctrl, n, entries[i].hash, (int32_t) dict->used);
+		dict->used++;
+	}
+
+	if (entries != NULL) {
+		pool_free ((void *) entries);
+	}
 }
 
 dict_t *
 dict_new (hash_f hf, hash_test_f tf)
 {
-	size_t req;
 	dict_t *dict;
 
-	req = DICT_REQ_BUCKET;
-
 	dict = pool_alloc (sizeof (dict_t));
 	if (dict == NULL) {
 		fatal_error ("out of memory.");
 	}
 
-	dict->used = 0;
-	dict->bu_size = req;
-	dict->size = 0;
+	/* The table is allocated on the first insertion, many dicts (block
+	 * namespaces mostly) never get one. */
+	dict->entries = NULL;
+	dict->indices = NULL;
+	dict->ctrl = NULL;
 	dict->hf = hf;
 	dict->tf = tf;
-	dict->h = hash_new (req,
-						dict_hash_fun,
-						dict_hash_test_fun,
-						dict_hash_cleanup_fun);
-	if (dict->h == NULL) {
-		pool_free ((void *) dict);
-		fatal_error ("out of memory.");
-	}
+	dict->mask = 0;
+	dict->used = 0;
+	dict->usable = 0;
+	dict->size = 0;
 
 	return dict;
 }
@@ -89,199 +176,317 @@ dict_new (hash_f hf, hash_test_f tf)
 void
 dict_free (dict_t *dict)
 {
-	hash_free ((void *) dict->h);
+	if (dict->entries != NULL) {
+		pool_free ((void *) dict->entries);
+	}
 	pool_free ((void *) dict);
 }
 
-static int
-dict_rehash (dict_t *dict, size_t req)
+void *
+dict_set (dict_t *dict, void *key, void *value)
 {
-	if (req > MAX_DICT_BUCKET) {
-		error ("hash bucket too big.");
+	uint64_t hash;
+	int32_t ix;
+	void *prev_value;
+	dict_entry_t *entry;
 
-		return 0;
-	}
+	hash = dict->hf (key);
 
-	if (req > dict->bu_size) {
-		req = dict->bu_size * 2;
-	}
-	else if (req < dict->bu_size / 4) {
-		req = dict->bu_size / 2;
-		if (req < DICT_REQ_BUCKET) {
-			req = DICT_REQ_BUCKET;
+	if (dict->entries != NULL) {
+		/* Already an entry with this key? */
+		UNUSED (dict_lookup (dict, key, hash, &ix));
+		if (ix >= 0) {
+			entry = dict->entries + ix;
+			prev_value = entry->value;
+			entry->value = value;
+
+			return prev_value;
 		}
 	}
-	else {
-		req = dict->bu_size;
+
+	/* Resizing also reclaims the removed entries. */
+	if (dict->used == dict->usable) {
+		dict_resize (dict, dict_grow_size (dict->size));
 	}
 
-	if (req != dict->bu_size) {
-		hash_t *new_hash;
-		vec_t *vec;
-		size_t size;
-		dict_node_t *dn;
+	ix = (int32_t) dict->used++;
+	entry = dict->entries + ix;
+	entry->hash = hash;
+	entry->key = key;
+	entry->value = value;
+	dict_index_set (dict->indices, dict->ctrl, dict->mask + 1, hash, ix);
+	dict->size++;
 
-		new_hash = hash_new (req,
-							 dict_hash_fun,
-							 dict_hash_test_fun,
-							 dict_hash_cleanup_fun);
-		if (new_hash == NULL) {
-			error ("failed to rehash.");
+	return value;
+}
 
-			return 0;
-		}
+void *
+dict_get (dict_t *dict, void *key)
+{
+	int32_t ix;
+
+	if (dict->size == 0) {
+		return NULL;
+	}
 
-		vec = hash_get_all_values (dict->h);
-		if (vec == NULL) {
-			error ("failed to get previous values while rehasing.");
+	UNUSED (dict_lookup (dict, key, dict->hf (key), &ix));
+	if (ix < 0) {
+		return NULL;
+	}
 
-			return 0;
-		}
+	return dict->entries[ix].value;
+}
 
-		size = vec_size (vec);
-		for (integer_value_t i = 0; i < size; i++) {
-			dn = (dict_node_t *) vec_pos (vec, i);
-			dn->hn = hash_add (new_hash, (void *) dn);
-			if (dn->hn == NULL) {
-				hash_free (new_hash);
-				error ("failed to rehash, can not add hash node.");
+/* Return the original key and set *value to the
+ * original value. */
+void *
+dict_remove (dict_t *dict, void *key, void **value)
+{
+	int32_t ix;
+	size_t i;
+	dict_entry_t *entry;
+	void *origin_key;
 
-				return 0;
-			}
-		}
+	ix = DICT_INDEX_EMPTY;
+	i = 0;
+	if (dict->size != 0) {
+		i = dict_lookup (dict, key, dict->hf (key), &ix);
+	}
 
-		/* Clear old hash table. */
-		hash_free (dict->h);
+	/* Key is not presented? */
+	if (ix < 0) {
+		*value = NULL;
+		error ("key doesn't exist.");
+
+		return NULL;
+	}
 
-		dict->h = new_hash;
-		dict->bu_size = req;
+	entry = dict->entries + ix;
+	origin_key = entry->key;
+	*value = entry->value;
+
+	entry->key = NULL;
+	entry->value = NULL;
+	hash_erase (dict->ctrl, i);
+	dict->size--;
+
+	/* Start over when emptied, so deleted slots don't pile up. */
+	if (dict->size == 0) {
 		dict->used = 0;
-		for (uint64_t i = 0; i < (uint64_t) req; i++) {
-			if (hash_occupied (dict->h, i)) {
-				dict->used++;
-			}
+		hash_ctrl_reset (dict->ctrl, dict->mask + 1);
+	}
+
+	return origin_key;
+}
+
+size_t
+dict_size (dict_t *dict)
+{
+	return dict->size;
+}
+
+/* Walk the entries in insertion order, pos starts at 0. The values of
+ * visited keys may be replaced, but nothing may be added or removed. */
+int
+dict_next (dict_t *dict, size_t *pos, void **key, void **value)
+{
+	while (*pos < dict->used) {
+		dict_entry_t *entry;
+
+		entry = dict->entries + (*pos)++;
+		if (entry->key != NULL) {
+			*key = entry->key;
+			*value = entry->value;
+
+			return 1;
 		}
 	}
 
-	return 1;
+	return 0;
 }
 
-void *
-dict_set (dict_t *dict, void *key, void *value)
+/* The index slot holding key, or the first empty one on its probe
+ * sequence if key is missing. */
+static size_t
+idict_lookup (idict_t *dict, int64_t key, int32_t *index)
 {
+	hash_probe_t probe;
 	uint64_t hash;
-	dict_node_t *node;
-	void *prev_value;
-	int occupied;
+	uint8_t h2;
 
-	hash = dict->hf (key);
+	hash = IDICT_HASH (key);
+	h2 = HASH_H2 (hash);
+	hash_probe_start (&probe, hash, dict->mask + 1);
+	for (;;) {
+		const uint8_t *group;
+
+		group = dict->ctrl + probe.offset;
+		for (unsigned int m = hash_group_match (group, h2); m != 0; m &= m - 1) {
+			size_t i;
+
+			i = probe.offset + (size_t) __builtin_ctz (m);
+			if (dict->entries[dict->indices[i]].key == key) {
+				*index = dict->indices[i];
 
-	/* Already a node with this key? */
-	node = (dict_node_t *) hash_test (dict->h, key, hash);
-	if (node != NULL) {
-		prev_value = node->second;
-		node->second = value;
+				return i;
+			}
+		}
+		if (hash_group_match (group, HASH_CTRL_EMPTY) != 0) {
+			*index = DICT_INDEX_EMPTY;
 
-		return prev_value;
+			return 0;
+		}
+		hash_probe_next (&probe);
 	}
+}
+
+static void
+idict_resize (idict_t *dict, size_t n)
+{
+	idict_entry_t *entries;
+	size_t used;
 
-	/* Need rehash? */
-	occupied = hash_occupied (dict->h, hash);
-	if (occupied == 0) {
-		if (dict_rehash (dict, dict->used + 1) == 0) {
-			return NULL;
+	entries = dict->entries;
+	used = dict->used;
+	dict->entries = (idict_entry_t *) dict_alloc (n, sizeof (idict_entry_t),
+												  &dict->usable, &dict->indices, &dict->ctrl);
+	dict->mask = n - 1;
+
+	dict->used = 0;
+	for (size_t i = 0; i < used; i++) {
+		if (entries[i].value == NULL) {
+			continue;
 		}
+		dict->entries[dict->used] = entries[i];
+		dict_index_set (dict->indices, dict->ctrl, n, IDICT_HASH (entries[i].key), (int32_t) dict->used);
+		dict->used++;
 	}
 
-	node = (dict_node_t *) pool_alloc (sizeof (dict_node_t));
-	if (node == NULL) {
-		fatal_error ("out of memory.");
+	if (entries != NULL) {
+		pool_free ((void *) entries);
 	}
+}
 
-	node->d = dict;
-	node->first = key;
-	node->second = value;
-	node->hn = hash_add (dict->h, (void *) node);
-	if (node->hn == NULL) {
-		pool_free ((void *) node);
-		error ("failed to add hash node.");
+idict_t *
+idict_new ()
+{
+	idict_t *dict;
 
-		return NULL;
+	dict = pool_calloc (1, sizeof (idict_t));
+	if (dict == NULL) {
+		fatal_error ("out of memory.");
 	}
 
-	dict->size++;
-	dict->used += occupied? 0: 1;
+	return dict;
+}
 
-	return value;
+void
+idict_free (idict_t *dict)
+{
+	if (dict->entries != NULL) {
+		pool_free ((void *) dict->entries);
+	}
+	pool_free ((void *) dict);
 }
 
+/* Return the value replaced, or NULL if key is new. */
 void *
-dict_get (dict_t *dict, void *key)
+idict_set (idict_t *dict, int64_t key, void *value)
 {
-	uint64_t hash;
-	dict_node_t *node;
+	int32_t ix;
+	idict_entry_t *entry;
 
-	hash = dict->hf (key);
+	if (dict->size != 0) {
+		UNUSED (idict_lookup (dict, key, &ix));
+		if (ix >= 0) {
+			void *prev_value;
 
-	node = (dict_node_t *) hash_test (dict->h, key, hash);
-	if (node == NULL) {
-		return NULL;
+			entry = dict->entries + ix;
+			prev_value = entry->value;
+			entry->value = value;
+
+			return prev_value;
+		}
+	}
+
+	if (dict->used == dict->usable) {
+		idict_resize (dict, dict_grow_size (dict->size));
 	}
 
-	return node->second;
+	ix = (int32_t) dict->used++;
+	entry = dict->entries + ix;
+	entry->key = key;
+	entry->value = value;
+	dict_index_set (dict->indices, dict->ctrl, dict->mask + 1, IDICT_HASH (key), ix);
+	dict->size++;
+
+	return NULL;
 }
 
-/* Return the original key and set *value to the
- * original value. */
 void *
-dict_remove (dict_t *dict, void *key, void **value)
+idict_get (idict_t *dict, int64_t key)
 {
-	uint64_t hash;
-	dict_node_t *node;
-	int occupied;
-	void *origin_key;
+	int32_t ix;
 
-	hash = dict->hf (key);
+	if (dict->size == 0) {
+		return NULL;
+	}
 
-	/* Key is not presented? */
-	node = (dict_node_t *) hash_test (dict->h, key, hash);
-	if (node == NULL) {
-		*value = NULL;
-		error ("key doesn't exist.");
+	UNUSED (idict_lookup (dict, key, &ix));
+
+	return ix < 0? NULL: dict->entries[ix].value;
+}
+
+/* Return the value removed, or NULL if key is missing. */
+void *
+idict_remove (idict_t *dict, int64_t key)
+{
+	int32_t ix;
+	size_t i;
+	void *value;
 
+	if (dict->size == 0) {
 		return NULL;
 	}
 
-	origin_key = node->first;
-	*value = node->second;
+	i = idict_lookup (dict, key, &ix);
+	if (ix < 0) {
+		return NULL;
+	}
 
-	hash_fast_remove (dict->h, node->hn);
+	value = dict->entries[ix].value;
+	dict->entries[ix].value = NULL;
+	hash_erase (dict->ctrl, i);
 	dict->size--;
-	/* Need rehash? */
-	occupied = hash_occupied (dict->h, hash);
-	if (occupied == 0) {
-		dict->used--;
-		if (dict_rehash (dict, dict->used) == 0) {
-			pool_free ((void *) node);
-
-			return NULL;
-		}
-	}
 
-	pool_free ((void *) node);
+	if (dict->size == 0) {
+		dict->used = 0;
+		hash_ctrl_reset (dict->ctrl, dict->mask + 1);
+	}
 
-	return origin_key;
+	return value;
 }
 
 size_t
-dict_size (dict_t *dict)
+idict_size (idict_t *dict)
 {
 	return dict->size;
 }
 
-vec_t *
-dict_pairs (dict_t *dict)
+int
+idict_next (idict_t *dict, size_t *pos, int64_t *key, void **value)
 {
-	return hash_get_all_values (dict->h);
-}
+	while (*pos < dict->used) {
+		idict_entry_t *entry;
 
+		entry = dict->entries + (*pos)++;
+		if (entry->value != NULL) {
+			*key = entry->key;
+			*value = entry->value;
+
+			return 1;
+		}
+	}
+
+	return 0;
+}
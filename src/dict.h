@@ -23,27 +23,47 @@
 
 #include "koa.h"
 #include "hash.h"
-#include "vec.h"
 
-#define DICT_PAIR_KEY(x) (((dict_node_t *)(x))->first)
-#define DICT_PAIR_VALUE(x) (((dict_node_t *)(x))->second)
+typedef struct dict_entry_s
+{
+	uint64_t hash; /* Of key, so it is never computed again. */
+	void *key; /* NULL once removed. */
+	void *value;
+} dict_entry_t;
 
+/* Entries are kept densely in insertion order, the index table maps
+ * hashes to positions in entries. It is probed by groups of control
+ * bytes as in hash.h. Entries, indices and control bytes live in one
+ * block. */
 typedef struct dict_s {
-	hash_t *h;
+	dict_entry_t *entries;
+	int32_t *indices;
+	uint8_t *ctrl;
 	hash_f hf;
 	hash_test_f tf;
-	size_t used; /* Hash buckets used. */
-	size_t bu_size; /* Number of hash buckets. */
+	size_t mask; /* Of indices, 0 if nothing is allocated yet. */
+	size_t used; /* Entries taken, removed ones included. */
+	size_t usable; /* Room in entries. */
 	size_t size;
 } dict_t;
 
-typedef struct dict_node_s
+/* The same layout for int64 keys, which are stored unboxed and hashed
+ * as they are. */
+typedef struct idict_entry_s
 {
-	dict_t *d;
-	void *hn; /* Handle for fast removing. */
-	void *first;
-	void *second;
-} dict_node_t;
+	int64_t key;
+	void *value; /* NULL once removed. */
+} idict_entry_t;
+
+typedef struct idict_s {
+	idict_entry_t *entries;
+	int32_t *indices;
+	uint8_t *ctrl;
+	size_t mask;
+	size_t used;
+	size_t usable;
+	size_t size;
+} idict_t;
 
 dict_t *
 dict_new (hash_f hf, hash_test_f tf);
@@ -63,7 +83,28 @@ dict_remove (dict_t *dict, void *key, void **value);
 size_t
 dict_size (dict_t *dict);
 
-vec_t *
-dict_pairs (dict_t *dict);
+int
+dict_next (dict_t *dict, size_t *pos, void **key, void **value);
+
+idict_t *
+idict_new ();
+
+void
+idict_free (idict_t *dict);
+
+void *
+idict_set (idict_t *dict, int64_t key, void *value);
+
+void *
+idict_get (idict_t *dict, int64_t key);
+
+void *
+idict_remove (idict_t *dict, int64_t key);
+
+size_t
+idict_size (idict_t *dict);
+
+int
+idict_next (idict_t *dict, size_t *pos, int64_t *key, void **value);
 
 #endif /* DICT_H */
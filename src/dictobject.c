@@ -18,19 +18,27 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdio.h>
 #include <string.h>
+#include <stdint.h>
 
 #include "dictobject.h"
 #include "pool.h"
 #include "hash.h"
 #include "gc.h"
+#include "global.h"
 #include "error.h"
 #include "thread.h"
 #include "nullobject.h"
 #include "boolobject.h"
+#include "intobject.h"
+#include "longobject.h"
 #include "uint64object.h"
 #include "strobject.h"
 
+/* Keys that can be kept unboxed in an int table. */
+#define DICT_UNBOXED(x) (OBJECT_IS_INT((x))||OBJECT_IS_LONG((x)))
+
 static object_t *g_dump_head;
 static object_t *g_dump_tail;
 static object_t *g_dump_sep;
@@ -44,7 +52,7 @@ static object_t *dictobject_op_eq (object_t *obj1, object_t *obj2);
 static object_t *dictobject_op_index (object_t *obj1, object_t *obj2);
 static object_t *dictobject_op_ipindex (object_t *obj1,
 										object_t *obj2, object_t *obj3);
-static object_t *dictobject_op_hash (object_t *obj);
+static uint64_t dictobject_op_hash (object_t *obj);
 static object_t *dictobject_op_binary (object_t *obj);
 static object_t *dictobject_op_len (object_t *obj);
 
@@ -78,36 +86,154 @@ static object_opset_t g_object_ops =
 	dictobject_op_len /* Binary. */
 };
 
-/* Free. */
-void
-dictobject_op_free (object_t *obj)
+/* Hash function for dict. */
+static uint64_t
+dictobject_hash_fun (void *data)
 {
-	dict_t *dict;
-	vec_t *pairs;
-	size_t size;
+	object_t *obj;
 
-	dict = dictobject_get_value (obj);
-	pairs = dict_pairs (dict);
-	if (pairs == NULL) {
-		return;
+	obj = (object_t *) data;
+
+	return object_digest (obj);
+}
+
+static int
+dictobject_test_fun (void *key, void *hd)
+{
+	object_t *res;
+
+	if (OBJECT_IS_STR ((object_t *) key) && OBJECT_IS_STR ((object_t *) hd)) {
+		return strobject_equal ((object_t *) key, (object_t *) hd);
 	}
 
-	size = vec_size (pairs);
-	/* Unref all pairs. */
-	for (integer_value_t i = 0; i < (integer_value_t) size; i++) {
-		object_t *key;
-		object_t *value;
+	res = (object_t *) object_equal ((object_t *) key, (object_t *) hd);
+	if (res == NULL) {
+		error ("hash test failed.");
+
+		return 0;
+	}
 
-		key = (object_t *) DICT_PAIR_KEY (vec_pos (pairs, i));
-		value = (object_t *) DICT_PAIR_VALUE (vec_pos (pairs, i));
-		object_unref (key);
-		if (value != obj) {
-			object_unref (value);
+	return (int) object_get_integer (res);
+}
+
+static object_t *
+dictobject_box (object_type_t type, int64_t key)
+{
+	if (type == OBJECT_TYPE_INT) {
+		return intobject_new ((int) key, NULL);
+	}
+
+	return longobject_new ((long) key, NULL);
+}
+
+/* The generic table of ob, made on demand. Unboxed keys are boxed and
+ * moved there, after which the dict never goes back to the int table. */
+static dict_t *
+dictobject_generic (dictobject_t *ob)
+{
+	size_t pos;
+	int64_t key;
+	void *value;
+
+	if (ob->val != NULL) {
+		return ob->val;
+	}
+
+	ob->val = dict_new (dictobject_hash_fun, dictobject_test_fun);
+	if (ob->ints == NULL) {
+		return ob->val;
+	}
+
+	pos = 0;
+	while (idict_next (ob->ints, &pos, &key, &value)) {
+		object_t *boxed;
+
+		boxed = dictobject_box (ob->key_type, key);
+		UNUSED (dict_set (ob->val, (void *) boxed, value));
+		object_ref (boxed);
+	}
+	idict_free (ob->ints);
+	ob->ints = NULL;
+
+	return ob->val;
+}
+
+/* Walk the pairs like dict_next. Unboxed keys come out as new objects,
+ * so every key is to be released with object_free, which leaves the
+ * ones owned by a generic table alone. */
+static int
+dictobject_next (dictobject_t *ob, size_t *pos, object_t **key, object_t **value)
+{
+	int64_t k;
+
+	if (ob->val != NULL) {
+		return dict_next (ob->val, pos, (void **) key, (void **) value);
+	}
+
+	if (ob->ints == NULL || !idict_next (ob->ints, pos, &k, (void **) value)) {
+		return 0;
+	}
+	*key = dictobject_box (ob->key_type, k);
+
+	return 1;
+}
+
+static size_t
+dictobject_size (dictobject_t *ob)
+{
+	if (ob->val != NULL) {
+		return dict_size (ob->val);
+	}
+
+	return ob->ints != NULL? idict_size (ob->ints): 0;
+}
+
+static object_t *
+dictobject_get (dictobject_t *ob, object_t *key)
+{
+	if (ob->val == NULL) {
+		if (ob->ints != NULL && OBJECT_TYPE (key) == ob->key_type) {
+			return (object_t *) idict_get (ob->ints, (int64_t) object_get_integer (key));
+		}
+		/* Numbers of other types may still equal an unboxed key. */
+		if (ob->ints == NULL || !NUMBERICAL_TYPE (key)) {
+			return NULL;
 		}
 	}
 
-	vec_free (pairs);
-	dict_free (dict);
+	return (object_t *) dict_get (dictobject_generic (ob), (void *) key);
+}
+
+/* Free. */
+static void
+dictobject_op_free (object_t *obj)
+{
+	dictobject_t *ob;
+	size_t pos;
+	void *key;
+	int64_t k;
+	void *value;
+
+	ob = (dictobject_t *) obj;
+	pos = 0;
+	/* Unref all pairs. */
+	if (ob->val != NULL) {
+		while (dict_next (ob->val, &pos, &key, &value)) {
+			object_unref ((object_t *) key);
+			if ((object_t *) value != obj) {
+				object_unref ((object_t *) value);
+			}
+		}
+		dict_free (ob->val);
+	}
+	else if (ob->ints != NULL) {
+		while (idict_next (ob->ints, &pos, &k, &value)) {
+			if ((object_t *) value != obj) {
+				object_unref ((object_t *) value);
+			}
+		}
+		idict_free (ob->ints);
+	}
 
 	gc_untrack ((void *) obj);
 }
@@ -116,34 +242,25 @@ dictobject_op_free (object_t *obj)
 static void
 dictobject_op_print (object_t *obj)
 {
-	dict_t *dict;
-	vec_t *pairs;
-	size_t size;
+	size_t pos;
 	object_t *key;
 	object_t *value;
+	int first;
 
-	dict = dictobject_get_value (obj);
-	pairs = dict_pairs (dict);
-	if (pairs == NULL) {
-		error ("failed to get dict pairs while printing.");
-
-		return;
-	}
-
-	size = vec_size (pairs);
+	pos = 0;
+	first = 1;
 	printf ("{");
-	for (integer_value_t i = 0; i < (integer_value_t) size; i++) {
-		key = (object_t *) DICT_PAIR_KEY (vec_pos (pairs, i));
-		value = (object_t *) DICT_PAIR_VALUE (vec_pos (pairs, i));
+	while (dictobject_next ((dictobject_t *) obj, &pos, &key, &value)) {
+		if (!first) {
+			printf (",");
+		}
+		first = 0;
 		object_print (key);
 		printf (":");
 		object_print (value);
-		if (i != (integer_value_t) size - 1) {
-			printf (",");
-		}
+		object_free (key);
 	}
 	printf ("}");
-	vec_free (pairs);
 }
 
 static object_t *
@@ -200,30 +317,24 @@ dictobject_pair_concat (object_t *key, object_t *value)
 static object_t *
 dictobject_op_dump (object_t *obj)
 {
+	dictobject_t *ob;
 	object_t *res;
-	dict_t *dict;
-	vec_t *pairs;
-	size_t size;
+	size_t pos;
 	object_t *key;
 	object_t *value;
 	object_t *pair;
 
-	dict = dictobject_get_value (obj);
-	pairs = dict_pairs (dict);
-	if (pairs == NULL) {
-		error ("failed to get dict pairs while dumping.");
-
-		return NULL;
-	}
-
-	size = vec_size (pairs);
-	if (!size) {
+	ob = (dictobject_t *) obj;
+	pos = 0;
+	if (!dictobject_next (ob, &pos, &key, &value)) {
 		return object_add (g_dump_head, g_dump_tail);
 	}
 
-	key = (object_t *) DICT_PAIR_KEY (vec_pos (pairs, 0));
-	value = (object_t *) DICT_PAIR_VALUE (vec_pos (pairs, 0));
 	pair = dictobject_pair_concat (key, value);
+	object_free (key);
+	if (pair == NULL) {
+		return NULL;
+	}
 	res = object_add (g_dump_head, pair);
 	if (res == NULL) {
 		object_free (pair);
@@ -232,12 +343,11 @@ dictobject_op_dump (object_t *obj)
 	}
 	object_free (pair);
 
-	for (integer_value_t i = 1; i < (integer_value_t) size; i++) {
+	while (dictobject_next (ob, &pos, &key, &value)) {
 		object_t *dump;
 
-		key = (object_t *) DICT_PAIR_KEY (vec_pos (pairs, i));
-		value = (object_t *) DICT_PAIR_VALUE (vec_pos (pairs, i));
 		dump = dictobject_pair_concat (key, value);
+		object_free (key);
 		if (dump == NULL) {
 			object_free (res);
 
@@ -250,8 +360,6 @@ dictobject_op_dump (object_t *obj)
 		}
 	}
 
-	vec_free (pairs);
-
 	return dictobject_dump_concat (res, g_dump_tail, 0);
 }
 
@@ -266,26 +374,30 @@ dictobject_op_eq (object_t *obj1, object_t *obj2)
 static object_t *
 dictobject_op_index (object_t *obj1, object_t *obj2)
 {
-	dict_t *dict;
-	void *value;
+	object_t *value;
 
 	if (!NUMBERICAL_TYPE (obj2) && OBJECT_TYPE (obj2) != OBJECT_TYPE_STR) {
 		error ("dict index must be a number or str.");
 
 		return NULL;
 	}
+	if (strobject_is_builder (obj2)) {
+		error ("strbuf can not be a dict key.");
+
+		return NULL;
+	}
 
-	dict = dictobject_get_value (obj1);
-	value = dict_get (dict, (void *) obj2);
+	value = dictobject_get ((dictobject_t *) obj1, obj2);
 
 	/* Return the 'null' object if the key is not presented. */
-	return value == NULL? nullobject_new (NULL): (object_t *) value;
+	return value == NULL? nullobject_new (NULL): value;
 }
 
 /* Inplace index. */
 static object_t *
 dictobject_op_ipindex (object_t *obj1, object_t *obj2, object_t *obj3)
 {
+	dictobject_t *ob;
 	dict_t *dict;
 	object_t *prev;
 	object_t *res;
@@ -295,9 +407,36 @@ dictobject_op_ipindex (object_t *obj1, object_t *obj2, object_t *obj3)
 
 		return NULL;
 	}
+	if (strobject_is_builder (obj2)) {
+		error ("strbuf can not be a dict key.");
+
+		return NULL;
+	}
 
 	/* obj3 is returned if successfully inserted. */
-	dict = dictobject_get_value (obj1);
+	gc_write_barrier ((void *) obj1, (void *) obj3);
+	GLOBAL_WRITE_BARRIER (obj1);
+	ob = (dictobject_t *) obj1;
+
+	/* Integer keys of one type are stored unboxed until another kind
+	 * of key shows up. */
+	if (ob->val == NULL && DICT_UNBOXED (obj2) &&
+		(ob->ints == NULL || OBJECT_TYPE (obj2) == ob->key_type)) {
+		if (ob->ints == NULL) {
+			ob->ints = idict_new ();
+			ob->key_type = OBJECT_TYPE (obj2);
+		}
+
+		object_ref (obj3);
+		prev = (object_t *) idict_set (ob->ints, (int64_t) object_get_integer (obj2), (void *) obj3);
+		if (prev != NULL) {
+			object_unref (prev);
+		}
+
+		return obj3;
+	}
+
+	dict = dictobject_generic (ob);
 	prev = (object_t *) dict_get (dict, (void *) obj2);
 	res = (object_t *) dict_set (dict, (void *) obj2, (void *) obj3);
 	if (res == NULL) {
@@ -316,14 +455,10 @@ dictobject_op_ipindex (object_t *obj1, object_t *obj2, object_t *obj3)
 }
 
 /* Hash. */
-static object_t *
-dictobject_op_hash(object_t *obj)
+static uint64_t
+dictobject_op_hash (object_t *obj)
 {
-	if (OBJECT_DIGEST (obj) == 0) {
-		OBJECT_DIGEST (obj) = object_address_hash ((void *) obj);
-	}
-
-	return uint64object_new (OBJECT_DIGEST (obj), NULL);
+	return object_address_hash ((void *) obj);
 }
 
 static object_t *
@@ -349,44 +484,35 @@ dictobject_binary_concat (object_t *obj1, object_t *obj2)
 static object_t *
 dictobject_op_binary (object_t *obj)
 {
-	dict_t *dict;
-	vec_t *pairs;
+	dictobject_t *ob;
 	size_t size;
+	size_t pos;
+	object_t *key;
+	object_t *value;
 	object_t *temp;
 
-	dict = dictobject_get_value (obj);
-	size = dict_size (dict);
+	ob = (dictobject_t *) obj;
+	size = dictobject_size (ob);
 
 	temp = strobject_new (BINARY (size), sizeof (size_t), 1, NULL);
 	if (temp == NULL) {
 		return NULL;
 	}
 
-	pairs = dict_pairs (dict);
-	if (pairs == NULL) {
-		object_free (temp);
-
-		return NULL;
-	}
-
-	for (integer_value_t i = 0; i < (integer_value_t) size; i++) {
-		object_t *obj;
-
-		obj = (object_t *) DICT_PAIR_KEY (vec_pos (pairs, i));
-		temp = dictobject_binary_concat (temp, obj);
+	pos = 0;
+	while (dictobject_next (ob, &pos, &key, &value)) {
+		temp = dictobject_binary_concat (temp, key);
+		object_free (key);
 		if (temp == NULL) {
 			return NULL;
 		}
 
-		obj = (object_t *) DICT_PAIR_VALUE (vec_pos (pairs, i));
-		temp = dictobject_binary_concat (temp, obj);
+		temp = dictobject_binary_concat (temp, value);
 		if (temp == NULL) {
 			return NULL;
 		}
 	}
 
-	vec_free (pairs);
-
 	return temp;
 }
 
@@ -394,46 +520,14 @@ dictobject_op_binary (object_t *obj)
 static object_t *
 dictobject_op_len (object_t *obj)
 {
-	dict_t *dict;
-	size_t size;
-
-	dict = dictobject_get_value (obj);
-	size = dict_size (dict);
-
-	return uint64object_new ((uint64_t) size, NULL);
-}
-
-/* Hash function for dict. */
-static uint64_t
-dictobject_hash_fun (void *data)
-{
-	object_t *obj;
-
-	obj = (object_t *) data;
-
-	return object_digest (obj);
-}
-
-static int
-dictobject_test_fun (void *key, void *hd)
-{
-	object_t *res;
-
-	res = (object_t *) object_equal ((object_t *) key, (object_t *) hd);
-	if (res == NULL) {
-		error ("hash test failed.");
-
-		return 0;
-	}
-
-	return (int) object_get_integer (res);
+	return uint64object_new ((uint64_t) dictobject_size ((dictobject_t *) obj), NULL);
 }
 
 object_t *
 dictobject_load_binary (FILE *f)
 {
 	size_t size;
-	dict_t *dict;
+	object_t *obj;
 
 	if (fread (&size, sizeof (size_t), 1, f) != 1) {
 		error ("failed to load size while load dict.");
@@ -441,8 +535,8 @@ dictobject_load_binary (FILE *f)
 		return NULL;
 	}
 
-	dict = dict_new (dictobject_hash_fun, dictobject_test_fun);
-	if (dict == NULL) {
+	obj = dictobject_new (NULL);
+	if (obj == NULL) {
 		return NULL;
 	}
 
@@ -452,39 +546,36 @@ dictobject_load_binary (FILE *f)
 
 		key = object_load_binary (f);
 		if (key == NULL) {
-			dict_free (dict);
+			object_free (obj);
 
 			return NULL;
 		}
 		value = object_load_binary (f);
 		if (value == NULL) {
-			dict_free (dict);
+			object_free (obj);
 			object_free (key);
 
 			return NULL;
 		}
 
-
-		if (dict_set (dict, (void *) key, (void *) value) == NULL) {
-			dict_free (dict);
+		if (dictobject_op_ipindex (obj, key, value) == NULL) {
+			object_free (obj);
 			object_free (key);
 			object_free (value);
 
 			return NULL;
 		}
-
-		object_ref (key);
-		object_ref (value);
+		object_free (key);
 	}
 
-	return dictobject_dict_new (dict, NULL);
+	return obj;
 }
 
 object_t *
 dictobject_load_buf (const char **buf, size_t *len)
 {
 	size_t size;
-	dict_t *dict;
+	object_t *obj;
 
 	if (*len < sizeof (size_t)) {
 		error ("failed to load size while load dict.");
@@ -496,8 +587,8 @@ dictobject_load_buf (const char **buf, size_t *len)
 	*buf += sizeof (size_t);
 	*len -= sizeof (size_t);
 
-	dict = dict_new (dictobject_hash_fun, dictobject_test_fun);
-	if (dict == NULL) {
+	obj = dictobject_new (NULL);
+	if (obj == NULL) {
 		return NULL;
 	}
 
@@ -507,38 +598,29 @@ dictobject_load_buf (const char **buf, size_t *len)
 
 		key = object_load_buf (buf, len);
 		if (key == NULL) {
-			dict_free (dict);
+			object_free (obj);
 
 			return NULL;
 		}
 		value = object_load_buf (buf, len);
 		if (value == NULL) {
-			dict_free (dict);
+			object_free (obj);
 			object_free (key);
 
 			return NULL;
 		}
 
-
-		if (dict_set (dict, (void *) key, (void *) value) == NULL) {
-			dict_free (dict);
+		if (dictobject_op_ipindex (obj, key, value) == NULL) {
+			object_free (obj);
 			object_free (key);
 			object_free (value);
 
 			return NULL;
 		}
-
-		object_ref (key);
-		object_ref (value);
+		object_free (key);
 	}
 
-	return dictobject_dict_new (dict, NULL);
-}
-
-static uint64_t
-dictobject_digest_fun (void *obj)
-{
-	return object_address_hash (obj);
+	return obj;
 }
 
 object_t *
@@ -546,99 +628,107 @@ dictobject_new (void *udata)
 {
 	dictobject_t *obj;
 
-	obj = (dictobject_t *) pool_alloc (sizeof (dictobject_t));
+	obj = (dictobject_t *) gc_alloc (sizeof (dictobject_t));
 	if (obj == NULL) {
 		fatal_error ("out of memory.");
 	}
 
-	OBJECT_NEW_INIT (obj, OBJECT_TYPE_DICT, udata);
-	OBJECT_DIGEST_FUN (obj) = dictobject_digest_fun;
-
-	obj->val = dict_new (dictobject_hash_fun, dictobject_test_fun);
-	if (obj->val == NULL) {
-		pool_free ((void *) obj);
-
-		return NULL;
-	}
+	OBJECT_NEW_INIT (obj, OBJECT_TYPE_DICT);
 
-	gc_track ((void *) obj);
+	/* Tables are made on the first insertion, once the kind of the
+	 * keys is known. */
+	obj->val = NULL;
+	obj->ints = NULL;
+	obj->key_type = OBJECT_TYPE_VOID;
 
 	return (object_t *) obj;
 }
 
-object_t *
-dictobject_dict_new (dict_t *val, void *udata)
+void
+dictobject_traverse (object_t *obj, traverse_f fun, void *udata)
 {
-	dictobject_t *obj;
-
-	obj = (dictobject_t *) pool_alloc (sizeof (dictobject_t));
-	if (obj == NULL) {
-		fatal_error ("out of memory.");
-	}
-
-	OBJECT_NEW_INIT (obj, OBJECT_TYPE_DICT, udata);
-	OBJECT_DIGEST_FUN (obj) = dictobject_digest_fun;
-
-	obj->val = val;
+	size_t pos;
 
-	gc_track ((void *) obj);
-
-	return (object_t *) obj;
+	pos = 0;
+	UNUSED (dictobject_traverse_slice (obj, fun, udata, &pos, SIZE_MAX));
 }
 
-dict_t *
-dictobject_get_value (object_t *obj)
+/* Visits at most n entries from *pos on, and gives 1 once the end is
+ * reached. The dict may change between two slices. */
+int
+dictobject_traverse_slice (object_t *obj, traverse_f fun, void *udata, size_t *pos, size_t n)
 {
 	dictobject_t *ob;
+	void *key;
+	int64_t k;
+	void *value;
+	object_t *dummy;
 
 	ob = (dictobject_t *) obj;
+	/* Replacing the value of a visited key is fine while walking. */
+	if (ob->val != NULL) {
+		for (; n > 0; n--) {
+			if (!dict_next (ob->val, pos, &key, &value)) {
+				return 1;
+			}
+			UNUSED (fun ((object_t *) key, udata));
+			if (fun ((object_t *) value, udata) > 0) {
+				dummy = object_get_default (OBJECT_TYPE_VOID, NULL);
+				UNUSED (dict_set (ob->val, key, (void *) dummy));
+				object_ref (dummy);
+			}
+		}
 
-	return ob->val;
-}
-
-void
-dictobject_traverse (object_t *obj, traverse_f fun, void *udata)
-{
-	dict_t *dict;
-	vec_t *pairs;
-	size_t size;
-
-	dict = dictobject_get_value (obj);
-	pairs = dict_pairs (dict);
-	if (pairs == NULL) {
-		return;
+		return 0;
 	}
-
-	size = vec_size (pairs);
-	for (integer_value_t i = 0; i < (integer_value_t) size; i++) {
-		object_t *key;
-		object_t *value;
-
-		key = (object_t *) DICT_PAIR_KEY (vec_pos (pairs, i));
-		value = (object_t *) DICT_PAIR_VALUE (vec_pos (pairs, i));
-		UNUSED (fun (key, udata));
-		object_traverse (value, fun, udata);
-		if (fun (value, udata) > 0) {
-			object_t *dummy;
-
-			dummy = object_get_default (OBJECT_TYPE_VOID, NULL);
-			dict_set (dict, (void *) key, (void *) dummy);
-			object_ref (dummy);
+	else if (ob->ints != NULL) {
+		/* Unboxed keys hold no references. */
+		for (; n > 0; n--) {
+			if (!idict_next (ob->ints, pos, &k, &value)) {
+				return 1;
+			}
+			if (fun ((object_t *) value, udata) > 0) {
+				dummy = object_get_default (OBJECT_TYPE_VOID, NULL);
+				UNUSED (idict_set (ob->ints, k, (void *) dummy));
+				object_ref (dummy);
+			}
 		}
+
+		return 0;
 	}
 
-	vec_free (pairs);
+	return 1;
 }
 
 int
 dictobject_remove (object_t *obj, object_t *key)
 {
-	dict_t *dict;
+	dictobject_t *ob;
 	object_t *origin_key;
 	void *value;
 
-	dict = dictobject_get_value (obj);
-	origin_key = dict_remove (dict, key, &value);
+	if (strobject_is_builder (key)) {
+		error ("strbuf can not be a dict key.");
+
+		return 0;
+	}
+
+	gc_remove_barrier ((void *) obj);
+	GLOBAL_WRITE_BARRIER (obj);
+	ob = (dictobject_t *) obj;
+	if (ob->val == NULL && ob->ints != NULL && OBJECT_TYPE (key) == ob->key_type) {
+		value = idict_remove (ob->ints, (int64_t) object_get_integer (key));
+		if (value == NULL) {
+			error ("key doesn't exist.");
+
+			return 0;
+		}
+		object_unref ((object_t *) value);
+
+		return 1;
+	}
+
+	origin_key = dict_remove (dictobject_generic (ob), key, &value);
 	if (origin_key == NULL) {
 		return 0;
 	}
@@ -653,45 +743,24 @@ object_t *
 dictobject_copy (object_t *obj)
 {
 	object_t *new_obj;
-	dict_t *new_dict;
-	dict_t *old_dict;
-	vec_t *pairs;
-	size_t size;
-
-	old_dict = dictobject_get_value (obj);
-	size = dict_size (old_dict);
-	new_dict = dict_new (dictobject_hash_fun, dictobject_test_fun);
-	if (new_dict == NULL) {
-		return NULL;
-	}
-
-	pairs = dict_pairs (old_dict);
-	if (pairs == NULL) {
-		dict_free (new_dict);
-
-		return NULL;
-	}
+	size_t pos;
+	object_t *old_key;
+	object_t *old_value;
 
-	new_obj = dictobject_dict_new (new_dict, NULL);
+	new_obj = dictobject_new (NULL);
 	if (new_obj == NULL) {
-		dict_free (new_dict);
-		vec_free (pairs);
-
 		return NULL;
 	}
 
-	for (integer_value_t i = 0; i < (integer_value_t) size; i++) {
-		object_t *old_key;
-		object_t *old_value;
+	pos = 0;
+	while (dictobject_next ((dictobject_t *) obj, &pos, &old_key, &old_value)) {
 		object_t *new_key;
 		object_t *new_value;
 
-		old_key = (object_t *) DICT_PAIR_KEY (vec_pos (pairs, i));
-		old_value = (object_t *) DICT_PAIR_VALUE (vec_pos (pairs, i));
 		new_key = object_copy (old_key);
 		new_value = object_copy (old_value);
+		object_free (old_key);
 		if (new_key == NULL || new_value == NULL) {
-			vec_free (pairs);
 			object_free (new_obj);
 			if (new_key != NULL) {
 				object_free (new_key);
@@ -699,12 +768,13 @@ dictobject_copy (object_t *obj)
 			if (new_value != NULL) {
 				object_free (new_value);
 			}
+
+			return NULL;
 		}
 		UNUSED (object_ipindex (new_obj, new_key, new_value));
+		object_free (new_key);
 	}
 
-	vec_free (pairs);
-
 	return new_obj;
 }
 
@@ -715,6 +785,8 @@ dictobject_init ()
 		return;
 	}
 
+	object_register_opset (OBJECT_TYPE_DICT, &g_object_ops);
+
 	/* Make dump objects. */
 	g_dump_head = strobject_new ("<dict {", strlen ("<dict {"), 1, NULL);
 	if (g_dump_head == NULL) {
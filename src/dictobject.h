@@ -28,7 +28,9 @@
 typedef struct dictobject_s
 {
 	object_head_t head;
-	dict_t *val;
+	dict_t *val; /* NULL while the keys are unboxed in ints. */
+	idict_t *ints;
+	object_type_t key_type; /* Of the unboxed keys. */
 } dictobject_t;
 
 object_t *
@@ -40,15 +42,12 @@ dictobject_load_buf (const char **buf, size_t *len);
 object_t *
 dictobject_new (void *udata);
 
-object_t *
-dictobject_dict_new (dict_t *val, void *udata);
-
-dict_t *
-dictobject_get_value (object_t *obj);
-
 void
 dictobject_traverse (object_t *obj, traverse_f fun, void *udata);
 
+int
+dictobject_traverse_slice (object_t *obj, traverse_f fun, void *udata, size_t *pos, size_t n);
+
 int
 dictobject_remove (object_t *obj, object_t *key);
 
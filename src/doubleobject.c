@@ -24,6 +24,7 @@
 #include "doubleobject.h"
 #include "pool.h"
 #include "error.h"
+#include "thread.h"
 #include "boolobject.h"
 #include "intobject.h"
 #include "uint64object.h"
@@ -44,7 +45,7 @@ static object_t *doubleobject_op_land (object_t *obj1, object_t *obj2);
 static object_t *doubleobject_op_lor (object_t *obj1, object_t *obj2);
 static object_t *doubleobject_op_eq (object_t *obj1, object_t *obj2);
 static object_t *doubleobject_op_cmp (object_t *obj1, object_t *obj2);
-static object_t *doubleobject_op_hash (object_t *obj);
+static uint64_t doubleobject_op_hash (object_t *obj);
 static object_t *doubleobject_op_binary (object_t *obj);
 
 static object_opset_t g_object_ops =
@@ -152,7 +153,6 @@ doubleobject_op_mul (object_t *obj1, object_t *obj2)
 	return doubleobject_new (val1 * val2, NULL);
 }
 
-
 /* Division. */
 static object_t *
 doubleobject_op_div (object_t *obj1, object_t *obj2)
@@ -215,14 +215,10 @@ doubleobject_op_cmp (object_t *obj1, object_t *obj2)
 }
 
 /* Hash. */
-static object_t *
-doubleobject_op_hash(object_t *obj)
+static uint64_t
+doubleobject_op_hash (object_t *obj)
 {
-	if (OBJECT_DIGEST (obj) == 0) {
-		OBJECT_DIGEST (obj) = object_floating_hash (object_get_floating (obj));
-	}
-
-	return uint64object_new (OBJECT_DIGEST (obj), NULL);
+	return object_floating_hash (object_get_floating (obj));
 }
 
 /* Binary. */
@@ -265,24 +261,17 @@ doubleobject_load_buf (const char **buf, size_t *len)
 	return doubleobject_new (val, NULL);
 }
 
-static uint64_t
-doubleobject_digest_fun (void *obj)
-{
-	return object_floating_hash (object_get_floating ((object_t *) obj));
-}
-
 object_t *
 doubleobject_new (double val, void *udata)
 {
 	doubleobject_t *obj;
 
-	obj = (doubleobject_t *) pool_alloc (sizeof (doubleobject_t));
+	obj = (doubleobject_t *) pool_freelist_alloc (FREELIST_DOUBLE, sizeof (doubleobject_t));
 	if (obj == NULL) {
 		fatal_error ("out of memory.");
 	}
 
-	OBJECT_NEW_INIT (obj, OBJECT_TYPE_DOUBLE, udata);
-	OBJECT_DIGEST_FUN (obj) = doubleobject_digest_fun;
+	OBJECT_NEW_INIT (obj, OBJECT_TYPE_DOUBLE);
 
 	obj->val = val;
 
@@ -299,3 +288,12 @@ doubleobject_get_value (object_t *obj)
 	return ob->val;
 }
 
+void
+doubleobject_init ()
+{
+	if (!thread_is_main_thread ()) {
+		return;
+	}
+
+	object_register_opset (OBJECT_TYPE_DOUBLE, &g_object_ops);
+}
@@ -0,0 +1,739 @@
+/*
+ * event.c
+ * This file is part of koa
+ *
+ * Copyright (C) 2018 - Gordon Li
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "event.h"
+#include "coroutine.h"
+#include "thread.h"
+#include "list.h"
+#include "str.h"
+#include "strobject.h"
+#include "longobject.h"
+#include "nullobject.h"
+#include "vecobject.h"
+#include "error.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_TIMERFD_H)
+#define EVENT_EPOLL
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
+
+#define EVENT_MAX_EVENTS 64
+
+/* Tasks are coroutines run by the loop of their thread. When a task
+ * would block on an fd or sleep, it parks itself: the loop registers
+ * what it waits for with epoll, and yields back to the loop, which
+ * resumes it with the result once it is ready. Anywhere else, these
+ * calls simply block. */
+
+typedef enum event_op_e
+{
+	EVENT_OP_READ,
+	EVENT_OP_WRITE
+} event_op_t;
+
+typedef struct event_waiter_s
+{
+	list_t link;
+	long co;
+	int fd;
+	event_op_t op;
+	char *buf; /* Left to write. */
+	size_t len; /* Max to read, or left to write. */
+	size_t done;
+} event_waiter_t;
+
+typedef struct event_task_s
+{
+	long co;
+	object_t *value; /* Resumed with it. */
+} event_task_t;
+
+typedef struct event_timer_s
+{
+	int64_t deadline; /* In CLOCK_MONOTONIC nanoseconds. */
+	long co;
+} event_timer_t;
+
+typedef struct event_loop_s
+{
+	int epfd;
+	int tfd; /* Armed for the earliest timer. */
+	event_task_t *ready; /* A ring. */
+	size_t head;
+	size_t size;
+	size_t cap;
+	event_timer_t *timers; /* A min heap. */
+	size_t timer_num;
+	size_t timer_cap;
+	list_t *waiting;
+	long running; /* The task being resumed. */
+	int parked;
+} event_loop_t;
+
+static __thread event_loop_t *g_loop;
+
+static int64_t
+event_now ()
+{
+	struct timespec now;
+
+	clock_gettime (CLOCK_MONOTONIC, &now);
+
+	return (int64_t) now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+static event_loop_t *
+event_loop ()
+{
+	if (g_loop != NULL) {
+		return g_loop;
+	}
+
+	g_loop = (event_loop_t *) calloc (1, sizeof (event_loop_t));
+	if (g_loop == NULL) {
+		fatal_error ("out of memory.");
+	}
+	g_loop->epfd = -1;
+	g_loop->tfd = -1;
+
+#ifdef EVENT_EPOLL
+	struct epoll_event ev;
+
+	g_loop->epfd = epoll_create1 (EPOLL_CLOEXEC);
+	g_loop->tfd = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (g_loop->epfd < 0 || g_loop->tfd < 0) {
+		fatal_error ("failed to create the event loop.");
+	}
+	/* The timer is told from waiters by a NULL ptr. */
+	memset (&ev, 0, sizeof (ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	if (epoll_ctl (g_loop->epfd, EPOLL_CTL_ADD, g_loop->tfd, &ev) != 0) {
+		fatal_error ("failed to create the event loop.");
+	}
+#endif
+
+	return g_loop;
+}
+
+static void
+event_push_ready (event_loop_t *loop, long co, object_t *value)
+{
+	if (loop->size == loop->cap) {
+		event_task_t *ready;
+		size_t cap;
+
+		cap = loop->cap == 0? 16: loop->cap * 2;
+		ready = (event_task_t *) malloc (cap * sizeof (event_task_t));
+		if (ready == NULL) {
+			fatal_error ("out of memory.");
+		}
+		for (size_t i = 0; i < loop->size; i++) {
+			ready[i] = loop->ready[(loop->head + i) % loop->cap];
+		}
+		free ((void *) loop->ready);
+		loop->ready = ready;
+		loop->head = 0;
+		loop->cap = cap;
+	}
+
+	object_ref (value);
+	loop->ready[(loop->head + loop->size) % loop->cap].co = co;
+	loop->ready[(loop->head + loop->size) % loop->cap].value = value;
+	loop->size++;
+}
+
+static event_task_t
+event_pop_ready (event_loop_t *loop)
+{
+	event_task_t task;
+
+	task = loop->ready[loop->head];
+	loop->head = (loop->head + 1) % loop->cap;
+	loop->size--;
+
+	return task;
+}
+
+/* The task being run by the loop, if it can park. */
+static event_loop_t *
+event_parking ()
+{
+	if (g_loop == NULL || g_loop->running == 0L ||
+		coroutine_current () != g_loop->running || !coroutine_can_yield ()) {
+		return NULL;
+	}
+
+	return g_loop;
+}
+
+static object_t *
+event_park (event_loop_t *loop)
+{
+	loop->parked = 1;
+
+	/* What yield returns is a placeholder, the result is given by
+	 * the loop when it resumes the task. */
+	return coroutine_yield (object_get_default (OBJECT_TYPE_VOID, NULL))?
+		object_get_default (OBJECT_TYPE_VOID, NULL): NULL;
+}
+
+#ifdef EVENT_EPOLL
+static void
+event_arm_timer (event_loop_t *loop)
+{
+	struct itimerspec its;
+	int64_t deadline;
+
+	memset (&its, 0, sizeof (its));
+	if (loop->timer_num > 0) {
+		/* A zero value would disarm it. */
+		deadline = loop->timers[0].deadline > 0? loop->timers[0].deadline: 1;
+		its.it_value.tv_sec = deadline / 1000000000L;
+		its.it_value.tv_nsec = deadline % 1000000000L;
+	}
+	if (timerfd_settime (loop->tfd, TFD_TIMER_ABSTIME, &its, NULL) != 0) {
+		fatal_error ("failed to arm the timer of the event loop.");
+	}
+}
+
+static void
+event_push_timer (event_loop_t *loop, int64_t deadline, long co)
+{
+	event_timer_t timer;
+	size_t i;
+
+	if (loop->timer_num == loop->timer_cap) {
+		loop->timer_cap = loop->timer_cap == 0? 16: loop->timer_cap * 2;
+		loop->timers = (event_timer_t *) realloc (loop->timers, loop->timer_cap * sizeof (event_timer_t));
+		if (loop->timers == NULL) {
+			fatal_error ("out of memory.");
+		}
+	}
+
+	timer.deadline = deadline;
+	timer.co = co;
+	for (i = loop->timer_num++; i > 0 && loop->timers[(i - 1) / 2].deadline > deadline; i = (i - 1) / 2) {
+		loop->timers[i] = loop->timers[(i - 1) / 2];
+	}
+	loop->timers[i] = timer;
+}
+
+static event_timer_t
+event_pop_timer (event_loop_t *loop)
+{
+	event_timer_t top;
+	event_timer_t last;
+	size_t i;
+	size_t child;
+
+	top = loop->timers[0];
+	last = loop->timers[--loop->timer_num];
+	for (i = 0; (child = i * 2 + 1) < loop->timer_num; i = child) {
+		if (child + 1 < loop->timer_num &&
+			loop->timers[child + 1].deadline < loop->timers[child].deadline) {
+			child++;
+		}
+		if (loop->timers[child].deadline >= last.deadline) {
+			break;
+		}
+		loop->timers[i] = loop->timers[child];
+	}
+	loop->timers[i] = last;
+
+	return top;
+}
+
+static int
+event_wait (event_loop_t *loop, event_waiter_t *waiter)
+{
+	struct epoll_event ev;
+
+	memset (&ev, 0, sizeof (ev));
+	ev.events = waiter->op == EVENT_OP_READ? EPOLLIN: EPOLLOUT;
+	ev.data.ptr = (void *) waiter;
+	if (epoll_ctl (loop->epfd, EPOLL_CTL_ADD, waiter->fd, &ev) != 0) {
+		error ("failed to wait on fd %d: %s.", waiter->fd, strerror (errno));
+		free ((void *) waiter->buf);
+		free ((void *) waiter);
+
+		return 0;
+	}
+
+	loop->waiting = list_append (loop->waiting, LIST (waiter));
+
+	return 1;
+}
+
+static void
+event_waiter_free (event_loop_t *loop, event_waiter_t *waiter)
+{
+	UNUSED (epoll_ctl (loop->epfd, EPOLL_CTL_DEL, waiter->fd, NULL));
+	loop->waiting = list_remove (loop->waiting, LIST (waiter));
+	free ((void *) waiter->buf);
+	free ((void *) waiter);
+}
+
+/* Do the io a waiter is ready for, and resume its task when it is done.
+ * Failures give null to the task. */
+static void
+event_fire (event_loop_t *loop, event_waiter_t *waiter)
+{
+	object_t *res;
+	ssize_t n;
+
+	if (waiter->op == EVENT_OP_READ) {
+		char *buf;
+
+		buf = (char *) malloc (waiter->len);
+		if (buf == NULL) {
+			fatal_error ("out of memory.");
+		}
+		n = read (waiter->fd, buf, waiter->len);
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+			free ((void *) buf);
+
+			return;
+		}
+		res = n >= 0? strobject_new (buf, (size_t) n, 1, NULL): nullobject_new (NULL);
+		free ((void *) buf);
+	}
+	else {
+		n = write (waiter->fd, waiter->buf + waiter->done, waiter->len - waiter->done);
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+			return;
+		}
+		if (n >= 0) {
+			waiter->done += (size_t) n;
+			if (waiter->done < waiter->len) {
+				return;
+			}
+		}
+		res = n >= 0? longobject_new ((long) waiter->done, NULL): nullobject_new (NULL);
+	}
+
+	event_push_ready (loop, waiter->co, res);
+	event_waiter_free (loop, waiter);
+}
+
+static int
+event_poll (event_loop_t *loop)
+{
+	struct epoll_event events[EVENT_MAX_EVENTS];
+	uint64_t expirations;
+	int64_t now;
+	int n;
+
+	n = epoll_wait (loop->epfd, events, EVENT_MAX_EVENTS, -1);
+	if (n < 0) {
+		if (errno == EINTR) {
+			return 1;
+		}
+		error ("failed to poll events: %s.", strerror (errno));
+
+		return 0;
+	}
+
+	for (int i = 0; i < n; i++) {
+		if (events[i].data.ptr != NULL) {
+			event_fire (loop, (event_waiter_t *) events[i].data.ptr);
+			continue;
+		}
+
+		UNUSED (read (loop->tfd, &expirations, sizeof (expirations)));
+		now = event_now ();
+		while (loop->timer_num > 0 && loop->timers[0].deadline <= now) {
+			event_push_ready (loop, event_pop_timer (loop).co,
+							  object_get_default (OBJECT_TYPE_VOID, NULL));
+		}
+		event_arm_timer (loop);
+	}
+
+	return 1;
+}
+#endif
+
+/* Block until fd is ready, outside of the loop. */
+static int
+event_block (int fd, short events)
+{
+	struct pollfd pfd;
+	int n;
+
+	pfd.fd = fd;
+	pfd.events = events;
+	thread_block_begin ();
+	do {
+		n = poll (&pfd, 1, -1);
+	} while (n < 0 && errno == EINTR);
+	thread_block_end ();
+
+	return n > 0;
+}
+
+void
+event_cleanup ()
+{
+	event_task_t task;
+
+	if (g_loop == NULL) {
+		return;
+	}
+
+	while (g_loop->size > 0) {
+		task = event_pop_ready (g_loop);
+		object_unref (task.value);
+	}
+#ifdef EVENT_EPOLL
+	while (g_loop->waiting != NULL) {
+		event_waiter_free (g_loop, (event_waiter_t *) g_loop->waiting);
+	}
+#endif
+	if (g_loop->epfd >= 0) {
+		close (g_loop->epfd);
+	}
+	if (g_loop->tfd >= 0) {
+		close (g_loop->tfd);
+	}
+	free ((void *) g_loop->ready);
+	free ((void *) g_loop->timers);
+	free ((void *) g_loop);
+	g_loop = NULL;
+}
+
+long
+event_spawn (code_t *code, object_t *args)
+{
+	event_loop_t *loop;
+	long co;
+
+	co = coroutine_create (code, args);
+	if (co == 0L) {
+		return 0L;
+	}
+
+	loop = event_loop ();
+	event_push_ready (loop, co, nullobject_new (NULL));
+
+	return co;
+}
+
+int
+event_run ()
+{
+	event_loop_t *loop;
+	event_task_t task;
+	object_t *res;
+
+	loop = event_loop ();
+	if (loop->running != 0L) {
+		error ("the event loop is already running.");
+
+		return 0;
+	}
+
+	while (loop->size > 0 || loop->timer_num > 0 || loop->waiting != NULL) {
+		if (loop->size == 0) {
+#ifdef EVENT_EPOLL
+			if (!event_poll (loop)) {
+				event_cleanup ();
+
+				return 0;
+			}
+#endif
+			continue;
+		}
+
+		task = event_pop_ready (loop);
+		loop->running = task.co;
+		loop->parked = 0;
+		res = coroutine_resume (task.co, task.value);
+		loop->running = 0L;
+		object_unref (task.value);
+		if (res == NULL) {
+			/* The exception is raised in the caller already. */
+			event_cleanup ();
+
+			return 0;
+		}
+		object_free (res);
+
+		/* A plain yield only gives way to other tasks. */
+		if (!loop->parked && coroutine_alive (task.co)) {
+			event_push_ready (loop, task.co, nullobject_new (NULL));
+		}
+	}
+
+	return 1;
+}
+
+object_t *
+event_sleep (long ms)
+{
+	event_loop_t *loop;
+	struct timespec ts;
+
+	if (ms < 0) {
+		error ("sleep time should not be negative.");
+
+		return NULL;
+	}
+
+#ifdef EVENT_EPOLL
+	loop = event_parking ();
+	if (loop != NULL) {
+		event_push_timer (loop, event_now () + (int64_t) ms * 1000000L, loop->running);
+		event_arm_timer (loop);
+
+		return event_park (loop);
+	}
+#else
+	UNUSED (loop);
+#endif
+
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = ms % 1000 * 1000000L;
+	thread_block_begin ();
+	while (nanosleep (&ts, &ts) != 0 && errno == EINTR) {
+	}
+	thread_block_end ();
+
+	return object_get_default (OBJECT_TYPE_VOID, NULL);
+}
+
+object_t *
+event_read (int fd, long n)
+{
+	event_loop_t *loop;
+	object_t *res;
+	char *buf;
+	ssize_t got;
+
+	if (n <= 0) {
+		error ("read size should be positive.");
+
+		return NULL;
+	}
+
+	buf = (char *) malloc ((size_t) n);
+	if (buf == NULL) {
+		fatal_error ("out of memory.");
+	}
+
+	/* Gives what is available up to n bytes, an empty str at the end. */
+	for (;;) {
+		got = read (fd, buf, (size_t) n);
+		if (got >= 0) {
+			break;
+		}
+		if (errno == EINTR) {
+			continue;
+		}
+		if (errno != EAGAIN && errno != EWOULDBLOCK) {
+			error ("failed to read fd %d: %s.", fd, strerror (errno));
+			free ((void *) buf);
+
+			return NULL;
+		}
+
+		loop = event_parking ();
+#ifdef EVENT_EPOLL
+		if (loop != NULL) {
+			event_waiter_t *waiter;
+
+			free ((void *) buf);
+			waiter = (event_waiter_t *) calloc (1, sizeof (event_waiter_t));
+			if (waiter == NULL) {
+				fatal_error ("out of memory.");
+			}
+			waiter->co = loop->running;
+			waiter->fd = fd;
+			waiter->op = EVENT_OP_READ;
+			waiter->len = (size_t) n;
+
+			return event_wait (loop, waiter)? event_park (loop): NULL;
+		}
+#else
+		UNUSED (loop);
+#endif
+		if (!event_block (fd, POLLIN)) {
+			error ("failed to wait on fd %d.", fd);
+			free ((void *) buf);
+
+			return NULL;
+		}
+	}
+
+	res = strobject_new (buf, (size_t) got, 1, NULL);
+	free ((void *) buf);
+
+	return res;
+}
+
+object_t *
+event_write (int fd, object_t *str)
+{
+	event_loop_t *loop;
+	const char *buf;
+	size_t len;
+	size_t done;
+	ssize_t n;
+
+	buf = str_c_str (strobject_get_value (str));
+	len = str_len (strobject_get_value (str));
+
+	/* Gives the number of bytes written, which is all of them. */
+	done = 0;
+	while (done < len) {
+		n = write (fd, buf + done, len - done);
+		if (n >= 0) {
+			done += (size_t) n;
+			continue;
+		}
+		if (errno == EINTR) {
+			continue;
+		}
+		if (errno != EAGAIN && errno != EWOULDBLOCK) {
+			error ("failed to write fd %d: %s.", fd, strerror (errno));
+
+			return NULL;
+		}
+
+		loop = event_parking ();
+#ifdef EVENT_EPOLL
+		if (loop != NULL) {
+			event_waiter_t *waiter;
+
+			waiter = (event_waiter_t *) calloc (1, sizeof (event_waiter_t));
+			if (waiter == NULL) {
+				fatal_error ("out of memory.");
+			}
+			waiter->co = loop->running;
+			waiter->fd = fd;
+			waiter->op = EVENT_OP_WRITE;
+			waiter->buf = (char *) malloc (len);
+			if (waiter->buf == NULL) {
+				fatal_error ("out of memory.");
+			}
+			memcpy (waiter->buf, buf, len);
+			waiter->len = len;
+			waiter->done = done;
+
+			return event_wait (loop, waiter)? event_park (loop): NULL;
+		}
+#else
+		UNUSED (loop);
+#endif
+		if (!event_block (fd, POLLOUT)) {
+			error ("failed to wait on fd %d.", fd);
+
+			return NULL;
+		}
+	}
+
+	return longobject_new ((long) done, NULL);
+}
+
+int
+event_close (int fd)
+{
+#ifdef EVENT_EPOLL
+	if (g_loop != NULL) {
+		for (list_t *l = g_loop->waiting; l != NULL; l = l->next) {
+			if (((event_waiter_t *) l)->fd == fd) {
+				error ("fd %d is waited on by a task.", fd);
+
+				return 0;
+			}
+		}
+	}
+#endif
+
+	if (close (fd) != 0) {
+		error ("failed to close fd %d: %s.", fd, strerror (errno));
+
+		return 0;
+	}
+
+	return 1;
+}
+
+/* A pipe, or a pair of connected unix sockets, as a vec of two fds.
+ * Both ends are non-blocking, so tasks can park on them. */
+object_t *
+event_pipe (int unix_socket)
+{
+	object_t *res;
+	object_t *prev;
+	object_t *fd_obj;
+	int fds[2];
+	int status;
+
+	if (unix_socket) {
+		status = socketpair (AF_UNIX, SOCK_STREAM, 0, fds);
+	}
+	else {
+		status = pipe (fds);
+	}
+	for (int i = 0; status == 0 && i < 2; i++) {
+		if (fcntl (fds[i], F_SETFL, fcntl (fds[i], F_GETFL) | O_NONBLOCK) != 0 ||
+			fcntl (fds[i], F_SETFD, FD_CLOEXEC) != 0) {
+			close (fds[0]);
+			close (fds[1]);
+			status = -1;
+		}
+	}
+	if (status != 0) {
+		error ("failed to create %s: %s.", unix_socket? "socketpair": "pipe", strerror (errno));
+
+		return NULL;
+	}
+
+	res = vecobject_new (2, NULL);
+	if (res == NULL) {
+		close (fds[0]);
+		close (fds[1]);
+
+		return NULL;
+	}
+	for (int i = 0; i < 2; i++) {
+		fd_obj = longobject_new ((long) fds[i], NULL);
+		prev = (object_t *) vec_set (vecobject_get_value (res), (integer_value_t) i, (void *) fd_obj);
+		object_ref (fd_obj);
+		object_unref (prev);
+	}
+
+	return res;
+}
@@ -0,0 +1,52 @@
+/*
+ * event.h
+ * This file is part of koa
+ *
+ * Copyright (C) 2018 - Gordon Li
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EVENT_H
+#define EVENT_H
+
+#include "koa.h"
+#include "code.h"
+#include "object.h"
+
+long
+event_spawn (code_t *code, object_t *args);
+
+int
+event_run ();
+
+object_t *
+event_sleep (long ms);
+
+object_t *
+event_read (int fd, long n);
+
+object_t *
+event_write (int fd, object_t *str);
+
+int
+event_close (int fd);
+
+object_t *
+event_pipe (int unix_socket);
+
+void
+event_cleanup ();
+
+#endif /* EVENT_H */
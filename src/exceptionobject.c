@@ -41,7 +41,7 @@ static str_t *g_dump_tail;
 static void exceptionobject_op_free (object_t *obj);
 static void exceptionobject_op_print (object_t *obj);
 static object_t *exceptionobject_op_dump (object_t *obj);
-static object_t *exceptionobject_op_hash (object_t *obj);
+static uint64_t exceptionobject_op_hash (object_t *obj);
 static object_t *exceptionobject_op_binary (object_t *obj);
 
 static object_opset_t g_object_ops =
@@ -119,14 +119,10 @@ exceptionobject_op_dump (object_t *obj)
 }
 
 /* Hash. */
-static object_t *
-exceptionobject_op_hash(object_t *obj)
+static uint64_t
+exceptionobject_op_hash (object_t *obj)
 {
-	if (OBJECT_DIGEST (obj) == 0) {
-		OBJECT_DIGEST (obj) = object_address_hash ((void *) obj);
-	}
-
-	return uint64object_new (OBJECT_DIGEST (obj), NULL);
+	return object_address_hash ((void *) obj);
 }
 
 /* Binary. */
@@ -183,12 +179,6 @@ exceptionobject_load_binary (FILE *f)
 	return obj;
 }
 
-static uint64_t
-exceptionobject_digest_fun (void *obj)
-{
-	return object_address_hash (obj);
-}
-
 object_t *
 exceptionobject_new (const char *val, size_t len, void *udata)
 {
@@ -203,8 +193,7 @@ exceptionobject_new (const char *val, size_t len, void *udata)
 		fatal_error ("out of memory.");
 	}
 
-	OBJECT_NEW_INIT (obj, OBJECT_TYPE_EXCEPTION, udata);
-	OBJECT_DIGEST_FUN (obj) = exceptionobject_digest_fun;
+	OBJECT_NEW_INIT (obj, OBJECT_TYPE_EXCEPTION);
 
 	obj->val = str_new (val, len);
 	if (obj->val == NULL) {
@@ -226,7 +215,7 @@ exceptionobject_str_new (str_t *val, void *udata)
 		fatal_error ("out of memory.");
 	}
 
-	OBJECT_NEW_INIT (obj, OBJECT_TYPE_EXCEPTION, udata);
+	OBJECT_NEW_INIT (obj, OBJECT_TYPE_EXCEPTION);
 
 	obj->val = val;
 
@@ -256,6 +245,8 @@ exceptionobject_init ()
 		return;
 	}
 
+	object_register_opset (OBJECT_TYPE_EXCEPTION, &g_object_ops);
+
 	/* Make dump head and tail. */
 	g_dump_head = str_new ("<exception \"", DUMP_HEAD_LENGTH);
 	if (g_dump_head == NULL) {
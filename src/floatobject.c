@@ -24,6 +24,7 @@
 #include "floatobject.h"
 #include "pool.h"
 #include "error.h"
+#include "thread.h"
 #include "boolobject.h"
 #include "intobject.h"
 #include "uint64object.h"
@@ -44,7 +45,7 @@ static object_t *floatobject_op_land (object_t *obj1, object_t *obj2);
 static object_t *floatobject_op_lor (object_t *obj1, object_t *obj2);
 static object_t *floatobject_op_eq (object_t *obj1, object_t *obj2);
 static object_t *floatobject_op_cmp (object_t *obj1, object_t *obj2);
-static object_t *floatobject_op_hash (object_t *obj);
+static uint64_t floatobject_op_hash (object_t *obj);
 static object_t *floatobject_op_binary (object_t *obj);
 
 static object_opset_t g_object_ops =
@@ -152,7 +153,6 @@ floatobject_op_mul (object_t *obj1, object_t *obj2)
 	return floatobject_new (val1 * val2, NULL);
 }
 
-
 /* Division. */
 static object_t *
 floatobject_op_div (object_t *obj1, object_t *obj2)
@@ -215,14 +215,10 @@ floatobject_op_cmp (object_t *obj1, object_t *obj2)
 }
 
 /* Hash. */
-static object_t *
-floatobject_op_hash(object_t *obj)
+static uint64_t
+floatobject_op_hash (object_t *obj)
 {
-	if (OBJECT_DIGEST (obj) == 0) {
-		OBJECT_DIGEST (obj) = object_floating_hash (object_get_floating (obj));
-	}
-
-	return uint64object_new (OBJECT_DIGEST (obj), NULL);
+	return object_floating_hash (object_get_floating (obj));
 }
 
 /* Binary. */
@@ -265,12 +261,6 @@ floatobject_load_buf (const char **buf, size_t *len)
 	return floatobject_new (val, NULL);
 }
 
-static uint64_t
-floatobject_digest_fun (void *obj)
-{
-	return object_floating_hash (object_get_floating ((object_t *) obj));
-}
-
 object_t *
 floatobject_new (float val, void *udata)
 {
@@ -281,8 +271,7 @@ floatobject_new (float val, void *udata)
 		fatal_error ("out of memory.");
 	}
 
-	OBJECT_NEW_INIT (obj, OBJECT_TYPE_FLOAT, udata);
-	OBJECT_DIGEST_FUN (obj) = floatobject_digest_fun;
+	OBJECT_NEW_INIT (obj, OBJECT_TYPE_FLOAT);
 
 	obj->val = val;
 
@@ -299,3 +288,12 @@ floatobject_get_value (object_t *obj)
 	return ob->val;
 }
 
+void
+floatobject_init ()
+{
+	if (!thread_is_main_thread ()) {
+		return;
+	}
+
+	object_register_opset (OBJECT_TYPE_FLOAT, &g_object_ops);
+}
@@ -26,6 +26,10 @@
 #include "strobject.h"
 #include "vecobject.h"
 #include "error.h"
+#include "global.h"
+
+/* Shared globals are read through their cells. */
+#define FRAME_VAR_VALUE(x) (OBJECT_SHARED((x))?global_shared_load((x)):(x))
 
 frame_t *
 frame_new (code_t *code, frame_t *current, sp_t bottom, int is_global, dict_t *main_global, int cmdline)
@@ -57,26 +61,18 @@ static int
 frame_block_cleanup_fun (list_t *list, void *data)
 {
 	block_t *block;
-	vec_t *pairs;
-	size_t size;
+	size_t pos;
+	void *name;
+	void *value;
 
 	UNUSED (data);
 	block = (block_t *) list;
-	pairs = dict_pairs (block->ns);
-	if (pairs == NULL) {
-		return 0;
-	}
-
-	size = vec_size (pairs);
-	/* Unref all pairs. */
-	for (integer_value_t i = 0; i < (integer_value_t) size; i++) {
-		object_t *value;
-
-		value = (object_t *) DICT_PAIR_VALUE (vec_pos (pairs, i));
-		object_unref (value);
+	pos = 0;
+	/* Unref all values. */
+	while (dict_next (block->ns, &pos, &name, &value)) {
+		object_unref ((object_t *) value);
 	}
 
-	vec_free (pairs);
 	dict_free (block->ns);
 
 	return 1;
@@ -185,27 +181,19 @@ frame_leave_block (frame_t *frame)
 {
 	dict_t *ns;
 	block_t *block;
-	vec_t *pairs;
-	size_t size;
+	size_t pos;
+	void *name;
+	void *value;
 
 	block = frame->current;
 	frame->current = (block_t *) list_remove (LIST (block), LIST (block));
 	ns = block->ns;
-	pairs = dict_pairs (ns);
-	if (pairs == NULL) {
-		return 0;
+	pos = 0;
+	/* Unref all values. */
+	while (dict_next (ns, &pos, &name, &value)) {
+		object_unref ((object_t *) value);
 	}
 
-	size = vec_size (pairs);
-	/* Unref all pairs. */
-	for (integer_value_t i = 0; i < (integer_value_t) size; i++) {
-		object_t *value;
-
-		value = (object_t *) DICT_PAIR_VALUE (vec_pos (pairs, i));
-		object_unref (value);
-	}
-
-	vec_free (pairs);
 	dict_free (ns);
 	pool_free ((void *) block);
 
@@ -225,11 +213,15 @@ frame_store_local (frame_t *frame, object_t *name, object_t *value)
 		return 0;
 	}
 
+	value = strobject_builder_store (value, 1);
 	if (dict_set (ns, (void *) name, (void *) value) != (void *) value) {
 		return 0;
 	}
 
 	object_ref (value);
+	if (frame->is_global) {
+		global_changed ();
+	}
 
 	return 1;
 }
@@ -242,6 +234,7 @@ frame_store_var (frame_t *frame, object_t *name, object_t *value)
 	int in_global;
 
 	in_global = 0;
+	prev = NULL;
 	block = frame->current;
 	while (block != NULL) {
 		prev = (object_t *) dict_get (block->ns, (void *) name);
@@ -255,12 +248,24 @@ frame_store_var (frame_t *frame, object_t *name, object_t *value)
 	/* Lookup global. */
 	if (prev == NULL && !frame->is_global) {
 		prev = (object_t *) dict_get (frame->global, (void *) name);
+		if (prev == NULL) {
+			prev = global_fetch (frame->global, name);
+		}
 		in_global = 1;
 	}
 
+	if (prev != NULL && OBJECT_SHARED (prev)) {
+		return global_shared_store (prev, value)? prev: NULL;
+	}
+
 	if (prev != NULL) {
 		dict_t *to_set;
 
+		value = strobject_builder_store (value, 1);
+		if (in_global || frame->is_global) {
+			global_changed ();
+		}
+
 		if (in_global) {
 			to_set = frame->global;
 		} else {
@@ -307,7 +312,7 @@ frame_get_var (frame_t *frame, object_t *name)
 	block = frame->current;
 	while (block != NULL) {
 		if ((var = dict_get (block->ns, name)) != NULL) {
-			return (object_t *) var;
+			return FRAME_VAR_VALUE ((object_t *) var);
 		}
 
 		block = (block_t *) LIST_NEXT (LIST (block));
@@ -315,8 +320,9 @@ frame_get_var (frame_t *frame, object_t *name)
 
 	/* Lookup global. */
 	if (!frame->is_global) {
-		if ((var = dict_get (frame->global, name)) != NULL) {
-			return (object_t *) var;
+		if ((var = dict_get (frame->global, name)) != NULL ||
+			(var = global_fetch (frame->global, name)) != NULL) {
+			return FRAME_VAR_VALUE ((object_t *) var);
 		}
 	}
 
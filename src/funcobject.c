@@ -24,6 +24,7 @@
 #include "funcobject.h"
 #include "pool.h"
 #include "error.h"
+#include "thread.h"
 #include "nullobject.h"
 #include "boolobject.h"
 #include "uint64object.h"
@@ -36,7 +37,7 @@ static void funcobject_op_free (object_t *obj);
 static void funcobject_op_print (object_t *obj);
 static object_t *funcobject_op_dump (object_t *obj);
 static object_t *funcobject_op_eq (object_t *obj1, object_t *obj2);
-static object_t *funcobject_op_hash (object_t *obj);
+static uint64_t funcobject_op_hash (object_t *obj);
 static object_t *funcobject_op_binary (object_t *obj);
 
 static object_opset_t g_object_ops =
@@ -149,14 +150,10 @@ funcobject_op_eq (object_t *obj1, object_t *obj2)
 }
 
 /* Hash. */
-static object_t *
-funcobject_op_hash(object_t *obj)
+static uint64_t
+funcobject_op_hash (object_t *obj)
 {
-	if (OBJECT_DIGEST (obj) == 0) {
-		OBJECT_DIGEST (obj) = object_address_hash ((void *) obj);
-	}
-
-	return uint64object_new (OBJECT_DIGEST (obj), NULL);
+	return object_address_hash ((void *) obj);
 }
 
 /* Binary. */
@@ -256,12 +253,6 @@ funcobject_load_buf (const char **buf, size_t *len)
 	return funcobject_code_new (code, NULL);
 }
 
-static uint64_t
-funcobject_digest_fun (void *obj)
-{
-	return object_address_hash (obj);
-}
-
 /* This is a null func object, which means it is not callable. */
 object_t *
 funcobject_new (void *udata)
@@ -273,8 +264,7 @@ funcobject_new (void *udata)
 		fatal_error ("out of memory.");
 	}
 
-	OBJECT_NEW_INIT (obj, OBJECT_TYPE_FUNC, udata);
-	OBJECT_DIGEST_FUN (obj) = funcobject_digest_fun;
+	OBJECT_NEW_INIT (obj, OBJECT_TYPE_FUNC);
 
 	obj->is_builtin = 0;
 	obj->builtin = NULL;
@@ -293,8 +283,7 @@ funcobject_code_new (code_t *val, void *udata)
 		fatal_error ("out of memory.");
 	}
 
-	OBJECT_NEW_INIT (obj, OBJECT_TYPE_FUNC, udata);
-	OBJECT_DIGEST_FUN (obj) = funcobject_digest_fun;
+	OBJECT_NEW_INIT (obj, OBJECT_TYPE_FUNC);
 
 	obj->is_builtin = 0;
 	obj->builtin = NULL;
@@ -313,8 +302,7 @@ funcobject_builtin_new (builtin_t *builtin, void *udata)
 		fatal_error ("out of memory.");
 	}
 
-	OBJECT_NEW_INIT (obj, OBJECT_TYPE_FUNC, udata);
-	OBJECT_DIGEST_FUN (obj) = funcobject_digest_fun;
+	OBJECT_NEW_INIT (obj, OBJECT_TYPE_FUNC);
 
 	obj->is_builtin = 1;
 	obj->builtin = builtin;
@@ -367,4 +355,14 @@ funcobject_copy (object_t *obj)
 	memcpy (new_obj, obj, sizeof (funcobject_t));
 
 	return (object_t *) new_obj;
-}
\ No newline at end of file
+}
+
+void
+funcobject_init ()
+{
+	if (!thread_is_main_thread ()) {
+		return;
+	}
+
+	object_register_opset (OBJECT_TYPE_FUNC, &g_object_ops);
+}
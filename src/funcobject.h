@@ -61,4 +61,7 @@ funcobject_is_builtin (object_t *obj);
 object_t *
 funcobject_copy (object_t *obj);
 
+void
+funcobject_init ();
+
 #endif /* FUNCOBJECT_H */
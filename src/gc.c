@@ -18,50 +18,207 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <time.h>
+
 #include "gc.h"
+#include "pool.h"
 #include "error.h"
 #include "list.h"
 #include "object.h"
 
-#define GEN_NUM 3
+#define GEN_NUM GC_GEN_NUM
 
 #define GEN_HEAD(x) (&g_generation_list[(x)].head)
-#define G1_HEAD (GEN_HEAD(0))
 
-typedef struct collect_s
+/* Only containers have a gc head in front of them. */
+#define GC_TRACKABLE(x) CONTAINER_TYPE((object_t*)(x))
+
+#define GC_IN_COLLECTION(x) ((x)->status==GC_STATUS_COLLECTING||\
+	(x)->status==GC_STATUS_UNREACHABLE)
+
+/* In incremental mode, check the clock once per this many units of work. */
+#define CLOCK_CHECK_UNITS 64
+
+/* Big containers are traversed this many references per unit of work. */
+#define SLICE_REFS 256
+
+/* While a collection is in progress, do the next step after this many
+ * containers have been allocated. */
+#define STEP_ALLOCS 100
+
+/* Bounds of the adaptive threshold of the youngest generation. */
+#define MIN_THRESHOLD 500
+#define MAX_THRESHOLD 64000
+
+/* Survival rates in percent, above the high one collections of the young
+ * generation are mostly wasted, below the low one they pay off. */
+#define HIGH_SURVIVAL 50
+#define LOW_SURVIVAL 10
+
+/* A collection runs through these phases. In incremental mode, each call
+ * of gc_collect only does as much work as the pause budget allows, so the
+ * mutator may change the object graph between two steps, even in the
+ * middle of a big container. Write barriers keep mutated containers
+ * alive, so marking only finds candidates, which are checked again.
+ *
+ * The check is split too, it gives up if any candidate is changed or
+ * freed meanwhile, so the references between candidates it counts stay
+ * true. It ends with one atomic pass making sure that the refcount of
+ * each garbage object is just what other garbage holds. Nothing can reach
+ * garbage from then on, so it is freed over as many steps as needed. */
+typedef enum gc_phase_e
 {
-	list_t *reachable;
-	list_t *unreachable;
-	list_t *old;
-} collect_t;
+	GC_PHASE_IDLE,
+	GC_PHASE_SCAN, /* Copy refcounts into gc_ref. */
+	GC_PHASE_SUBTRACT, /* Drop references coming from inside the set. */
+	GC_PHASE_MARK, /* Move objects that are not referenced from outside. */
+	GC_PHASE_VERIFY_SCAN, /* Zero gc_ref of the candidates. */
+	GC_PHASE_VERIFY_COUNT, /* Count references between candidates. */
+	GC_PHASE_VERIFY_ROOTS, /* Rescue candidates referenced from outside. */
+	GC_PHASE_VERIFY_RESCUE, /* Rescue all they reach. */
+	GC_PHASE_CLEAR, /* Drop the references held by garbage. */
+	GC_PHASE_FREE, /* Free the garbage. */
+	GC_PHASE_RELEASE /* Hand survivors to the next generation. */
+} gc_phase_t;
+
+#define GC_VERIFYING() (g_collection.phase >= GC_PHASE_VERIFY_SCAN &&\
+	g_collection.phase <= GC_PHASE_VERIFY_RESCUE)
 
 typedef struct generation_s
 {
 	list_t head;
-	const int threshold;
+	int base; /* Threshold set by user. */
+	int threshold;
 	int count;
 } generation_t;
 
+typedef struct collection_s
+{
+	gc_phase_t phase;
+	int gen; /* The oldest generation merged into the set. */
+	list_t set;
+	list_t unreachable;
+	list_t rescued;
+	int dirty; /* A candidate changed while verifying. */
+	list_t *cursor; /* The next object to process. */
+	size_t offset; /* Where the traversal of cursor stopped. */
+	size_t scanned;
+	size_t freed;
+} collection_t;
+
+typedef struct subtract_s
+{
+	int cost;
+	int containers;
+} subtract_t;
+
 /* Each thread track its own objects. */
 static __thread generation_t g_generation_list[GEN_NUM] =
 {
-	{LIST_SINGLE (NULL), 500, 0},
-	{LIST_SINGLE (NULL), 10, 0},
-	{LIST_SINGLE (NULL), 10, 0}
+	{LIST_SINGLE (NULL), MIN_THRESHOLD, MIN_THRESHOLD, 0},
+	{LIST_SINGLE (NULL), 10, 10, 0},
+	{LIST_SINGLE (NULL), 10, 10, 0}
 };
 
+static __thread collection_t g_collection;
+
+static __thread gc_stats_t g_stats;
+
+static __thread int g_enabled = 1;
+
+/* Set when the interpreter should call gc_collect at its next safe point. */
+static __thread int g_pending;
+
+/* Containers allocated since the last step. */
+static __thread int g_step_allocs;
+
+/* Objects that survived a full collection, and objects moved into the
+ * oldest generation since then. Full collections are delayed until the
+ * latter is a quarter of the former, so that they don't get quadratic
+ * with a growing heap. */
+static __thread size_t g_long_lived_total;
+static __thread size_t g_long_lived_pending;
+
+/* Max pause of one collection step in microseconds, 0 means that
+ * collections are done at once. */
+static __thread long g_max_pause;
+
+void *
+gc_alloc (size_t size)
+{
+	gc_head_t *head;
+
+	head = (gc_head_t *) pool_alloc (sizeof (gc_head_t) + size);
+	if (head == NULL) {
+		return NULL;
+	}
+
+	GC_INIT (head);
+
+	return GC_OBJECT (head);
+}
+
+void
+gc_free (void *obj)
+{
+	pool_free ((void *) GC_HEAD (obj));
+}
+
 void
 gc_track (void *obj)
 {
 	gc_head_t *head;
 
-	if (!CONTAINER_TYPE ((object_t *) obj)) {
+	if (!GC_TRACKABLE (obj)) {
+		return;
+	}
+	head = GC_HEAD (obj);
+	if (head->status != GC_STATUS_UNTRACKED) {
 		return;
 	}
-	head = (gc_head_t *) obj;
 	UNUSED (list_append (LIST (GEN_HEAD(0)), LIST (head)));
 	g_generation_list[0].count++;
 	head->status = GC_STATUS_REACHABLE;
+
+	if (!g_enabled) {
+		return;
+	}
+	if (g_collection.phase != GC_PHASE_IDLE) {
+		if (++g_step_allocs >= STEP_ALLOCS) {
+			g_pending = 1;
+		}
+	}
+	else if (g_generation_list[0].count > g_generation_list[0].threshold) {
+		g_pending = 1;
+	}
+}
+
+static int
+gc_find_container_fun (object_t *obj, void *data)
+{
+	if (GC_TRACKABLE (obj)) {
+		*(int *) data = 1;
+	}
+
+	return 0;
+}
+
+/* A container only holding atomic values can not be a part of any cycle,
+ * it will be tracked when the first container is stored into it. */
+void
+gc_maybe_track (void *obj)
+{
+	int found;
+
+	if (!GC_TRACKABLE (obj)) {
+		return;
+	}
+
+	found = 0;
+	object_traverse ((object_t *) obj, gc_find_container_fun, (void *) &found);
+	if (found) {
+		gc_track (obj);
+	}
 }
 
 void
@@ -69,11 +226,22 @@ gc_untrack (void *obj)
 {
 	gc_head_t *head;
 
-	head = (gc_head_t *) obj;
+	if (!GC_TRACKABLE (obj)) {
+		return;
+	}
+	head = GC_HEAD (obj);
 	if (head->status == GC_STATUS_UNTRACKED) {
 		return;
 	}
 
+	if (head->status == GC_STATUS_UNREACHABLE && GC_VERIFYING ()) {
+		g_collection.dirty = 1;
+	}
+	/* Do not let the running collection lose its place. */
+	if (LIST (head) == g_collection.cursor) {
+		g_collection.cursor = LIST_NEXT (head);
+		g_collection.offset = 0;
+	}
 	UNUSED (list_remove (NULL, LIST (head)));
 	if (g_generation_list[0].count > 0) {
 		g_generation_list[0].count--;
@@ -81,38 +249,102 @@ gc_untrack (void *obj)
 	head->status = GC_STATUS_UNTRACKED;
 }
 
+int
+gc_is_tracked (void *obj)
+{
+	return GC_TRACKABLE (obj) && GC_HEAD (obj)->status != GC_STATUS_UNTRACKED;
+}
+
 static void
-gc_list_merge (int young, int old)
+gc_list_splice (list_t *from, list_t *to)
 {
-	list_merge (GEN_HEAD (old), GEN_HEAD (young));
-	UNUSED (list_remove (GEN_HEAD (old), GEN_HEAD (young)));
-	LIST_SET_SINGLE (GEN_HEAD (young));
+	if (LIST_IS_SINGLE (from)) {
+		return;
+	}
+
+	from->next->prev = to->prev;
+	to->prev->next = from->next;
+	from->prev->next = to;
+	to->prev = from->prev;
+	LIST_SET_SINGLE (from);
 }
 
-static int
-gc_update_ref_fun (list_t *list, void *data)
+/* Move an object from the unreachable list back to the tail of the set. */
+static void
+gc_rescue (gc_head_t *head, list_t *to)
 {
-	gc_head_t *head;
+	UNUSED (list_remove (NULL, LIST (head)));
+	UNUSED (list_append (to, LIST (head)));
+	if (g_collection.cursor == to) {
+		g_collection.cursor = LIST (head);
+	}
+	head->status = GC_STATUS_COLLECTING;
+	head->gc_ref = 1;
+}
 
-	if (list == (list_t *) data) {
-		return 0;
+/* Containers are tracked lazily, so this must be called before any
+ * value is stored into a live container. */
+void
+gc_write_barrier (void *container, void *value)
+{
+	void *objs[2];
+
+	if (GC_TRACKABLE (value)) {
+		gc_track (container);
 	}
-	head = (gc_head_t *) list;
-	head->gc_ref = OBJECT_REF ((object_t *) head);
 
-	return 0;
+	if (g_collection.phase == GC_PHASE_IDLE ||
+		g_collection.phase > GC_PHASE_VERIFY_RESCUE) {
+		return;
+	}
+
+	/* Both the mutated container and the stored value are alive. */
+	objs[0] = container;
+	objs[1] = value;
+	for (int i = 0; i < 2; i++) {
+		gc_head_t *head;
+
+		if (!GC_TRACKABLE (objs[i])) {
+			continue;
+		}
+		head = GC_HEAD (objs[i]);
+		if (GC_VERIFYING ()) {
+			if (head->status == GC_STATUS_UNREACHABLE) {
+				g_collection.dirty = 1;
+			}
+		}
+		else if (head->status == GC_STATUS_COLLECTING) {
+			head->gc_ref++;
+		}
+		else if (head->status == GC_STATUS_UNREACHABLE) {
+			gc_rescue (head, &g_collection.set);
+		}
+	}
+}
+
+/* Must be called before a reference is taken out of a live container. */
+void
+gc_remove_barrier (void *container)
+{
+	if (GC_VERIFYING () && GC_HEAD (container)->status == GC_STATUS_UNREACHABLE) {
+		g_collection.dirty = 1;
+	}
 }
 
 static int
-gc_object_sub_ref_fun (object_t *obj, void *data)
+gc_sub_ref_fun (object_t *obj, void *data)
 {
+	subtract_t *sub;
 	gc_head_t *head;
 
-	head = (gc_head_t *) obj;
-	if (head->status == GC_STATUS_UNTRACKED) {
+	sub = (subtract_t *) data;
+	sub->cost++;
+	if (!GC_TRACKABLE (obj)) {
 		return 0;
 	}
-	if (head->gc_ref > 0) {
+	sub->containers++;
+	head = GC_HEAD (obj);
+	if (head->status == GC_STATUS_COLLECTING && head->gc_ref > 0) {
 		head->gc_ref--;
 	}
 
@@ -120,141 +352,608 @@ gc_object_sub_ref_fun (object_t *obj, void *data)
 }
 
 static int
-gc_sub_ref_fun (list_t *list, void *data)
+gc_mark_fun (object_t *obj, void *data)
 {
-	object_t *obj;
+	gc_head_t *head;
 
-	if (list == (list_t *) data) {
+	(*(int *) data)++;
+	if (!GC_TRACKABLE (obj)) {
 		return 0;
 	}
-	obj = (object_t *) list;
-	object_traverse (obj, gc_object_sub_ref_fun, NULL);
+	head = GC_HEAD (obj);
+	if (head->status == GC_STATUS_UNREACHABLE) {
+		gc_rescue (head, &g_collection.set);
+	}
+	else if (head->status == GC_STATUS_COLLECTING && head->gc_ref == 0) {
+		/* It will be reached by the cursor later. */
+		head->gc_ref = 1;
+	}
 
 	return 0;
 }
 
 static int
-gc_object_recover_fun (object_t *obj, void *data)
+gc_verify_count_fun (object_t *obj, void *data)
 {
 	gc_head_t *head;
-	collect_t *collect;
 
-	head = (gc_head_t *) obj;
-	collect = (collect_t *) data;
-	if (head->gc_ref <= 0) {
-		head->gc_ref = 1;
+	(*(int *) data)++;
+	if (!GC_TRACKABLE (obj)) {
+		return 0;
 	}
-	else if (head->status == GC_STATUS_UNREACHABLE) {
-		UNUSED (list_remove (collect->unreachable, LIST (head)));
-		UNUSED (list_append (collect->reachable, LIST (head)));
-		head->status = GC_STATUS_REACHABLE;
+	head = GC_HEAD (obj);
+	if (head->status == GC_STATUS_UNREACHABLE) {
+		head->gc_ref++;
 	}
 
 	return 0;
 }
 
 static int
-gc_get_unreachable_fun (list_t *list, void *data)
+gc_verify_rescue_fun (object_t *obj, void *data)
 {
 	gc_head_t *head;
-	collect_t *collect;
 
-	head = (gc_head_t *) list;
-	collect = (collect_t *) data;
-	if (list == collect->old) {
+	(*(int *) data)++;
+	if (!GC_TRACKABLE (obj)) {
 		return 0;
 	}
-
-	if (head->gc_ref > 0) {
-		object_traverse ((object_t *) head, gc_object_recover_fun, data);
-	}
-	else {
-		UNUSED (list_remove (NULL, LIST (head)));
-		UNUSED (list_append (collect->unreachable, LIST (head)));
-		head->status = GC_STATUS_UNREACHABLE;
+	head = GC_HEAD (obj);
+	if (head->status == GC_STATUS_UNREACHABLE) {
+		gc_rescue (head, &g_collection.rescued);
 	}
 
 	return 0;
 }
 
 static int
-gc_object_unref_fun (object_t *obj, void *data)
+gc_clear_fun (object_t *obj, void *data)
 {
-	gc_head_t *head;
-
-	head = (gc_head_t *) obj;
-	if (head->status == GC_STATUS_UNTRACKED) {
+	(*(int *) data)++;
+	if (!GC_TRACKABLE (obj) || GC_HEAD (obj)->status != GC_STATUS_UNREACHABLE) {
 		return 0;
 	}
 	object_unref (obj);
 
+	/* Let the container drop this slot. */
 	return 1;
 }
 
+/* Something changed under the check, let all candidates survive. */
 static void
-gc_free_unreachable (list_t *unreachable, list_t *old)
+gc_verify_abort ()
+{
+	gc_list_splice (&g_collection.rescued, &g_collection.set);
+	gc_list_splice (&g_collection.unreachable, &g_collection.set);
+	g_collection.phase = GC_PHASE_RELEASE;
+	g_collection.cursor = LIST_NEXT (&g_collection.set);
+	g_collection.offset = 0;
+}
+
+/* The only atomic pass, and the cheapest one. The counted references
+ * between candidates are still true, so a refcount matching them means
+ * nothing else holds the object right now. The extra reference keeps
+ * garbage around while its cycles are broken. */
+static int
+gc_verify_end ()
+{
+	list_t *unreachable;
+	list_t *l;
+	list_t *m;
+	int cost;
+
+	unreachable = &g_collection.unreachable;
+	cost = 1;
+	for (l = LIST_NEXT (unreachable); l != unreachable; l = LIST_NEXT (l)) {
+		cost++;
+		if (OBJECT_REF ((object_t *) GC_OBJECT (l)) != ((gc_head_t *) l)->gc_ref) {
+			for (m = LIST_NEXT (unreachable); m != l; m = LIST_NEXT (m)) {
+				object_unref ((object_t *) GC_OBJECT (m));
+			}
+			gc_verify_abort ();
+
+			return cost;
+		}
+		object_ref ((object_t *) GC_OBJECT (l));
+	}
+
+	gc_list_splice (&g_collection.rescued, &g_collection.set);
+	g_collection.phase = GC_PHASE_CLEAR;
+	g_collection.cursor = LIST_NEXT (unreachable);
+	g_collection.offset = 0;
+
+	return cost;
+}
+
+/* Check one candidate, or a slice of it. */
+static int
+gc_verify_unit ()
 {
+	list_t *end;
+	gc_head_t *head;
 	object_t *obj;
+	int cost;
+
+	if (g_collection.dirty) {
+		gc_verify_abort ();
+
+		return 1;
+	}
 
-	while (!LIST_IS_SINGLE (unreachable)) {
-		obj = (object_t *) LIST_NEXT (unreachable);
-		object_ref (obj);
-		object_traverse (obj, gc_object_unref_fun, NULL);
-		object_unref (obj);
-		if (LIST_NEXT (unreachable) == LIST (obj)) {
-			UNUSED (list_remove (NULL, LIST (obj)));
-			UNUSED (list_append (old, LIST (obj)));
+	end = g_collection.phase == GC_PHASE_VERIFY_RESCUE?
+		&g_collection.rescued: &g_collection.unreachable;
+	if (g_collection.cursor == end) {
+		switch (g_collection.phase) {
+			case GC_PHASE_VERIFY_SCAN:
+				g_collection.phase = GC_PHASE_VERIFY_COUNT;
+				break;
+			case GC_PHASE_VERIFY_COUNT:
+				g_collection.phase = GC_PHASE_VERIFY_ROOTS;
+				break;
+			case GC_PHASE_VERIFY_ROOTS:
+				g_collection.phase = GC_PHASE_VERIFY_RESCUE;
+				g_collection.cursor = LIST_NEXT (&g_collection.rescued);
+
+				return 1;
+			default:
+				return gc_verify_end ();
 		}
+		g_collection.cursor = LIST_NEXT (&g_collection.unreachable);
+
+		return 1;
+	}
+
+	head = (gc_head_t *) g_collection.cursor;
+	obj = (object_t *) GC_OBJECT (head);
+	cost = 1;
+	switch (g_collection.phase) {
+		case GC_PHASE_VERIFY_SCAN:
+			head->gc_ref = 0;
+			break;
+		case GC_PHASE_VERIFY_COUNT:
+			if (!object_traverse_slice (obj, gc_verify_count_fun, (void *) &cost,
+										&g_collection.offset, SLICE_REFS)) {
+				return cost;
+			}
+			break;
+		case GC_PHASE_VERIFY_ROOTS:
+			if (OBJECT_REF (obj) > head->gc_ref) {
+				g_collection.cursor = LIST_NEXT (head);
+				gc_rescue (head, &g_collection.rescued);
+
+				return cost;
+			}
+			break;
+		default:
+			if (!object_traverse_slice (obj, gc_verify_rescue_fun, (void *) &cost,
+										&g_collection.offset, SLICE_REFS)) {
+				return cost;
+			}
+			break;
 	}
+	g_collection.cursor = LIST_NEXT (head);
+	g_collection.offset = 0;
+
+	return cost;
 }
 
-static void
-gc_collect_gen (int gen)
+/* Clear one slice of the garbage under the cursor. */
+static int
+gc_clear_unit ()
 {
-	collect_t collect;
-	list_t reachable;
-	list_t unreachable;
+	list_t *l;
+	int cost;
+
+	l = g_collection.cursor;
+	if (l == &g_collection.unreachable) {
+		g_collection.phase = GC_PHASE_FREE;
 
+		return 1;
+	}
+
+	cost = 1;
+	if (object_traverse_slice ((object_t *) GC_OBJECT (l), gc_clear_fun, (void *) &cost,
+							   &g_collection.offset, SLICE_REFS)) {
+		g_collection.cursor = LIST_NEXT (l);
+		g_collection.offset = 0;
+	}
+
+	return cost;
+}
+
+/* Free one cleared object. */
+static int
+gc_free_unit ()
+{
+	list_t *unreachable;
+	list_t *l;
+
+	unreachable = &g_collection.unreachable;
+	if (LIST_IS_SINGLE (unreachable)) {
+		g_collection.phase = GC_PHASE_RELEASE;
+		g_collection.cursor = LIST_NEXT (&g_collection.set);
+
+		return 1;
+	}
+
+	l = LIST_NEXT (unreachable);
+	object_unref ((object_t *) GC_OBJECT (l));
+	/* Still alive? Keep it. */
+	if (LIST_NEXT (unreachable) == l) {
+		UNUSED (list_remove (NULL, l));
+		UNUSED (list_append (&g_collection.set, l));
+		((gc_head_t *) l)->status = GC_STATUS_COLLECTING;
+	}
+	else {
+		g_collection.freed++;
+	}
+
+	return 1;
+}
+
+static void
+gc_collection_begin (int gen)
+{
 	if (gen + 1 < GEN_NUM) {
 		g_generation_list[gen + 1].count++;
 	}
 
 	for (int i = 0; i <= gen; i++) {
 		g_generation_list[i].count = 0;
+		gc_list_splice (GEN_HEAD (i), &g_collection.set);
+	}
+
+	g_collection.gen = gen;
+	g_collection.phase = GC_PHASE_SCAN;
+	g_collection.cursor = LIST_NEXT (&g_collection.set);
+	g_collection.offset = 0;
+	g_collection.scanned = 0;
+	g_collection.freed = 0;
+	g_step_allocs = 0;
+}
+
+/* Collecting the young generation is wasted work when most of it
+ * survives, so wait for more allocations then. */
+static void
+gc_adapt_threshold (size_t survived)
+{
+	generation_t *young;
+	size_t rate;
+
+	if (g_collection.scanned == 0) {
+		return;
+	}
+
+	young = &g_generation_list[0];
+	rate = survived * 100 / g_collection.scanned;
+	if (rate > HIGH_SURVIVAL && young->threshold < MAX_THRESHOLD) {
+		young->threshold *= 2;
+		if (young->threshold > MAX_THRESHOLD) {
+			young->threshold = MAX_THRESHOLD;
+		}
+	}
+	else if (rate < LOW_SURVIVAL && young->threshold > young->base) {
+		young->threshold /= 2;
+		if (young->threshold < young->base) {
+			young->threshold = young->base;
+		}
+	}
+}
+
+static void
+gc_collection_end ()
+{
+	size_t survived;
+	int gen;
+	int to;
+
+	gen = g_collection.gen;
+	survived = g_collection.scanned > g_collection.freed?
+		g_collection.scanned - g_collection.freed: 0;
+	g_stats.collections[gen]++;
+	g_stats.scanned += g_collection.scanned;
+	g_stats.freed += g_collection.freed;
+	if (gen == GEN_NUM - 1) {
+		g_long_lived_total = survived;
+		g_long_lived_pending = 0;
+	}
+	else if (gen == GEN_NUM - 2) {
+		g_long_lived_pending += survived;
+	}
+	else {
+		gc_adapt_threshold (survived);
 	}
 
-	/* Merge generations. */
-	for (int i = 0; i < gen; i++) {
-		gc_list_merge (i, gen);
-	}
-	/* Update gc_ref. */
-	list_foreach (GEN_HEAD (gen), gc_update_ref_fun, (void *) GEN_HEAD (gen));
-	/* Find root objects. */
-	list_foreach (GEN_HEAD (gen), gc_sub_ref_fun, (void *) GEN_HEAD (gen));
-	/* Collect unreachable objects. */
-	LIST_SET_SINGLE (&reachable);
-	LIST_SET_SINGLE (&unreachable);
-	collect.reachable = &reachable;
-	collect.unreachable = &unreachable;
-	collect.old = GEN_HEAD (gen);
-	list_foreach (GEN_HEAD (gen), gc_get_unreachable_fun, (void *) &collect);
-	list_merge (GEN_HEAD (gen), &reachable);
-	UNUSED (list_remove (NULL, &reachable));
-	gc_free_unreachable (&unreachable, GEN_HEAD (gen));
 	/* Push young to old. */
-	if (gen + 1 < GEN_NUM && !LIST_IS_SINGLE (GEN_HEAD (gen))) {
-		gc_list_merge (gen, gen + 1);
+	to = gen + 1 < GEN_NUM? gen + 1: gen;
+	gc_list_splice (&g_collection.set, GEN_HEAD (to));
+	g_collection.phase = GC_PHASE_IDLE;
+	g_collection.cursor = NULL;
+}
+
+/* Do one unit of work, returns its cost. */
+static int
+gc_collection_unit ()
+{
+	gc_head_t *head;
+	object_t *obj;
+	subtract_t sub;
+	size_t offset;
+	int cost;
+
+	if (GC_VERIFYING ()) {
+		return gc_verify_unit ();
+	}
+	if (g_collection.phase == GC_PHASE_CLEAR) {
+		return gc_clear_unit ();
+	}
+	if (g_collection.phase == GC_PHASE_FREE) {
+		return gc_free_unit ();
+	}
+
+	if (g_collection.cursor == &g_collection.set) {
+		switch (g_collection.phase) {
+			case GC_PHASE_SCAN:
+				g_collection.phase = GC_PHASE_SUBTRACT;
+				break;
+			case GC_PHASE_SUBTRACT:
+				g_collection.phase = GC_PHASE_MARK;
+				break;
+			case GC_PHASE_MARK:
+				g_collection.phase = GC_PHASE_VERIFY_SCAN;
+				g_collection.cursor = LIST_NEXT (&g_collection.unreachable);
+				g_collection.dirty = 0;
+
+				return 1;
+			default:
+				gc_collection_end ();
+
+				return 1;
+		}
+		g_collection.cursor = LIST_NEXT (&g_collection.set);
+
+		return 1;
+	}
+
+	/* The cursor only moves on once the object is done with, big
+	 * containers take several units. */
+	head = (gc_head_t *) g_collection.cursor;
+	obj = (object_t *) GC_OBJECT (head);
+	offset = g_collection.offset;
+	cost = 1;
+	switch (g_collection.phase) {
+		case GC_PHASE_SCAN:
+			head->gc_ref = OBJECT_REF (obj);
+			head->status = GC_STATUS_COLLECTING;
+			g_collection.scanned++;
+			break;
+		case GC_PHASE_SUBTRACT:
+			sub.cost = 0;
+			sub.containers = 0;
+			if (!object_traverse_slice (obj, gc_sub_ref_fun, (void *) &sub,
+										&g_collection.offset, SLICE_REFS)) {
+				return cost + sub.cost;
+			}
+			cost += sub.cost;
+			/* Nothing to find in it, until a container is stored. Only
+			 * trusted if it was seen in one go. */
+			if (offset == 0 && sub.containers == 0) {
+				g_collection.cursor = LIST_NEXT (head);
+				g_collection.offset = 0;
+				gc_untrack ((void *) obj);
+
+				return cost;
+			}
+			break;
+		case GC_PHASE_MARK:
+			if (head->gc_ref > 0) {
+				if (!object_traverse_slice (obj, gc_mark_fun, (void *) &cost,
+											&g_collection.offset, SLICE_REFS)) {
+					return cost;
+				}
+			}
+			else {
+				g_collection.cursor = LIST_NEXT (head);
+				UNUSED (list_remove (NULL, LIST (head)));
+				UNUSED (list_append (&g_collection.unreachable, LIST (head)));
+				head->status = GC_STATUS_UNREACHABLE;
+
+				return cost;
+			}
+			break;
+		default:
+			head->status = GC_STATUS_REACHABLE;
+			break;
+	}
+	g_collection.cursor = LIST_NEXT (head);
+	g_collection.offset = 0;
+
+	return cost;
+}
+
+static long
+gc_elapsed (struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime (CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) * 1000000L +
+		(now.tv_nsec - start->tv_nsec) / 1000L;
+}
+
+static void
+gc_collection_step (long max_pause)
+{
+	struct timespec start;
+	long pause;
+	int units;
+
+	clock_gettime (CLOCK_MONOTONIC, &start);
+
+	units = 0;
+	while (g_collection.phase != GC_PHASE_IDLE) {
+		units += gc_collection_unit ();
+		if (max_pause > 0 && units >= CLOCK_CHECK_UNITS) {
+			units = 0;
+			if (gc_elapsed (&start) >= max_pause) {
+				break;
+			}
+		}
+	}
+
+	pause = gc_elapsed (&start);
+	g_stats.pauses++;
+	g_stats.total_pause += pause;
+	if (pause > g_stats.max_pause) {
+		g_stats.max_pause = pause;
+	}
+}
+
+/* Until a pause is set, collections run to their end in one step. */
+int
+gc_set_max_pause (long max_pause)
+{
+	if (max_pause <= 0) {
+		return 0;
 	}
+
+	g_max_pause = max_pause;
+
+	return 1;
+}
+
+int
+gc_set_threshold (int gen, int threshold)
+{
+	if (gen < 0 || gen >= GEN_NUM || threshold <= 0) {
+		return 0;
+	}
+
+	g_generation_list[gen].base = threshold;
+	g_generation_list[gen].threshold = threshold;
+
+	return 1;
+}
+
+void
+gc_enable ()
+{
+	g_enabled = 1;
+}
+
+void
+gc_disable ()
+{
+	g_enabled = 0;
+	g_pending = 0;
+}
+
+int
+gc_need_collect ()
+{
+	return g_pending;
+}
+
+static int
+gc_select_generation ()
+{
+	for (int i = GEN_NUM - 1; i > 0; i--) {
+		if (g_generation_list[i].count <= g_generation_list[i].threshold) {
+			continue;
+		}
+		if (i == GEN_NUM - 1 &&
+			g_long_lived_pending < g_long_lived_total / 4) {
+			continue;
+		}
+
+		return i;
+	}
+
+	return g_generation_list[0].count > g_generation_list[0].threshold? 0: -1;
 }
 
 void
 gc_collect ()
 {
-	for (int i = GEN_NUM - 1; i >= 0; i--) {
-		if (g_generation_list[i].count > g_generation_list[i].threshold) {
-			gc_collect_gen (i);
-			break;
+	g_pending = 0;
+	if (!g_enabled) {
+		return;
+	}
+
+	if (g_collection.phase == GC_PHASE_IDLE) {
+		int gen;
+
+		gen = gc_select_generation ();
+		if (gen < 0) {
+			return;
 		}
+
+		gc_collection_begin (gen);
+	}
+
+	gc_collection_step (g_max_pause);
+	g_step_allocs = 0;
+}
+
+void
+gc_collect_full ()
+{
+	g_pending = 0;
+
+	/* Finish the running one first, it may hold a part of the heap. */
+	if (g_collection.phase != GC_PHASE_IDLE) {
+		gc_collection_step (0);
+	}
+
+	gc_collection_begin (GEN_NUM - 1);
+	gc_collection_step (0);
+}
+
+static void
+gc_reset_counts ()
+{
+	for (int i = 0; i < GEN_NUM; i++) {
+		g_generation_list[i].count = 0;
+	}
+	g_enabled = 1;
+	g_pending = 0;
+	g_step_allocs = 0;
+	g_long_lived_total = 0;
+	g_long_lived_pending = 0;
+}
+
+/* Move all tracked objects to a list that outlives this thread, this
+ * is done when a thread exits with its heap handed over. */
+void
+gc_handoff (list_t *to)
+{
+	LIST_SET_SINGLE (to);
+	if (g_collection.phase != GC_PHASE_IDLE) {
+		gc_collection_step (0);
+	}
+
+	for (int i = 0; i < GEN_NUM; i++) {
+		gc_list_splice (GEN_HEAD (i), to);
+	}
+	/* Pooled workers go on with the next task. */
+	gc_reset_counts ();
+}
+
+/* Track objects handed over by gc_handoff. */
+void
+gc_adopt (list_t *from)
+{
+	gc_list_splice (from, GEN_HEAD (GEN_NUM - 1));
+}
+
+void
+gc_get_stats (gc_stats_t *stats)
+{
+	*stats = g_stats;
+	stats->enabled = g_enabled;
+	for (int i = 0; i < GEN_NUM; i++) {
+		stats->threshold[i] = g_generation_list[i].threshold;
 	}
 }
 
@@ -264,4 +963,11 @@ gc_init ()
 	for (int i = 0; i < GEN_NUM; i++) {
 		LIST_SET_SINGLE (GEN_HEAD (i));
 	}
-}
\ No newline at end of file
+
+	LIST_SET_SINGLE (&g_collection.set);
+	LIST_SET_SINGLE (&g_collection.unreachable);
+	LIST_SET_SINGLE (&g_collection.rescued);
+	g_collection.phase = GC_PHASE_IDLE;
+	g_collection.cursor = NULL;
+	gc_reset_counts ();
+}
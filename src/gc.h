@@ -21,12 +21,17 @@
 #ifndef GC_H
 #define GC_H
 
+#include <stddef.h>
+
 #include "koa.h"
 #include "list.h"
 
+#define GC_GEN_NUM 3
+
 #define GC_REF(x) ((x)->gc_ref)
 #define GC_STATUS(x) ((x)->status)
-#define GC_NULL {LIST_NULL,GC_STATUS_UNTRACKED,0}
+#define GC_HEAD(x) (((gc_head_t*)(x))-1)
+#define GC_OBJECT(x) ((void*)(((gc_head_t*)(x))+1))
 #define GC_INIT(x) GC_REF((x))=0;\
 	GC_STATUS((x))=GC_STATUS_UNTRACKED;\
 	LIST_CLEAR(&(x)->link)
@@ -35,6 +40,7 @@ typedef enum gc_status_e
 {
 	GC_STATUS_UNTRACKED,
 	GC_STATUS_REACHABLE,
+	GC_STATUS_COLLECTING, /* In the set of a running collection. */
 	GC_STATUS_UNREACHABLE
 } gc_status_t;
 
@@ -45,15 +51,72 @@ typedef struct gc_head_s
 	gc_status_t status;
 } gc_head_t;
 
+typedef struct gc_stats_s
+{
+	int enabled;
+	int threshold[GC_GEN_NUM];
+	size_t collections[GC_GEN_NUM];
+	size_t scanned;
+	size_t freed;
+	size_t pauses;
+	long total_pause; /* In microseconds. */
+	long max_pause;
+} gc_stats_t;
+
+void *
+gc_alloc (size_t size);
+
+void
+gc_free (void *obj);
+
 void
 gc_track (void *obj);
 
+void
+gc_maybe_track (void *obj);
+
 void
 gc_untrack (void *obj);
 
+int
+gc_is_tracked (void *obj);
+
+void
+gc_write_barrier (void *container, void *value);
+
+void
+gc_remove_barrier (void *container);
+
+int
+gc_set_max_pause (long max_pause);
+
+int
+gc_set_threshold (int gen, int threshold);
+
+void
+gc_enable ();
+
+void
+gc_disable ();
+
+int
+gc_need_collect ();
+
 void
 gc_collect ();
 
+void
+gc_collect_full ();
+
+void
+gc_handoff (list_t *to);
+
+void
+gc_adopt (list_t *from);
+
+void
+gc_get_stats (gc_stats_t *stats);
+
 void
 gc_init ();
 
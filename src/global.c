@@ -0,0 +1,566 @@
+/*
+ * global.c
+ * This file is part of koa
+ *
+ * Copyright (C) 2018 - Gordon Li
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "global.h"
+#include "pool.h"
+#include "vec.h"
+#include "gc.h"
+#include "thread.h"
+#include "interpreter.h"
+#include "strobject.h"
+#include "nullobject.h"
+#include "uint64object.h"
+#include "error.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_PTHREAD_H
+#include "thread_pthread.h"
+#else
+#endif
+
+#define IS_CONTAINER(x) (OBJECT_IS_VEC((x))||OBJECT_IS_DICT((x))||\
+	OBJECT_IS_STRUCT((x))||OBJECT_IS_UNION((x)))
+
+/* Child threads don't touch the globals of the main thread. They see a
+ * snapshot of them instead, which nobody changes once it is made, and
+ * copy what they read into globals of their own. Globals that should
+ * really be shared are moved into cells, which all threads go through.
+ *
+ * Containers are copied into a snapshot once, the next snapshot takes
+ * the same copy unless a container of the main thread was changed in
+ * place since, which GLOBAL_WRITE_BARRIER tells. */
+
+struct global_snapshot_s
+{
+	dict_t *ns;
+	dict_t *sources; /* The containers copied, by name. */
+	unsigned long containers; /* g_container_version when made. */
+	_Atomic long users; /* Threads started with it, and the main thread. */
+	global_snapshot_t *next;
+};
+
+/* A shared global, it has the same type all along. Scalars are read
+ * with a seqlock, others are copied under the lock. */
+typedef struct global_cell_s
+{
+	_Atomic unsigned long seq; /* Odd while being written. */
+	_Atomic uint64_t bits;
+	packed_object_t packed;
+	_thread_mutex_t lock;
+} global_cell_t;
+
+/* The last value a thread read from a cell. */
+typedef struct global_cached_s
+{
+	unsigned long seq;
+	object_t *obj;
+} global_cached_t;
+
+/* Snapshots are only made and freed by the main thread. */
+static global_snapshot_t *g_snapshots;
+
+static global_snapshot_t *g_snapshot;
+
+static unsigned long g_snapshot_version;
+
+static __thread unsigned long g_version;
+
+static __thread unsigned long g_container_version;
+
+static __thread global_snapshot_t *g_frozen;
+
+static __thread dict_t *g_overlay;
+
+static __thread dict_t *g_cache;
+
+static uint64_t
+global_name_hash_fun (void *data)
+{
+	return strobject_get_hash ((object_t *) data);
+}
+
+static int
+global_name_test_fun (void *value, void *hd)
+{
+	return strobject_equal ((object_t *) value, (object_t *) hd);
+}
+
+static uint64_t
+global_cell_hash_fun (void *data)
+{
+	return (uint64_t) (uintptr_t) data;
+}
+
+static int
+global_cell_test_fun (void *value, void *hd)
+{
+	return value == hd;
+}
+
+static void
+global_ns_free (dict_t *ns)
+{
+	size_t pos;
+	void *name;
+	void *value;
+
+	pos = 0;
+	while (dict_next (ns, &pos, &name, &value)) {
+		object_unref ((object_t *) value);
+	}
+	dict_free (ns);
+}
+
+static int
+global_untrack_fun (object_t *obj, void *data)
+{
+	if (gc_is_tracked ((void *) obj)) {
+		gc_untrack ((void *) obj);
+		object_traverse (obj, global_untrack_fun, data);
+	}
+
+	return 0;
+}
+
+static int
+global_watch_fun (object_t *obj, void *data)
+{
+	if (IS_CONTAINER (obj)) {
+		OBJECT_FLAGS (obj) |= OBJECT_FLAG_WATCHED;
+		object_traverse (obj, global_watch_fun, data);
+	}
+
+	return 0;
+}
+
+static object_t *
+global_freeze (object_t *value)
+{
+	object_t *frozen;
+
+	if (OBJECT_SHARED (value)) {
+		return value;
+	}
+	else if (IS_CONTAINER (value)) {
+		/* Keep the collector of the main thread off the copy. */
+		frozen = object_copy (value);
+		if (frozen != NULL) {
+			UNUSED (global_untrack_fun (frozen, NULL));
+			UNUSED (global_watch_fun (value, NULL));
+		}
+
+		return frozen;
+	}
+	else if (OBJECT_IS_NULL (value)) {
+		return nullobject_new (NULL);
+	}
+	else if (!NUMBERICAL_TYPE (value) && !OBJECT_IS_STR (value) && !OBJECT_IS_FUNC (value)) {
+		return NULL;
+	}
+
+	/* Constants live as long as the code. */
+	return OBJECT_CONST (value)? value: object_copy (value);
+}
+
+/* The copy of a container in the last snapshot, if it is still good. */
+static object_t *
+global_frozen_copy (global_snapshot_t *last, object_t *name, object_t *value)
+{
+	if (last == NULL || last->containers != g_container_version ||
+		!IS_CONTAINER (value) || !OBJECT_WATCHED (value) ||
+		dict_get (last->sources, (void *) name) != (void *) value) {
+		return NULL;
+	}
+
+	return (object_t *) dict_get (last->ns, (void *) name);
+}
+
+static global_snapshot_t *
+global_snapshot_new (dict_t *global, global_snapshot_t *last)
+{
+	global_snapshot_t *snapshot;
+	size_t pos;
+	void *name;
+	void *value;
+
+	snapshot = (global_snapshot_t *) pool_calloc (1, sizeof (global_snapshot_t));
+	if (snapshot == NULL) {
+		fatal_error ("out of memory.");
+	}
+
+	snapshot->ns = dict_new (global_name_hash_fun, global_name_test_fun);
+	snapshot->sources = dict_new (global_name_hash_fun, global_name_test_fun);
+	if (snapshot->ns == NULL || snapshot->sources == NULL) {
+		fatal_error ("out of memory.");
+	}
+	snapshot->containers = g_container_version;
+
+	pos = 0;
+	while (dict_next (global, &pos, &name, &value)) {
+		object_t *frozen;
+
+		frozen = global_frozen_copy (last, (object_t *) name, (object_t *) value);
+		if (frozen == NULL) {
+			frozen = global_freeze ((object_t *) value);
+		}
+		if (frozen == NULL) {
+			continue;
+		}
+
+		UNUSED (dict_set (snapshot->ns, name, (void *) frozen));
+		object_ref (frozen);
+		if (IS_CONTAINER ((object_t *) value)) {
+			UNUSED (dict_set (snapshot->sources, name, value));
+		}
+	}
+
+	return snapshot;
+}
+
+static void
+global_snapshot_collect ()
+{
+	global_snapshot_t **p;
+
+	p = &g_snapshots;
+	while (*p != NULL) {
+		global_snapshot_t *snapshot;
+
+		snapshot = *p;
+		if (atomic_load (&snapshot->users) > 0) {
+			p = &snapshot->next;
+			continue;
+		}
+
+		*p = snapshot->next;
+		global_ns_free (snapshot->ns);
+		dict_free (snapshot->sources);
+		pool_free ((void *) snapshot);
+	}
+}
+
+/* Children get the snapshot of their parent, only the main thread makes
+ * new ones, when its globals may have changed since the last. */
+global_snapshot_t *
+global_snapshot_acquire ()
+{
+	global_snapshot_t *snapshot;
+
+	if (!thread_is_main_thread ()) {
+		snapshot = g_frozen;
+		if (snapshot != NULL) {
+			atomic_fetch_add (&snapshot->users, 1);
+		}
+
+		return snapshot;
+	}
+
+	if (g_snapshot == NULL || g_snapshot_version != g_version) {
+		global_snapshot_t *last;
+
+		/* Still on the list, so its copies can be taken over. */
+		last = g_snapshot;
+		g_snapshot = global_snapshot_new (interpreter_get_main_global (), last);
+		if (last != NULL) {
+			global_snapshot_release (last);
+		}
+		global_snapshot_collect ();
+
+		atomic_init (&g_snapshot->users, 1);
+		g_snapshot->next = g_snapshots;
+		g_snapshots = g_snapshot;
+		g_snapshot_version = g_version;
+	}
+
+	atomic_fetch_add (&g_snapshot->users, 1);
+
+	return g_snapshot;
+}
+
+void
+global_snapshot_release (global_snapshot_t *snapshot)
+{
+	if (snapshot != NULL) {
+		atomic_fetch_sub (&snapshot->users, 1);
+	}
+}
+
+/* Make the globals of a child, which start empty. */
+dict_t *
+global_thread_enter (global_snapshot_t *snapshot)
+{
+	g_frozen = snapshot;
+	g_overlay = dict_new (global_name_hash_fun, global_name_test_fun);
+	if (g_overlay == NULL) {
+		fatal_error ("out of memory.");
+	}
+
+	return g_overlay;
+}
+
+void
+global_thread_leave ()
+{
+	if (g_cache != NULL) {
+		size_t pos;
+		void *name;
+		void *cached;
+
+		pos = 0;
+		while (dict_next (g_cache, &pos, &name, &cached)) {
+			object_unref (((global_cached_t *) cached)->obj);
+			pool_free (cached);
+		}
+		dict_free (g_cache);
+		g_cache = NULL;
+	}
+
+	if (g_overlay != NULL) {
+		global_ns_free (g_overlay);
+		g_overlay = NULL;
+	}
+	g_frozen = NULL;
+}
+
+/* Look a global up in the snapshot, the copy read is kept in our own
+ * globals, so later reads are as fast as any. */
+object_t *
+global_fetch (dict_t *global, object_t *name)
+{
+	object_t *value;
+
+	if (g_frozen == NULL) {
+		return NULL;
+	}
+
+	value = (object_t *) dict_get (g_frozen->ns, (void *) name);
+	if (value == NULL) {
+		return NULL;
+	}
+
+	if (OBJECT_IS_NULL (value)) {
+		value = nullobject_new (NULL);
+	}
+	else if (!OBJECT_SHARED (value)) {
+		value = object_copy (value);
+		if (value == NULL) {
+			return NULL;
+		}
+	}
+
+	UNUSED (dict_set (global, (void *) name, (void *) value));
+	object_ref (value);
+
+	return value;
+}
+
+static int
+global_cell_is_scalar (global_cell_t *cell)
+{
+	return cell->packed.kind == PACKED_INTEGER || cell->packed.kind == PACKED_FLOATING;
+}
+
+object_t *
+global_shared_load (object_t *var)
+{
+	global_cell_t *cell;
+	global_cached_t *cached;
+	object_t *obj;
+	unsigned long seq;
+
+	cell = (global_cell_t *) uint64object_get_value (var);
+	if (g_cache == NULL) {
+		g_cache = dict_new (global_cell_hash_fun, global_cell_test_fun);
+		if (g_cache == NULL) {
+			fatal_error ("out of memory.");
+		}
+	}
+
+	/* Nothing to do if it is not written since our last read. */
+	cached = (global_cached_t *) dict_get (g_cache, (void *) cell);
+	seq = atomic_load_explicit (&cell->seq, memory_order_acquire);
+	if (cached != NULL && cached->seq == seq) {
+		return cached->obj;
+	}
+
+	if (global_cell_is_scalar (cell)) {
+		packed_object_t packed;
+		uint64_t bits;
+
+		packed = cell->packed;
+		for (;;) {
+			seq = atomic_load_explicit (&cell->seq, memory_order_acquire);
+			if (seq & 1) {
+				continue;
+			}
+			bits = atomic_load_explicit (&cell->bits, memory_order_relaxed);
+			atomic_thread_fence (memory_order_acquire);
+			if (atomic_load_explicit (&cell->seq, memory_order_relaxed) == seq) {
+				break;
+			}
+		}
+		memcpy (&packed.scalar, &bits, sizeof (bits));
+		obj = object_unpack (&packed);
+	}
+	else {
+		_thread_mutex_lock (&cell->lock);
+		seq = atomic_load_explicit (&cell->seq, memory_order_relaxed);
+		obj = object_unpack (&cell->packed);
+		_thread_mutex_unlock (&cell->lock);
+	}
+	if (obj == NULL) {
+		return NULL;
+	}
+
+	if (cached == NULL) {
+		cached = (global_cached_t *) pool_alloc (sizeof (global_cached_t));
+		if (cached == NULL) {
+			fatal_error ("out of memory.");
+		}
+		UNUSED (dict_set (g_cache, (void *) cell, (void *) cached));
+	}
+	else {
+		object_unref (cached->obj);
+	}
+	cached->seq = seq;
+	cached->obj = obj;
+	object_ref (obj);
+
+	return obj;
+}
+
+int
+global_shared_store (object_t *var, object_t *value)
+{
+	global_cell_t *cell;
+	packed_object_t packed;
+	object_t *casted;
+	unsigned long seq;
+	int ok;
+
+	cell = (global_cell_t *) uint64object_get_value (var);
+	casted = NULL;
+	if (OBJECT_TYPE (value) != cell->packed.type) {
+		casted = object_cast (value, cell->packed.type);
+		if (casted == NULL) {
+			return 0;
+		}
+		value = casted;
+	}
+	ok = object_pack (value, &packed);
+	if (casted != NULL) {
+		object_free (casted);
+	}
+	if (!ok) {
+		return 0;
+	}
+
+	_thread_mutex_lock (&cell->lock);
+	seq = atomic_load_explicit (&cell->seq, memory_order_relaxed);
+	atomic_store_explicit (&cell->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence (memory_order_release);
+	if (global_cell_is_scalar (cell)) {
+		uint64_t bits;
+
+		memcpy (&bits, &packed.scalar, sizeof (bits));
+		atomic_store_explicit (&cell->bits, bits, memory_order_relaxed);
+	}
+	else {
+		object_pack_free (&cell->packed);
+		cell->packed = packed;
+	}
+	atomic_store_explicit (&cell->seq, seq + 2, memory_order_release);
+	_thread_mutex_unlock (&cell->lock);
+
+	return 1;
+}
+
+/* Move a global of the main thread into a cell, from then on all
+ * threads read and write the same value. */
+int
+global_share (object_t *name)
+{
+	dict_t *global;
+	object_t *value;
+	object_t *var;
+	global_cell_t *cell;
+	uint64_t bits;
+
+	if (!thread_is_main_thread ()) {
+		error ("globals can only be shared by the main thread.");
+
+		return 0;
+	}
+
+	global = interpreter_get_main_global ();
+	value = (object_t *) dict_get (global, (void *) name);
+	if (value == NULL) {
+		error ("variable undefined: %s.", strobject_c_str (name));
+
+		return 0;
+	}
+	if (OBJECT_SHARED (value)) {
+		return 1;
+	}
+
+	cell = (global_cell_t *) calloc (1, sizeof (global_cell_t));
+	if (cell == NULL) {
+		fatal_error ("out of memory.");
+	}
+	if (!object_pack (value, &cell->packed)) {
+		free ((void *) cell);
+
+		return 0;
+	}
+	memcpy (&bits, &cell->packed.scalar, sizeof (bits));
+	atomic_init (&cell->bits, bits);
+	atomic_init (&cell->seq, 0);
+	_thread_mutex_init (&cell->lock);
+
+	/* Cells are never freed, like the constants standing for them. */
+	var = uint64object_new ((uint64_t) (uintptr_t) cell, NULL);
+	OBJECT_FLAGS (var) |= OBJECT_FLAG_CONST | OBJECT_FLAG_SHARED;
+	object_unref ((object_t *) dict_set (global, (void *) name, (void *) var));
+	global_changed ();
+
+	return 1;
+}
+
+void
+global_changed ()
+{
+	g_version++;
+}
+
+void
+global_container_changed (object_t *obj)
+{
+	OBJECT_FLAGS (obj) &= ~OBJECT_FLAG_WATCHED;
+	g_container_version++;
+	g_version++;
+}
@@ -0,0 +1,65 @@
+/*
+ * global.h
+ * This file is part of koa
+ *
+ * Copyright (C) 2018 - Gordon Li
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GLOBAL_H
+#define GLOBAL_H
+
+#include "koa.h"
+#include "dict.h"
+#include "object.h"
+
+/* Called before a container is changed in place. The copy a snapshot
+ * holds is then out of date. */
+#define GLOBAL_WRITE_BARRIER(x) (OBJECT_WATCHED((x))?\
+	global_container_changed((x)):(void)0)
+
+typedef struct global_snapshot_s global_snapshot_t;
+
+global_snapshot_t *
+global_snapshot_acquire ();
+
+void
+global_snapshot_release (global_snapshot_t *snapshot);
+
+dict_t *
+global_thread_enter (global_snapshot_t *snapshot);
+
+void
+global_thread_leave ();
+
+object_t *
+global_fetch (dict_t *global, object_t *name);
+
+object_t *
+global_shared_load (object_t *var);
+
+int
+global_shared_store (object_t *var, object_t *value);
+
+int
+global_share (object_t *name);
+
+void
+global_changed ();
+
+void
+global_container_changed (object_t *obj);
+
+#endif /* GLOBAL_H */
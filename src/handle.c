@@ -0,0 +1,262 @@
+/*
+ * handle.c
+ * This file is part of koa
+ *
+ * Copyright (C) 2018 - Gordon Li
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#include "handle.h"
+#include "error.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_PTHREAD_H
+#include "thread_pthread.h"
+#else
+#endif
+
+/* Things shared by threads are passed around as long handles. They are
+ * found through a two-level table, so that lookups need no lock and the
+ * table never moves. A released slot is reused under a new generation,
+ * which is part of the id, so stale ids never find the new thing. */
+#define HANDLE_CHUNK_SIZE 256
+#define HANDLE_CHUNK_NUM 1024
+#define HANDLE_SLOT_NUM (HANDLE_CHUNK_NUM * HANDLE_CHUNK_SIZE)
+
+/* A slot tag is the generation and the kind, the kind is HANDLE_NONE
+ * while the slot is not in use. */
+#define HANDLE_KIND_BITS 8
+#define HANDLE_KIND_MASK ((1UL << HANDLE_KIND_BITS) - 1)
+#define HANDLE_GEN_MASK ((1UL << 40) - 1)
+#define HANDLE_TAG(gen, kind) (((gen) << HANDLE_KIND_BITS) | (unsigned long) (kind))
+
+typedef struct handle_slot_s
+{
+	_Atomic unsigned long tag; /* Set once ptr is ready. */
+	_Atomic long users; /* Pins, plus one until released. */
+	void *ptr;
+	handle_free_func_t free_func;
+	long index;
+	long next; /* Next free slot. */
+} handle_slot_t;
+
+typedef struct handle_chunk_s
+{
+	handle_slot_t slots[HANDLE_CHUNK_SIZE];
+} handle_chunk_t;
+
+static handle_chunk_t *_Atomic g_handle_table[HANDLE_CHUNK_NUM];
+
+static _Atomic long g_handle_num;
+
+static _thread_mutex_t g_handle_lock;
+
+static long g_handle_free = -1L;
+
+static handle_slot_t *
+handle_slot (long index)
+{
+	handle_chunk_t *chunk;
+	handle_chunk_t *expected;
+
+	chunk = atomic_load (&g_handle_table[index / HANDLE_CHUNK_SIZE]);
+	if (chunk == NULL) {
+		chunk = (handle_chunk_t *) calloc (1, sizeof (handle_chunk_t));
+		if (chunk == NULL) {
+			fatal_error ("out of memory.");
+		}
+		expected = NULL;
+		if (!atomic_compare_exchange_strong (&g_handle_table[index / HANDLE_CHUNK_SIZE], &expected, chunk)) {
+			free ((void *) chunk);
+			chunk = expected;
+		}
+	}
+
+	return &chunk->slots[index % HANDLE_CHUNK_SIZE];
+}
+
+/* Gives the slot of id, and the generation id was made for. */
+static handle_slot_t *
+handle_find (long id, unsigned long *gen)
+{
+	handle_chunk_t *chunk;
+	long index;
+
+	if (id <= 0) {
+		return NULL;
+	}
+
+	*gen = (unsigned long) (id - 1) / HANDLE_SLOT_NUM;
+	index = (id - 1) % HANDLE_SLOT_NUM;
+	chunk = atomic_load (&g_handle_table[index / HANDLE_CHUNK_SIZE]);
+	if (chunk == NULL) {
+		return NULL;
+	}
+
+	return &chunk->slots[index % HANDLE_CHUNK_SIZE];
+}
+
+/* The last pin frees the thing, and puts the slot back on the free list
+ * under the next generation. */
+static void
+handle_unpin (handle_slot_t *slot)
+{
+	unsigned long gen;
+
+	if (atomic_fetch_sub (&slot->users, 1) != 1) {
+		return;
+	}
+
+	if (slot->free_func != NULL) {
+		slot->free_func (slot->ptr);
+	}
+	slot->ptr = NULL;
+	gen = (atomic_load (&slot->tag) >> HANDLE_KIND_BITS) + 1;
+	atomic_store (&slot->tag, HANDLE_TAG (gen & HANDLE_GEN_MASK, HANDLE_NONE));
+
+	_thread_mutex_lock (&g_handle_lock);
+	slot->next = g_handle_free;
+	g_handle_free = slot->index;
+	_thread_mutex_unlock (&g_handle_lock);
+}
+
+long
+handle_new (handle_kind_t kind, void *ptr, handle_free_func_t free_func)
+{
+	handle_slot_t *slot;
+	unsigned long gen;
+	long index;
+
+	_thread_mutex_lock (&g_handle_lock);
+	index = g_handle_free;
+	if (index >= 0) {
+		slot = handle_slot (index);
+		g_handle_free = slot->next;
+	}
+	_thread_mutex_unlock (&g_handle_lock);
+
+	if (index < 0) {
+		index = atomic_fetch_add (&g_handle_num, 1);
+		if (index >= HANDLE_SLOT_NUM) {
+			error ("too many handles.");
+
+			return 0L;
+		}
+		slot = handle_slot (index);
+		slot->index = index;
+	}
+
+	gen = atomic_load (&slot->tag) >> HANDLE_KIND_BITS;
+	slot->ptr = ptr;
+	slot->free_func = free_func;
+	atomic_store (&slot->users, 1);
+	atomic_store_explicit (&slot->tag, HANDLE_TAG (gen, kind), memory_order_release);
+
+	return (long) gen * HANDLE_SLOT_NUM + index + 1;
+}
+
+void *
+handle_get (long id, handle_kind_t *kind)
+{
+	handle_slot_t *slot;
+	unsigned long gen;
+	unsigned long tag;
+
+	*kind = HANDLE_NONE;
+	slot = handle_find (id, &gen);
+	if (slot == NULL) {
+		return NULL;
+	}
+
+	tag = atomic_load_explicit (&slot->tag, memory_order_acquire);
+	if (tag >> HANDLE_KIND_BITS != gen) {
+		return NULL;
+	}
+	*kind = (handle_kind_t) (tag & HANDLE_KIND_MASK);
+
+	return *kind != HANDLE_NONE? slot->ptr: NULL;
+}
+
+void *
+handle_acquire (long id, handle_kind_t kind)
+{
+	handle_slot_t *slot;
+	unsigned long gen;
+	long users;
+
+	slot = handle_find (id, &gen);
+	if (slot == NULL) {
+		return NULL;
+	}
+
+	/* A slot with no users is being freed, it must not come back. */
+	users = atomic_load (&slot->users);
+	do {
+		if (users <= 0) {
+			return NULL;
+		}
+	} while (!atomic_compare_exchange_weak (&slot->users, &users, users + 1));
+
+	/* The slot may have been reused meanwhile, then the pin is on
+	 * someone else's thing. */
+	if (atomic_load_explicit (&slot->tag, memory_order_acquire) != HANDLE_TAG (gen, kind)) {
+		handle_unpin (slot);
+
+		return NULL;
+	}
+
+	return slot->ptr;
+}
+
+void
+handle_put (long id)
+{
+	unsigned long gen;
+
+	handle_unpin (handle_find (id, &gen));
+}
+
+int
+handle_release (long id, handle_kind_t kind)
+{
+	handle_slot_t *slot;
+	unsigned long gen;
+	unsigned long expected;
+
+	slot = handle_find (id, &gen);
+	if (slot == NULL) {
+		return 0;
+	}
+
+	expected = HANDLE_TAG (gen, kind);
+	if (!atomic_compare_exchange_strong (&slot->tag, &expected, HANDLE_TAG (gen, HANDLE_NONE))) {
+		return 0;
+	}
+	handle_unpin (slot);
+
+	return 1;
+}
+
+void
+handle_init ()
+{
+	_thread_mutex_init (&g_handle_lock);
+}
@@ -0,0 +1,63 @@
+/*
+ * handle.h
+ * This file is part of koa
+ *
+ * Copyright (C) 2018 - Gordon Li
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HANDLE_H
+#define HANDLE_H
+
+#include "koa.h"
+
+typedef enum handle_kind_e
+{
+	HANDLE_NONE,
+	HANDLE_CHAN,
+	HANDLE_MUTEX,
+	HANDLE_RWLOCK,
+	HANDLE_COND,
+	HANDLE_ATOMIC_INT,
+	HANDLE_ATOMIC_LONG
+} handle_kind_t;
+
+typedef void (*handle_free_func_t) (void *ptr);
+
+/* Gives 0 if the table is full, free_func is run once the handle is
+ * released and nobody has it pinned anymore. */
+long
+handle_new (handle_kind_t kind, void *ptr, handle_free_func_t free_func);
+
+/* Lookup without a pin, for things whose users keep them alive. */
+void *
+handle_get (long id, handle_kind_t *kind);
+
+/* Pins the thing so that it outlives a concurrent release, gives NULL
+ * if id is not a live handle of kind. Every pin needs a handle_put. */
+void *
+handle_acquire (long id, handle_kind_t kind);
+
+void
+handle_put (long id);
+
+/* Gives 0 if id is not a live handle of kind. */
+int
+handle_release (long id, handle_kind_t kind);
+
+void
+handle_init ();
+
+#endif /* HANDLE_H */
@@ -24,64 +24,108 @@
 #include <stddef.h>
 #include <inttypes.h>
 
-#include "koa.h"
-#include "list.h"
-#include "vec.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-#define HASH_SEED(x) ((x)->seed)
+#include "koa.h"
 
 typedef uint64_t (*hash_f) (void *data);
 typedef int (*hash_test_f) (void *value, void *hd);
-typedef void (*hash_del_f) (void *data);
 
-typedef struct hash_node_s
-{
-	list_t link;
-	void *value;
-	size_t idx;
-} hash_node_t;
+/* Open addressing probed by groups of slots. Each slot has a control
+ * byte, either empty, deleted or the low 7 bits of the hash it holds,
+ * so most mismatches are ruled out a group at a time without touching
+ * the slots. A table has a power of two of slots and always some empty
+ * ones. Tables smaller than a group still have a group of control
+ * bytes, the ones past the slots are sentinels. */
 
-typedef struct hash_s
-{
-	list_t **h;
-	hash_f hf;
-	hash_test_f tf;
-	hash_del_f df;
-	size_t bu;
-	size_t size;
-} hash_t;
+#define HASH_GROUP_WIDTH 16
 
-hash_t *
-hash_new (size_t bu, hash_f hf, hash_test_f tf, hash_del_f df);
+#define HASH_CTRL_EMPTY 0x80
+#define HASH_CTRL_DELETED 0xfe
+#define HASH_CTRL_SENTINEL 0xff
 
-void
-hash_free (hash_t *ha);
+/* Control bytes of a table of cap slots. */
+#define HASH_CTRL_SIZE(cap) ((cap) < HASH_GROUP_WIDTH? HASH_GROUP_WIDTH: (cap))
 
-void *
-hash_add (hash_t *ha, void *data);
+/* The high bits pick the first group, the low 7 go to the control byte. */
+#define HASH_H1(x) ((size_t) ((x) >> 7))
+#define HASH_H2(x) ((uint8_t) ((x) & 0x7f))
 
-void
-hash_fast_add (hash_t *ha, void *hn);
-
-void
-hash_remove (hash_t *ha, void *data);
+/* At most 7/8 of the slots are taken. */
+#define HASH_MAX_LOAD(x) ((x) - (x) / 8)
 
-void
-hash_fast_remove (hash_t *ha, void *hn);
-
-void *
-hash_test (hash_t *ha, void *hd, uint64_t hash);
+/* Groups are visited with growing steps, which covers all of them
+ * since their number is a power of two. */
+typedef struct hash_probe_s
+{
+	size_t offset; /* Of the first slot of the group. */
+	size_t step;
+	size_t mask;
+} hash_probe_t;
+
+/* Bit i is set if byte i of group is b. */
+static inline unsigned int
+hash_group_match (const uint8_t *group, uint8_t b)
+{
+#ifdef __SSE2__
+	return (unsigned int) _mm_movemask_epi8 (_mm_cmpeq_epi8 (_mm_loadu_si128 ((const __m128i *) group),
+															 _mm_set1_epi8 ((char) b)));
+#else
+	unsigned int mask;
+
+	mask = 0;
+	for (int i = 0; i < HASH_GROUP_WIDTH; i++) {
+		mask |= (unsigned int) (group[i] == b) << i;
+	}
+
+	return mask;
+#endif
+}
+
+/* Empty or deleted bytes, the only ones below the sentinel when
+ * taken as signed. */
+static inline unsigned int
+hash_group_free (const uint8_t *group)
+{
+#ifdef __SSE2__
+	return (unsigned int) _mm_movemask_epi8 (_mm_cmpgt_epi8 (_mm_set1_epi8 ((char) HASH_CTRL_SENTINEL),
+															 _mm_loadu_si128 ((const __m128i *) group)));
+#else
+	unsigned int mask;
+
+	mask = 0;
+	for (int i = 0; i < HASH_GROUP_WIDTH; i++) {
+		mask |= (unsigned int) (group[i] >= HASH_CTRL_EMPTY && group[i] != HASH_CTRL_SENTINEL) << i;
+	}
+
+	return mask;
+#endif
+}
+
+static inline void
+hash_probe_start (hash_probe_t *probe, uint64_t hash, size_t cap)
+{
+	probe->mask = (cap - 1) / HASH_GROUP_WIDTH;
+	probe->offset = (HASH_H1 (hash) & probe->mask) * HASH_GROUP_WIDTH;
+	probe->step = 0;
+}
 
-int
-hash_find (hash_t *ha, void *data);
+static inline void
+hash_probe_next (hash_probe_t *probe)
+{
+	probe->step++;
+	probe->offset = ((probe->offset / HASH_GROUP_WIDTH + probe->step) & probe->mask) * HASH_GROUP_WIDTH;
+}
 
-int
-hash_occupied (hash_t *ha, uint64_t hash);
+void
+hash_ctrl_reset (uint8_t *ctrl, size_t cap);
 
-vec_t *
-hash_get_all_values (hash_t *ha);
+size_t
+hash_find_free (const uint8_t *ctrl, size_t cap, uint64_t hash);
 
-void *
-hash_handle_copy (void *hn);
+void
+hash_erase (uint8_t *ctrl, size_t pos);
 
 #endif /* HASH_H */
@@ -29,6 +29,8 @@
 #include "gc.h"
 #include "error.h"
 #include "thread.h"
+#include "coroutine.h"
+#include "event.h"
 #include "boolobject.h"
 #include "intobject.h"
 #include "strobject.h"
@@ -38,8 +40,6 @@
 #include "structobject.h"
 #include "unionobject.h"
 
-#define GC_OP_COUNT 1000
-
 #define HANDLE_EXCEPTION if (interpreter_recover_exception ()) {\
 	goto recover;\
 }\
@@ -52,8 +52,8 @@ else {\
 static __thread frame_t *g_current;
 static __thread st_t *g_s;
 static __thread int g_runtime_started;
+static __thread coroutine_t *g_coroutine; /* The running one, if any. */
 static int g_cmdline;
-static __thread int g_gc_op_count;
 static code_t *g_global;
 
 static void
@@ -116,7 +116,6 @@ interpreter_play (code_t *code, int global, frame_t *frame)
 
 recover:
 	while ((opcode = frame_next_opcode (g_current))) {
-		g_gc_op_count++;
 		op = OPCODE_OP (opcode);
 		para = OPCODE_PARA (opcode);
 		r = NULL;
@@ -125,7 +124,8 @@ recover:
 			fatal_error ("what's this?");
 		case OP_LOAD_CONST:
 			r = code_get_const (code, para);
-			if (!thread_is_main_thread () && !OBJECT_IS_DUMMY (r)) {
+			/* Only containers are not frozen, they get a fresh copy. */
+			if (!OBJECT_FROZEN (r)) {
 				r = object_copy (r);
 			}
 			if (r == NULL) {
@@ -183,11 +183,16 @@ recover:
 
 				HANDLE_EXCEPTION;
 			}
+			/* A strbuf stays with its variable. */
+			d = strobject_builder_store (c, 0);
 			if (OBJECT_IS_STRUCT (a)) {
-				r = structobject_store_member (a, b, c, g_global);
+				r = structobject_store_member (a, b, d, g_global);
 			}
 			else {
-				r = unionobject_store_member (a, b, c, g_global);
+				r = unionobject_store_member (a, b, d, g_global);
+			}
+			if (r == NULL && d != c) {
+				object_free (d);
 			}
 			object_unref (a);
 			object_unref (c);
@@ -388,7 +393,11 @@ recover:
 			b = (object_t *) stack_pop (g_s);
 			a = (object_t *) stack_pop (g_s);
 			c = (object_t *) stack_pop (g_s);
-			r = object_ipindex (a, b, c);
+			d = strobject_builder_store (c, 0);
+			r = object_ipindex (a, b, d);
+			if (r == NULL && d != c) {
+				object_free (d);
+			}
 			object_unref (a);
 			object_unref (b);
 			object_unref (c);
@@ -515,6 +524,10 @@ recover:
 				}
 				object_unref (a);
 				object_unref (b);
+				/* Suspended by yield, resume pushes the result of it. */
+				if (g_coroutine != NULL && g_coroutine->state == COROUTINE_SUSPENDED) {
+					return 1;
+				}
 				break;
 			}
 			else {
@@ -1605,9 +1618,8 @@ recover:
 			if (!frame_leave_block (g_current)) {
 				HANDLE_EXCEPTION;
 			}
-			if (g_gc_op_count > GC_OP_COUNT) {
+			if (gc_need_collect ()) {
 				gc_collect ();
-				g_gc_op_count = 0;
 			}
 			break;
 		case OP_RETURN:
@@ -1636,9 +1648,8 @@ recover:
 				}
 			}
 			g_current = frame_free (g_current);
-			if (g_gc_op_count > GC_OP_COUNT) {
+			if (gc_need_collect ()) {
 				gc_collect ();
-				g_gc_op_count = 0;
 			}
 			return 1;
 		case OP_PUSH_BLOCKS:
@@ -1716,6 +1727,8 @@ interpreter_execute (const char *path)
 	while (g_current) {
 		g_current = frame_free (g_current);
 	}
+	event_cleanup ();
+	coroutine_cleanup ();
 
 	while (stack_get_sp (g_s) > 0) {
 		obj = (object_t *) stack_pop (g_s);
@@ -1752,6 +1765,8 @@ interpreter_execute_thread (code_t *code, object_t *args, dict_t *main_global, o
 	while (g_current) {
 		g_current = frame_free (g_current);
 	}
+	event_cleanup ();
+	coroutine_cleanup ();
 
 	*ret_value = NULL;
 	obj = stack_top (g_s);
@@ -1762,6 +1777,8 @@ interpreter_execute_thread (code_t *code, object_t *args, dict_t *main_global, o
 		obj = (object_t *) stack_pop (g_s);
 		object_unref (obj);
 	}
+	stack_free (g_s);
+	g_s = NULL;
 	g_runtime_started = 0;
 }
 
@@ -1792,21 +1809,17 @@ interpreter_started ()
 	return g_runtime_started;
 }
 
-void
-interpreter_set_exception (const char *exception)
+/* Leave the exception to the current frame, or unwind it. Exceptions
+ * passed on from coroutines are reported already. */
+static void
+interpreter_raise (object_t *exception_obj, const char *exception)
 {
 	sp_t stack_sp;
 	sp_t bottom;
-	object_t *exception_obj;
-
-	exception_obj = exceptionobject_new (exception, strlen (exception), NULL);
-	if (exception_obj == NULL) {
-		fatal_error ("out of memory.");
-	}
 
 	if (frame_is_catched (g_current)) {
 		frame_set_exception (g_current, exception_obj);
-		if (g_cmdline) {
+		if (g_cmdline && exception != NULL) {
 			interpreter_traceback ();
 			fprintf (stderr, "runtime error: %s\n", exception);
 		}
@@ -1814,8 +1827,10 @@ interpreter_set_exception (const char *exception)
 		return;
 	}
 
-	interpreter_traceback ();
-	fprintf (stderr, "runtime error: %s\n", exception);
+	if (exception != NULL) {
+		interpreter_traceback ();
+		fprintf (stderr, "runtime error: %s\n", exception);
+	}
 	stack_sp = stack_get_sp (g_s);
 	bottom = frame_get_bottom (g_current);
 	if (stack_sp <= frame_get_bottom (g_current)) {
@@ -1833,6 +1848,129 @@ interpreter_set_exception (const char *exception)
 	g_current = frame_free (g_current);
 }
 
+void
+interpreter_set_exception (const char *exception)
+{
+	object_t *exception_obj;
+
+	exception_obj = exceptionobject_new (exception, strlen (exception), NULL);
+	if (exception_obj == NULL) {
+		fatal_error ("out of memory.");
+	}
+
+	interpreter_raise (exception_obj, exception);
+}
+
+object_t *
+interpreter_resume (coroutine_t *co, object_t *value)
+{
+	st_t *s;
+	frame_t *current;
+	object_t *res;
+	int status;
+
+	/* Switch to the stack of co and put its frame on top of ours. */
+	s = g_s;
+	current = g_current;
+	g_s = co->s;
+	if (co->state == COROUTINE_CREATED) {
+		co->frame = frame_new (co->code, g_current, stack_get_sp (g_s), 0, NULL, 0);
+		g_current = co->frame;
+		/* The stack takes over the reference. */
+		UNUSED (stack_push (g_s, (void *) co->args));
+		co->args = NULL;
+	}
+	else {
+		g_current = (frame_t *) list_append (LIST (g_current), LIST (co->frame));
+		/* Given as the result of yield. */
+		if (!STACK_PUSH (g_s, (void *) value)) {
+			fatal_error ("out of memory.");
+		}
+	}
+
+	co->state = COROUTINE_RUNNING;
+	co->resumer = g_coroutine;
+	g_coroutine = co;
+	status = interpreter_play (co->code, 0, co->frame);
+	g_coroutine = co->resumer;
+	co->resumer = NULL;
+
+	if (status && co->state == COROUTINE_SUSPENDED) {
+		g_current = (frame_t *) list_remove (LIST (co->frame), LIST (co->frame));
+		g_s = s;
+		res = co->transfer;
+		co->transfer = NULL;
+		object_unref_without_free (res);
+
+		return res;
+	}
+
+	/* Returned or failed, its frames are gone either way. */
+	co->state = COROUTINE_DEAD;
+	while (g_current != current) {
+		g_current = frame_free (g_current);
+	}
+	co->frame = NULL;
+	res = (object_t *) stack_pop (g_s);
+	g_s = s;
+	if (status) {
+		object_unref_without_free (res);
+
+		return res;
+	}
+
+	/* Raise the exception of co in its resumer. */
+	if (res == NULL || !OBJECT_IS_EXCEPTION (res)) {
+		if (res != NULL) {
+			object_unref (res);
+		}
+		res = exceptionobject_new ("coroutine failed.", strlen ("coroutine failed."), NULL);
+		if (res == NULL) {
+			fatal_error ("out of memory.");
+		}
+	}
+	else {
+		object_unref_without_free (res);
+	}
+	interpreter_raise (res, NULL);
+
+	return NULL;
+}
+
+coroutine_t *
+interpreter_get_coroutine ()
+{
+	return g_coroutine;
+}
+
+int
+interpreter_can_yield ()
+{
+	return g_coroutine != NULL && g_current == g_coroutine->frame;
+}
+
+int
+interpreter_yield (object_t *value)
+{
+	if (g_coroutine == NULL) {
+		error ("yield outside of a coroutine.");
+
+		return 0;
+	}
+	/* Only the frame of the coroutine itself can be suspended. */
+	if (g_current != g_coroutine->frame) {
+		error ("yield should be called in the body of a coroutine.");
+
+		return 0;
+	}
+
+	g_coroutine->transfer = value;
+	object_ref (value);
+	g_coroutine->state = COROUTINE_SUSPENDED;
+
+	return 1;
+}
+
 void
 interpreter_set_cmdline (frame_t *frame, code_t *code)
 {
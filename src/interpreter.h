@@ -24,6 +24,7 @@
 #include "koa.h"
 #include "dict.h"
 #include "frame.h"
+#include "coroutine.h"
 
 int
 interpreter_play (code_t *code, int global, frame_t *frame);
@@ -46,6 +47,18 @@ interpreter_started ();
 void
 interpreter_set_exception (const char *exception);
 
+object_t *
+interpreter_resume (coroutine_t *co, object_t *value);
+
+coroutine_t *
+interpreter_get_coroutine ();
+
+int
+interpreter_can_yield ();
+
+int
+interpreter_yield (object_t *value);
+
 void
 interpreter_set_cmdline (frame_t *frame, code_t *code);
 
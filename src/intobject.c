@@ -62,7 +62,7 @@ static object_t *intobject_op_lshift (object_t *obj1, object_t *obj2);
 static object_t *intobject_op_rshift (object_t *obj1, object_t *obj2);
 static object_t *intobject_op_eq (object_t *obj1, object_t *obj2);
 static object_t *intobject_op_cmp (object_t *obj1, object_t *obj2);
-static object_t *intobject_op_hash (object_t *obj);
+static uint64_t intobject_op_hash (object_t *obj);
 static object_t *intobject_op_binary (object_t *obj);
 
 static object_opset_t g_object_ops =
@@ -170,7 +170,6 @@ intobject_op_mul (object_t *obj1, object_t *obj2)
 	return intobject_new (val1 * val2, NULL);
 }
 
-
 /* Division. */
 static object_t *
 intobject_op_div (object_t *obj1, object_t *obj2)
@@ -322,14 +321,10 @@ intobject_op_cmp (object_t *obj1, object_t *obj2)
 }
 
 /* Hash. */
-static object_t *
-intobject_op_hash(object_t *obj)
+static uint64_t
+intobject_op_hash (object_t *obj)
 {
-	if (OBJECT_DIGEST (obj) == 0) {
-		OBJECT_DIGEST (obj) = object_integer_hash (object_get_integer (obj));
-	}
-
-	return uint64object_new (OBJECT_DIGEST (obj), NULL);
+	return object_integer_hash (object_get_integer (obj));
 }
 
 /* Binary. */
@@ -372,12 +367,6 @@ intobject_load_buf (const char **buf, size_t *len)
 	return intobject_new (val, NULL);
 }
 
-static uint64_t
-intobject_digest_fun (void *obj)
-{
-	return object_integer_hash (object_get_integer ((object_t *) obj));
-}
-
 object_t *
 intobject_new (int val, void *udata)
 {
@@ -388,13 +377,12 @@ intobject_new (int val, void *udata)
 		return g_int_cache[INT_CACHE_INDEX (val)];
 	}
 
-	obj = (intobject_t *) pool_alloc (sizeof (intobject_t));
+	obj = (intobject_t *) pool_freelist_alloc (FREELIST_INT, sizeof (intobject_t));
 	if (obj == NULL) {
 		fatal_error ("out of memory.");
 	}
 
-	OBJECT_NEW_INIT (obj, OBJECT_TYPE_INT, udata);
-	OBJECT_DIGEST_FUN (obj) = intobject_digest_fun;
+	OBJECT_NEW_INIT (obj, OBJECT_TYPE_INT);
 
 	obj->val = val;
 
@@ -418,6 +406,8 @@ intobject_init ()
 		return;
 	}
 
+	object_register_opset (OBJECT_TYPE_INT, &g_object_ops);
+
 	/* Make small int cache. */
 	for (int i = INT_CACHE_MIN; i <= INT_CACHE_MAX; i++) {
 		g_int_cache[INT_CACHE_INDEX (i)] = intobject_new (i, NULL);
@@ -63,7 +63,7 @@ static object_t *longobject_op_lshift (object_t *obj1, object_t *obj2);
 static object_t *longobject_op_rshift (object_t *obj1, object_t *obj2);
 static object_t *longobject_op_eq (object_t *obj1, object_t *obj2);
 static object_t *longobject_op_cmp (object_t *obj1, object_t *obj2);
-static object_t *longobject_op_hash (object_t *obj);
+static uint64_t longobject_op_hash (object_t *obj);
 static object_t *longobject_op_binary (object_t *obj);
 
 static object_opset_t g_object_ops =
@@ -171,7 +171,6 @@ longobject_op_mul (object_t *obj1, object_t *obj2)
 	return longobject_new (val1 * val2, NULL);
 }
 
-
 /* Division. */
 static object_t *
 longobject_op_div (object_t *obj1, object_t *obj2)
@@ -323,14 +322,10 @@ longobject_op_cmp (object_t *obj1, object_t *obj2)
 }
 
 /* Hash. */
-static object_t *
-longobject_op_hash(object_t *obj)
+static uint64_t
+longobject_op_hash (object_t *obj)
 {
-	if (OBJECT_DIGEST (obj) == 0) {
-		OBJECT_DIGEST (obj) = object_integer_hash (object_get_integer (obj));
-	}
-
-	return uint64object_new (OBJECT_DIGEST (obj), NULL);
+	return object_integer_hash (object_get_integer (obj));
 }
 
 /* Binary. */
@@ -373,12 +368,6 @@ longobject_load_buf (const char **buf, size_t *len)
 	return longobject_new (val, NULL);
 }
 
-static uint64_t
-longobject_digest_fun (void *obj)
-{
-	return object_integer_hash (object_get_integer ((object_t *) obj));
-}
-
 object_t *
 longobject_new (long val, void *udata)
 {
@@ -396,8 +385,7 @@ longobject_new (long val, void *udata)
 		return NULL;
 	}
 
-	OBJECT_NEW_INIT (obj, OBJECT_TYPE_LONG, udata);
-	OBJECT_DIGEST_FUN (obj) = longobject_digest_fun;
+	OBJECT_NEW_INIT (obj, OBJECT_TYPE_LONG);
 
 	obj->val = val;
 
@@ -421,6 +409,8 @@ longobject_init ()
 		return;
 	}
 
+	object_register_opset (OBJECT_TYPE_LONG, &g_object_ops);
+
 	/* Make small int cache. */
 	for (long i = LONG_CACHE_MIN; i <= LONG_CACHE_MAX; i++) {
 		g_long_cache[LONG_CACHE_INDEX (i)] = longobject_new (i, NULL);
@@ -30,6 +30,7 @@
 #include "parser.h"
 #include "gc.h"
 #include "thread.h"
+#include "handle.h"
 #include "opt.h"
 #include "misc.h"
 
@@ -50,6 +51,8 @@ void koa_init ()
 	builtin_init ();
 	/* Init thread. */
 	thread_init ();
+	/* Init handle table. */
+	handle_init ();
 }
 
 int main(int argc, char *argv[])
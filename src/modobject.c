@@ -24,6 +24,7 @@
 #include "modobject.h"
 #include "pool.h"
 #include "error.h"
+#include "thread.h"
 #include "nullobject.h"
 #include "boolobject.h"
 #include "uint64object.h"
@@ -36,7 +37,7 @@ static void modobject_op_free (object_t *obj);
 static void modobject_op_print (object_t *obj);
 static object_t *modobject_op_dump (object_t *obj);
 static object_t *modobject_op_eq (object_t *obj1, object_t *obj2);
-static object_t *modobject_op_hash (object_t *obj);
+static uint64_t modobject_op_hash (object_t *obj);
 static object_t *modobject_op_binary (object_t *obj);
 
 static object_opset_t g_object_ops =
@@ -117,14 +118,10 @@ modobject_op_eq (object_t *obj1, object_t *obj2)
 }
 
 /* Hash. */
-static object_t *
-modobject_op_hash(object_t *obj)
+static uint64_t
+modobject_op_hash (object_t *obj)
 {
-	if (OBJECT_DIGEST (obj) == 0) {
-		OBJECT_DIGEST (obj) = object_address_hash ((void *) obj);
-	}
-
-	return uint64object_new (OBJECT_DIGEST (obj), NULL);
+	return object_address_hash ((void *) obj);
 }
 
 /* Binary. */
@@ -160,12 +157,6 @@ modobject_load_buf (const char **buf, size_t *len)
 	return modobject_code_new (code, NULL);
 }
 
-static uint64_t
-modobject_digest_fun (void *obj)
-{
-	return object_address_hash (obj);
-}
-
 /* This is a null mod object, which means it has nothing. */
 object_t *
 modobject_new (void *udata)
@@ -177,8 +168,7 @@ modobject_new (void *udata)
 		fatal_error ("out of memory.");
 	}
 
-	OBJECT_NEW_INIT (obj, OBJECT_TYPE_MOD, udata);
-	OBJECT_DIGEST_FUN (obj) = modobject_digest_fun;
+	OBJECT_NEW_INIT (obj, OBJECT_TYPE_MOD);
 
 	obj->val = NULL;
 
@@ -195,8 +185,7 @@ modobject_code_new (code_t *val, void *udata)
 		fatal_error ("out of memory.");
 	}
 
-	OBJECT_NEW_INIT (obj, OBJECT_TYPE_MOD, udata);
-	OBJECT_DIGEST_FUN (obj) = modobject_digest_fun;
+	OBJECT_NEW_INIT (obj, OBJECT_TYPE_MOD);
 
 	obj->val = val;
 
@@ -213,3 +202,12 @@ modobject_get_value (object_t *obj)
 	return ob->val;
 }
 
+void
+modobject_init ()
+{
+	if (!thread_is_main_thread ()) {
+		return;
+	}
+
+	object_register_opset (OBJECT_TYPE_MOD, &g_object_ops);
+}
@@ -46,4 +46,7 @@ modobject_code_new (code_t *val, void *udata);
 code_t *
 modobject_get_value (object_t *obj);
 
+void
+modobject_init ();
+
 #endif /* MODOBJECT_H */
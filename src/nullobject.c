@@ -36,7 +36,7 @@ static object_t *g_null_object;
 static void nullobject_op_print (object_t *obj);
 static object_t *nullobject_op_dump (object_t *obj);
 static object_t *nullobject_op_eq (object_t *obj1, object_t *obj2);
-static object_t *nullobject_op_hash (object_t *obj);
+static uint64_t nullobject_op_hash (object_t *obj);
 static object_t *nullobject_op_binary (object_t *obj);
 
 static object_opset_t g_object_ops =
@@ -99,11 +99,11 @@ nullobject_op_dump (object_t *obj)
 }
 
 /* Hash. */
-static object_t *
+static uint64_t
 nullobject_op_hash (object_t *obj)
 {
 	/* The digest is already computed. */
-	return uint64object_new (OBJECT_DIGEST (obj), NULL);
+	return OBJECT_DIGEST (obj);
 }
 
 /* Binary. */
@@ -125,12 +125,6 @@ nullobject_load_buf (const char **buf, size_t *len)
 	return nullobject_new (NULL);
 }
 
-static uint64_t
-nullobject_digest_fun (void *obj)
-{
-	return OBJECT_DIGEST ((object_t *) obj);
-}
-
 /* This object is known as 'null'. */
 object_t *
 nullobject_new (void *udata)
@@ -146,8 +140,7 @@ nullobject_new (void *udata)
 		fatal_error ("out of memory.");
 	}
 
-	OBJECT_NEW_INIT (obj, OBJECT_TYPE_NULL, udata);
-	OBJECT_DIGEST_FUN (obj) = nullobject_digest_fun;
+	OBJECT_NEW_INIT (obj, OBJECT_TYPE_NULL);
 
 	return (object_t *) obj;
 }
@@ -159,6 +152,8 @@ nullobject_init ()
 		return;
 	}
 
+	object_register_opset (OBJECT_TYPE_NULL, &g_object_ops);
+
 	/* The 'null' object should never be freed. */
 	g_null_object = nullobject_new (NULL);
 	if (g_null_object == NULL) {
@@ -20,6 +20,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 #include <math.h>
 
 #include "object.h"
@@ -106,17 +107,15 @@ static object_opset_t g_dummy_ops =
 static object_t g_dummy_object =
 {
 	{
-		GC_NULL,
 		0,
-		1,
+		OBJECT_FLAG_CONST | OBJECT_FLAG_FROZEN,
 		OBJECT_TYPE_VOID,
-		0,
-		NULL,
-		&g_dummy_ops,
-		NULL
+		0
 	},
 };
 
+object_opset_t *g_opset_table[OPSET_NUM];
+
 void
 object_ref (object_t *obj)
 {
@@ -150,7 +149,28 @@ object_unref_without_free (object_t *obj)
 void
 object_set_const (object_t *obj)
 {
-	OBJECT_CONST (obj) = 1;
+	OBJECT_FLAGS (obj) |= OBJECT_FLAG_CONST;
+}
+
+/* Constants of code are read by all threads, so their hashes are made
+ * now rather than cached on first use. Containers are not frozen, they
+ * are copied whenever loaded. */
+void
+object_freeze (object_t *obj)
+{
+	object_set_const (obj);
+	if (OBJECT_IS_VEC (obj) || OBJECT_IS_DICT (obj) ||
+		OBJECT_IS_STRUCT (obj) || OBJECT_IS_UNION (obj)) {
+		return;
+	}
+
+	if (OBJECT_IS_STR (obj)) {
+		UNUSED (strobject_get_hash (obj));
+	}
+	if (NUMBERICAL_TYPE (obj) || OBJECT_IS_STR (obj) || OBJECT_IS_NULL (obj)) {
+		UNUSED (object_digest (obj));
+	}
+	OBJECT_FLAGS (obj) |= OBJECT_FLAG_FROZEN;
 }
 
 integer_value_t
@@ -223,104 +243,110 @@ object_is_zero (object_t *obj)
 	return (int) (NUMBERICAL_GET_VALUE (obj) == 0);
 }
 
+object_t *
+object_new_integer (integer_value_t val, object_type_t type)
+{
+	switch (type) {
+		case OBJECT_TYPE_BOOL:
+			return boolobject_new ((bool) val, NULL);
+		case OBJECT_TYPE_CHAR:
+			return charobject_new ((char) val, NULL);
+		case OBJECT_TYPE_UCHAR:
+			return ucharobject_new ((unsigned char) val, NULL);
+		case OBJECT_TYPE_SHORT:
+			return shortobject_new ((short) val, NULL);
+		case OBJECT_TYPE_USHORT:
+			return ushortobject_new ((unsigned short int) val, NULL);
+		case OBJECT_TYPE_INT:
+			return intobject_new ((int) val, NULL);
+		case OBJECT_TYPE_UINT:
+			return uintobject_new ((unsigned int) val, NULL);
+		case OBJECT_TYPE_LONG:
+			return longobject_new ((long) val, NULL);
+		case OBJECT_TYPE_ULONG:
+			return ulongobject_new ((unsigned long int) val, NULL);
+		case OBJECT_TYPE_INT8:
+			return int8object_new ((int8_t) val, NULL);
+		case OBJECT_TYPE_UINT8:
+			return uint8object_new ((uint8_t) val, NULL);
+		case OBJECT_TYPE_INT16:
+			return int16object_new ((int16_t) val, NULL);
+		case OBJECT_TYPE_UINT16:
+			return uint16object_new ((uint16_t) val, NULL);
+		case OBJECT_TYPE_INT32:
+			return int32object_new ((int32_t) val, NULL);
+		case OBJECT_TYPE_UINT32:
+			return uint32object_new ((uint32_t) val, NULL);
+		case OBJECT_TYPE_INT64:
+			return int64object_new ((int64_t) val, NULL);
+		case OBJECT_TYPE_UINT64:
+			return uint64object_new ((uint64_t) val, NULL);
+		case OBJECT_TYPE_FLOAT:
+			return floatobject_new ((float) val, NULL);
+		case OBJECT_TYPE_DOUBLE:
+			return doubleobject_new ((double) val, NULL);
+		default:
+			error ("try to cast numberical object to %s.", TYPE_ID_NAME (type));
+			return NULL;
+	}
+}
+
+object_t *
+object_new_floating (floating_value_t val, object_type_t type)
+{
+	switch (type) {
+		case OBJECT_TYPE_BOOL:
+			return boolobject_new ((bool) val, NULL);
+		case OBJECT_TYPE_CHAR:
+			return charobject_new ((char) val, NULL);
+		case OBJECT_TYPE_UCHAR:
+			return ucharobject_new ((unsigned char) val, NULL);
+		case OBJECT_TYPE_SHORT:
+			return shortobject_new ((short) val, NULL);
+		case OBJECT_TYPE_USHORT:
+			return ushortobject_new ((unsigned short int) val, NULL);
+		case OBJECT_TYPE_INT:
+			return intobject_new ((int) val, NULL);
+		case OBJECT_TYPE_UINT:
+			return uintobject_new ((unsigned int) val, NULL);
+		case OBJECT_TYPE_LONG:
+			return longobject_new ((long) val, NULL);
+		case OBJECT_TYPE_ULONG:
+			return ulongobject_new ((unsigned long int) val, NULL);
+		case OBJECT_TYPE_INT8:
+			return int8object_new ((int8_t) val, NULL);
+		case OBJECT_TYPE_UINT8:
+			return uint8object_new ((uint8_t) val, NULL);
+		case OBJECT_TYPE_INT16:
+			return int16object_new ((int16_t) val, NULL);
+		case OBJECT_TYPE_UINT16:
+			return uint16object_new ((uint16_t) val, NULL);
+		case OBJECT_TYPE_INT32:
+			return int32object_new ((int32_t) val, NULL);
+		case OBJECT_TYPE_UINT32:
+			return uint32object_new ((uint32_t) val, NULL);
+		case OBJECT_TYPE_INT64:
+			return int64object_new ((int64_t) val, NULL);
+		case OBJECT_TYPE_UINT64:
+			return uint64object_new ((uint64_t) val, NULL);
+		case OBJECT_TYPE_FLOAT:
+			return floatobject_new ((float) val, NULL);
+		case OBJECT_TYPE_DOUBLE:
+			return doubleobject_new ((double) val, NULL);
+		default:
+			error ("try to cast numberical object to %s.", TYPE_ID_NAME (type));
+			return NULL;
+	}
+}
+
 object_t *
 object_cast (object_t *obj, object_type_t type)
 {
 	if (INTEGER_TYPE (obj)) {
-		integer_value_t val;
-
-		val = object_get_integer (obj);
-		switch (type) {
-			case OBJECT_TYPE_BOOL:
-				return boolobject_new ((bool) val, NULL);
-			case OBJECT_TYPE_CHAR:
-				return charobject_new ((char) val, NULL);
-			case OBJECT_TYPE_UCHAR:
-				return ucharobject_new ((unsigned char) val, NULL);
-			case OBJECT_TYPE_SHORT:
-				return shortobject_new ((short) val, NULL);
-			case OBJECT_TYPE_USHORT:
-				return ushortobject_new ((unsigned short int) val, NULL);
-			case OBJECT_TYPE_INT:
-				return intobject_new ((int) val, NULL);
-			case OBJECT_TYPE_UINT:
-				return uintobject_new ((unsigned int) val, NULL);
-			case OBJECT_TYPE_LONG:
-				return longobject_new ((long) val, NULL);
-			case OBJECT_TYPE_ULONG:
-				return ulongobject_new ((unsigned long int) val, NULL);
-			case OBJECT_TYPE_INT8:
-				return int8object_new ((int8_t) val, NULL);
-			case OBJECT_TYPE_UINT8:
-				return uint8object_new ((uint8_t) val, NULL);
-			case OBJECT_TYPE_INT16:
-				return int16object_new ((int16_t) val, NULL);
-			case OBJECT_TYPE_UINT16:
-				return uint16object_new ((uint16_t) val, NULL);
-			case OBJECT_TYPE_INT32:
-				return int32object_new ((int32_t) val, NULL);
-			case OBJECT_TYPE_UINT32:
-				return uint32object_new ((uint32_t) val, NULL);
-			case OBJECT_TYPE_INT64:
-				return int64object_new ((int64_t) val, NULL);
-			case OBJECT_TYPE_UINT64:
-				return uint64object_new ((uint64_t) val, NULL);
-			case OBJECT_TYPE_FLOAT:
-				return floatobject_new ((float) val, NULL);
-			case OBJECT_TYPE_DOUBLE:
-				return doubleobject_new ((double) val, NULL);
-			default:
-				error ("try to cast numberical object to %s.", TYPE_ID_NAME (type));
-				return NULL;
-		}
+		return object_new_integer (object_get_integer (obj), type);
 	}
 	else if (FLOATING_TYPE (obj)) {
-		floating_value_t val;
-
-		val = object_get_floating (obj);
-		switch (type) {
-			case OBJECT_TYPE_BOOL:
-				return boolobject_new ((bool) val, NULL);
-			case OBJECT_TYPE_CHAR:
-				return charobject_new ((char) val, NULL);
-			case OBJECT_TYPE_UCHAR:
-				return ucharobject_new ((unsigned char) val, NULL);
-			case OBJECT_TYPE_SHORT:
-				return shortobject_new ((short) val, NULL);
-			case OBJECT_TYPE_USHORT:
-				return ushortobject_new ((unsigned short int) val, NULL);
-			case OBJECT_TYPE_INT:
-				return intobject_new ((int) val, NULL);
-			case OBJECT_TYPE_UINT:
-				return uintobject_new ((unsigned int) val, NULL);
-			case OBJECT_TYPE_LONG:
-				return longobject_new ((long) val, NULL);
-			case OBJECT_TYPE_ULONG:
-				return ulongobject_new ((unsigned long int) val, NULL);
-			case OBJECT_TYPE_INT8:
-				return int8object_new ((int8_t) val, NULL);
-			case OBJECT_TYPE_UINT8:
-				return uint8object_new ((uint8_t) val, NULL);
-			case OBJECT_TYPE_INT16:
-				return int16object_new ((int16_t) val, NULL);
-			case OBJECT_TYPE_UINT16:
-				return uint16object_new ((uint16_t) val, NULL);
-			case OBJECT_TYPE_INT32:
-				return int32object_new ((int32_t) val, NULL);
-			case OBJECT_TYPE_UINT32:
-				return uint32object_new ((uint32_t) val, NULL);
-			case OBJECT_TYPE_INT64:
-				return int64object_new ((int64_t) val, NULL);
-			case OBJECT_TYPE_UINT64:
-				return uint64object_new ((uint64_t) val, NULL);
-			case OBJECT_TYPE_FLOAT:
-				return floatobject_new ((float) val, NULL);
-			case OBJECT_TYPE_DOUBLE:
-				return doubleobject_new ((double) val, NULL);
-			default:
-				error ("try to cast numberical object to %s.", TYPE_ID_NAME (type));
-				return NULL;
-		}
+		return object_new_floating (object_get_floating (obj), type);
 	}
 
 	error ("only numberical object can be casted.");
@@ -389,7 +415,26 @@ object_free (object_t *obj)
 		free_fun (obj);
 	}
 
-	pool_free ((void *) obj);
+	/* Hot scalar types go back to their own freelists. */
+	switch (OBJECT_TYPE (obj)) {
+		case OBJECT_TYPE_INT:
+			pool_freelist_free (FREELIST_INT, (void *) obj);
+			break;
+		case OBJECT_TYPE_DOUBLE:
+			pool_freelist_free (FREELIST_DOUBLE, (void *) obj);
+			break;
+		case OBJECT_TYPE_STR:
+			pool_freelist_free (FREELIST_STR, (void *) obj);
+			break;
+		default:
+			if (CONTAINER_TYPE (obj)) {
+				gc_free ((void *) obj);
+			}
+			else {
+				pool_free ((void *) obj);
+			}
+			break;
+	}
 }
 
 object_t *
@@ -1141,36 +1186,36 @@ object_address_hash (void *obj)
 object_t *
 object_hash (object_t *obj)
 {
-	una_op_f hash_fun;
-
-	hash_fun = (OBJECT_OPSET (obj))->hash;
-	/* At this stage, this is impossible, =_=. */
-	if (hash_fun == NULL) {
-		error ("type %s has no hash routine.", TYPE_NAME (obj));
-
-		return NULL;
-	}
-
-	return hash_fun (obj);
+	return uint64object_new (object_digest (obj), NULL);
 }
 
+/* Values never change and containers are hashed by address, so
+ * the digest is computed once and kept in the head. Objects shared
+ * by threads are left alone, frozen ones already have theirs. */
 uint64_t
 object_digest (object_t *obj)
 {
-	digest_f digest_fun;
+	digest_f hash_fun;
+	uint64_t digest;
 
 	if (OBJECT_DIGEST (obj)) {
 		return OBJECT_DIGEST (obj);
 	}
 
-	digest_fun = obj->head.digest_fun;
-	if (digest_fun == NULL) {
+	hash_fun = (OBJECT_OPSET (obj))->hash;
+	/* At this stage, this is impossible, =_=. */
+	if (hash_fun == NULL) {
 		error ("type %s has no hash routine.", TYPE_NAME (obj));
 
 		return 0;
 	}
 
-	return digest_fun (obj);
+	digest = hash_fun (obj);
+	if (!OBJECT_SHARED (obj)) {
+		OBJECT_DIGEST (obj) = digest;
+	}
+
+	return digest;
 }
 
 /* At this stage, this operation is only used by dumping code.
@@ -1472,7 +1517,109 @@ object_traverse (object_t *obj, traverse_f fun, void *udata)
 	}
 }
 
+/* Like object_traverse, but big containers are walked n references at a
+ * time from *pos on, gives 1 once obj is done. */
+int
+object_traverse_slice (object_t *obj, traverse_f fun, void *udata, size_t *pos, size_t n)
+{
+	switch (OBJECT_TYPE (obj)) {
+		case OBJECT_TYPE_VEC:
+			return vecobject_traverse_slice (obj, fun, udata, pos, n);
+		case OBJECT_TYPE_DICT:
+			return dictobject_traverse_slice (obj, fun, udata, pos, n);
+		default:
+			object_traverse (obj, fun, udata);
+
+			return 1;
+	}
+}
+
+
 
+int
+object_pack (object_t *obj, packed_object_t *packed)
+{
+	object_t *binary;
+	str_t *str;
+
+	packed->type = OBJECT_TYPE (obj);
+	packed->buf = NULL;
+	packed->len = 0;
+	if (INTEGER_TYPE (obj)) {
+		packed->kind = PACKED_INTEGER;
+		packed->scalar.integer = object_get_integer (obj);
+
+		return 1;
+	}
+	else if (FLOATING_TYPE (obj)) {
+		packed->kind = PACKED_FLOATING;
+		packed->scalar.floating = object_get_floating (obj);
+
+		return 1;
+	}
+	else if (OBJECT_IS_NULL (obj)) {
+		packed->kind = PACKED_NULL;
+
+		return 1;
+	}
+
+	binary = NULL;
+	if (OBJECT_IS_STR (obj)) {
+		packed->kind = PACKED_STR;
+		str = strobject_get_value (obj);
+	}
+	else {
+		packed->kind = PACKED_BINARY;
+		binary = object_binary (obj);
+		if (binary == NULL) {
+			return 0;
+		}
+		str = strobject_get_value (binary);
+	}
+
+	/* Not from the pool, which belongs to this thread. */
+	packed->len = str_len (str);
+	packed->buf = (char *) malloc (packed->len + 1);
+	if (packed->buf == NULL) {
+		fatal_error ("out of memory.");
+	}
+	memcpy (packed->buf, str_c_str (str), packed->len);
+	if (binary != NULL) {
+		object_free (binary);
+	}
+
+	return 1;
+}
+
+object_t *
+object_unpack (packed_object_t *packed)
+{
+	const char *buf;
+	size_t len;
+
+	switch (packed->kind) {
+		case PACKED_INTEGER:
+			return object_new_integer (packed->scalar.integer, packed->type);
+		case PACKED_FLOATING:
+			return object_new_floating (packed->scalar.floating, packed->type);
+		case PACKED_NULL:
+			return nullobject_new (NULL);
+		case PACKED_STR:
+			return strobject_new (packed->buf, packed->len, 0, NULL);
+		default:
+			buf = packed->buf;
+			len = packed->len;
+
+			return object_load_buf (&buf, &len);
+	}
+}
+
+void
+object_pack_free (packed_object_t *packed)
+{
+	free ((void *) packed->buf);
+	packed->buf = NULL;
+}
 
 object_t *
 object_copy (object_t *obj)
@@ -1500,17 +1647,43 @@ object_copy (object_t *obj)
 	}
 }
 
+void
+object_register_opset (object_type_t type, object_opset_t *ops)
+{
+	g_opset_table[OPSET_INDEX (type)] = ops;
+}
+
 void
 object_init ()
 {
+	object_register_opset (OBJECT_TYPE_VOID, &g_dummy_ops);
+
 	/* Init some types of objects. */
 	nullobject_init ();
 	boolobject_init ();
+	charobject_init ();
+	ucharobject_init ();
+	shortobject_init ();
+	ushortobject_init ();
 	intobject_init ();
+	uintobject_init ();
 	longobject_init ();
+	ulongobject_init ();
+	int8object_init ();
+	uint8object_init ();
+	int16object_init ();
+	uint16object_init ();
+	int32object_init ();
+	uint32object_init ();
+	int64object_init ();
+	uint64object_init ();
+	floatobject_init ();
+	doubleobject_init ();
 	strobject_init ();
 	vecobject_init ();
 	dictobject_init ();
+	funcobject_init ();
+	modobject_init ();
 	exceptionobject_init ();
 	structobject_init ();
 	unionobject_init ();
@@ -119,22 +119,30 @@
 
 #define CAN_CAST(x, y) (CAST_TYPE((x))&&CAST_TYPE((y)))
 
+#define OBJECT_FLAG_CONST 0x01
+#define OBJECT_FLAG_SHARED 0x02 /* Stands for a global shared by threads. */
+#define OBJECT_FLAG_FROZEN 0x04 /* Immutable and immortal, used as it is by all threads. */
+#define OBJECT_FLAG_WATCHED 0x08 /* A snapshot of the globals holds a copy of it. */
+
 #define OBJECT_REF(x) ((x)->head.ref)
-#define OBJECT_CONST(x) ((x)->head.cnst)
+#define OBJECT_FLAGS(x) ((x)->head.flags)
+#define OBJECT_CONST(x) (OBJECT_FLAGS((x))&OBJECT_FLAG_CONST)
+#define OBJECT_SHARED(x) (OBJECT_FLAGS((x))&OBJECT_FLAG_SHARED)
+#define OBJECT_FROZEN(x) (OBJECT_FLAGS((x))&OBJECT_FLAG_FROZEN)
+#define OBJECT_WATCHED(x) (OBJECT_FLAGS((x))&OBJECT_FLAG_WATCHED)
 #define OBJECT_TYPE(x) ((x)->head.type)
-#define OBJECT_OPSET(x) ((object_opset_t *) ((x)->head.ops))
-#define OBJECT_OPSET_P(x) ((x)->head.ops)
 #define OBJECT_DIGEST(x) ((x)->head.digest)
-#define OBJECT_DIGEST_FUN(x) ((x)->head.digest_fun)
-#define OBJECT_UDATA(x) ((x)->head.udata)
 
-#define OBJECT_NEW_INIT(x, t, d) OBJECT_REF((x))=0;\
+/* Opsets are indexed by type, all structs share one slot and so do unions. */
+#define OPSET_NUM (OBJECT_TYPE_EXCEPTION+3)
+#define OPSET_INDEX(t) ((t)<OBJECT_TYPE_STRUCT?(size_t)(t):\
+	((t)<OBJECT_TYPE_UNION?OPSET_NUM-2:OPSET_NUM-1))
+#define OBJECT_OPSET(x) (g_opset_table[OPSET_INDEX(OBJECT_TYPE((x)))])
+
+#define OBJECT_NEW_INIT(x, t) OBJECT_REF((x))=0;\
 	OBJECT_TYPE((x))=t;\
-	OBJECT_CONST((x))=0;\
-	OBJECT_OPSET_P((x))=(void*)&g_object_ops;\
-	OBJECT_DIGEST ((x))=0;\
-	OBJECT_UDATA ((x))=d;\
-	GC_INIT(((gc_head_t*)(x)))
+	OBJECT_FLAGS((x))=0;\
+	OBJECT_DIGEST ((x))=0
 
 #define OBJECT_BIGGER(o1, o2) (OBJECT_TYPE((o1))<OBJECT_TYPE((o2))?\
 	object_cast((o1),OBJECT_TYPE((o2))):(o1))
@@ -226,18 +234,13 @@ typedef enum object_type_e
 	OBJECT_TYPE_UNION = 0xf0000000
 } object_type_t;
 
-typedef uint64_t (*digest_f) (void *obj);
-
+/* Containers carry a gc_head_t in front of this header, see gc_alloc. */
 typedef struct object_head_s
 {
-	gc_head_t gc;
 	int ref;
-	int cnst;
+	unsigned int flags;
 	object_type_t type;
 	uint64_t digest;
-	digest_f digest_fun;
-	void *ops;
-	void *udata;
 } object_head_t;
 
 typedef struct object_s
@@ -245,6 +248,30 @@ typedef struct object_s
 	object_head_t head;
 } object_t;
 
+typedef enum packed_kind_e
+{
+	PACKED_INTEGER,
+	PACKED_FLOATING,
+	PACKED_NULL,
+	PACKED_STR,
+	PACKED_BINARY
+} packed_kind_t;
+
+/* An object out of any heap, so that it can move between threads.
+ * Scalars are kept as they are and strs as their bytes, only
+ * containers are dumped to binary. */
+typedef struct packed_object_s
+{
+	packed_kind_t kind;
+	object_type_t type;
+	union {
+		integer_value_t integer;
+		floating_value_t floating;
+	} scalar;
+	char *buf;
+	size_t len;
+} packed_object_t;
+
 typedef object_t *(*una_op_f) (object_t *obj);
 
 typedef void (*void_una_op_f) (object_t *obj);
@@ -253,6 +280,8 @@ typedef object_t *(*bin_op_f) (object_t *obj1, object_t *obj2);
 
 typedef object_t *(*ter_op_f) (object_t *obj1, object_t *obj2, object_t *ob3);
 
+typedef uint64_t (*digest_f) (object_t *obj);
+
 typedef int (*traverse_f) (object_t *obj, void *data);
 
 typedef struct object_opset_s
@@ -280,11 +309,13 @@ typedef struct object_opset_s
 	bin_op_f cmp;
 	bin_op_f index;
 	ter_op_f ipindex;
-	una_op_f hash;
+	digest_f hash;
 	una_op_f binary;
 	una_op_f len;
 } object_opset_t;
 
+extern object_opset_t *g_opset_table[OPSET_NUM];
+
 void
 object_ref (object_t *obj);
 
@@ -297,6 +328,9 @@ object_unref_without_free (object_t *obj);
 void
 object_set_const (object_t *obj);
 
+void
+object_freeze (object_t *obj);
+
 integer_value_t
 object_get_integer (object_t *obj);
 
@@ -306,6 +340,12 @@ object_get_floating (object_t *obj);
 int
 object_is_zero (object_t *obj);
 
+object_t *
+object_new_integer (integer_value_t val, object_type_t type);
+
+object_t *
+object_new_floating (floating_value_t val, object_type_t type);
+
 object_t *
 object_cast (object_t *obj, object_type_t type);
 
@@ -402,6 +442,15 @@ object_load_binary (FILE *f);
 object_t *
 object_load_buf (const char **buf, size_t *len);
 
+int
+object_pack (object_t *obj, packed_object_t *packed);
+
+object_t *
+object_unpack (packed_object_t *packed);
+
+void
+object_pack_free (packed_object_t *packed);
+
 void
 object_print (object_t *obj);
 
@@ -411,9 +460,15 @@ object_len (object_t *obj);
 void
 object_traverse (object_t *obj, traverse_f fun, void *udata);
 
+int
+object_traverse_slice (object_t *obj, traverse_f fun, void *udata, size_t *pos, size_t n);
+
 object_t *
 object_copy (object_t *obj);
 
+void
+object_register_opset (object_type_t type, object_opset_t *ops);
+
 void
 object_init ();
 
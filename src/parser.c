@@ -2122,7 +2122,7 @@ parser_vec_constant (parser_t *parser, code_t *code)
 				break;
 			}
 			case TOKEN_STRING:
-				element = strobject_new (TOKEN_ID (parser->token), strlen (TOKEN_ID (parser->token)), 0, NULL);
+				element = strobject_intern (TOKEN_ID (parser->token), strlen (TOKEN_ID (parser->token)));
 				parser_next_token (parser);
 				break;
 			default:
@@ -2212,7 +2212,7 @@ parser_dict_constant (parser_t *parser, code_t *code)
 				break;
 			}
 			case TOKEN_STRING:
-				key = strobject_new (TOKEN_ID (parser->token), strlen (TOKEN_ID (parser->token)), 0, NULL);
+				key = strobject_intern (TOKEN_ID (parser->token), strlen (TOKEN_ID (parser->token)));
 				parser_next_token (parser);
 				break;
 			default:
@@ -2279,7 +2279,7 @@ parser_dict_constant (parser_t *parser, code_t *code)
 				break;
 			}
 			case TOKEN_STRING:
-				value = strobject_new (TOKEN_ID (parser->token), strlen (TOKEN_ID (parser->token)), 0, NULL);
+				value = strobject_intern (TOKEN_ID (parser->token), strlen (TOKEN_ID (parser->token)));
 				parser_next_token (parser);
 				break;
 			default:
@@ -2420,9 +2420,8 @@ parser_primary_expression (parser_t *parser, code_t *code, int leading_par)
 		case TOKEN_STRING:
 			pos = parser_push_const (code,
 									 OBJECT_TYPE_STR,
-									 strobject_new (TOKEN_ID (parser->token),
-									 strlen (TOKEN_ID (parser->token)), 0,
-									 NULL));
+									 strobject_intern (TOKEN_ID (parser->token),
+									 strlen (TOKEN_ID (parser->token))));
 			parser_next_token (parser);
 			if (pos == -1) {
 				return 0;
@@ -3397,7 +3396,7 @@ parser_check_binary (const char *path)
 	int res;
 
 	len = strlen (path);
-	f = (char *) pool_alloc (len);
+	f = (char *) pool_alloc (len + 1);
 	if (f == NULL) {
 		return -1;
 	}
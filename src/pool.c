@@ -25,6 +25,7 @@
 #include "pool.h"
 #include "list.h"
 #include "error.h"
+#include "thread_pthread.h"
 
 /* The general structure of koa memory allocation is Pool=>Page=>Cell.
  * There are several kinds of cells: from 8 bytes to 256 bytes, and all
@@ -39,6 +40,8 @@
 #define CHILD_INIT_REQUEST_SIZE (16*PAGE_SIZE) /* For child thread when starting. */
 #define INIT_POOL_NUM 1
 #define RECYCLE_CYCLE 100
+#define FREELIST_MAX_SIZE 2048 /* Cap for each per-type freelist. */
+#define SPARE_ALLOCATOR_NUM 64
 
 #define BLOCK_START(x, s) ((void *)(((intptr_t)(x))&(~((intptr_t)((s)-1)))))
 
@@ -48,13 +51,21 @@
 
 #define REQ_2_CELL_TYPE(x) ((int)((x)-1)/8+1)
 
+#define PAGE_HASH(p) ((int)((intptr_t)(p)%PAGE_HASH_BUCKET))
+
 typedef unsigned char cell_type_t;
 
+typedef struct page_hash_s
+{
+	list_t link;
+	struct page_s *p;
+} page_hash_t;
+
 typedef struct page_s
 {
 	list_t link;
 	void *pool;
-	void *hash;
+	page_hash_t hash; /* Kept in the page, so no cell pins it. */
 	cell_type_t t;
 	int allocated;
 	size_t cell_size; /* Pages can be reused for another size. */
@@ -69,17 +80,18 @@ typedef struct pool_s
 	int used;
 	list_t *free;
 	int cycle; /* To release pools that is empty for a long time. */
+	int adopted; /* Taken over from an exited thread. */
 } pool_t;
 
-typedef struct page_hash_s
-{
-	list_t link;
-	page_t *p;
-} page_hash_t;
-
 static __thread allocator_t *g_allocator;
 static __thread allocator_t *g_second_allocator;
 
+/* Emptied allocators kept for later tasks, zeroing a new page hash costs
+ * more than most tasks. They are chained through pool_list. */
+static allocator_t *g_spare_allocator;
+static int g_spare_allocator_num;
+static _thread_mutex_t g_spare_lock;
+
 static void
 pool_page_init (page_t *page, cell_type_t t)
 {
@@ -107,16 +119,10 @@ pool_page_hash_add (allocator_t *allocator, page_t *page)
 	int b;
 	page_hash_t *ph;
 
-	b = (intptr_t) page % PAGE_HASH_BUCKET;
-	/* Hash data can be allocated from pool! */
-	ph = (page_hash_t *) pool_alloc_allocator (allocator, sizeof (page_hash_t));
-	if (ph == NULL) {
-		return 0;
-	}
-
+	b = PAGE_HASH (page);
+	ph = &page->hash;
 	ph->p = page;
 	allocator->page_hash[b] = list_append (allocator->page_hash[b], LIST (ph));
-	page->hash = ph;
 
 	return 1;
 }
@@ -128,11 +134,9 @@ pool_page_hash_remove (allocator_t *allocator, page_t *page)
 	int b;
 	page_hash_t *ph;
 
-	b = (intptr_t) page % PAGE_HASH_BUCKET;
-	ph = (page_hash_t *) page->hash;
+	b = PAGE_HASH (page);
+	ph = &page->hash;
 	allocator->page_hash[b] = list_remove (allocator->page_hash[b], LIST (ph));
-
-	pool_free_allocator (allocator, (void *) ph);
 }
 
 static pool_t *
@@ -199,6 +203,12 @@ pool_empty_page_in (allocator_t *allocator, pool_t *pool, page_t *page)
 	/* Set empty flag for recycling empty pools. */
 	if (pool->used <= 0) {
 		pool->cycle = 1;
+		/* Adopted pools mostly hold results that are dropped at
+		 * some point, give them back once empty. */
+		if (pool->adopted) {
+			allocator->pool_list = list_remove (allocator->pool_list, LIST (pool));
+			free ((void *) pool);
+		}
 	}
 }
 
@@ -289,10 +299,14 @@ pool_alloc_allocator (allocator_t *allocator, size_t size)
 	void *cell;
 	int need_hash;
 
+	allocator->alloc_count++;
+
 	/* If size is larger than max cell size, use system malloc then. */
 	if (size > MAX_CELL_SIZE) {
 		void *ret;
 
+		allocator->large_count++;
+
 		ret = malloc (size);
 		if (ret == NULL) {
 			return NULL;
@@ -404,6 +418,8 @@ pool_free (void *bl)
 {
 	if (g_second_allocator != NULL) {
 		pool_free_allocator (g_second_allocator, bl);
+
+		return;
 	}
 	pool_free_allocator (g_allocator, bl);
 }
@@ -413,6 +429,7 @@ pool_free_allocator (allocator_t *allocator, void *bl)
 {
 	page_t *page;
 
+	allocator->free_count++;
 	if (!pool_is_pool_cell (allocator, bl)) {
 		/* Use system free to release this block. */
 		free (bl);
@@ -439,6 +456,67 @@ pool_free_allocator (allocator_t *allocator, void *bl)
 	}
 }
 
+void *
+pool_freelist_alloc (freelist_type_t type, size_t size)
+{
+	allocator_t *allocator;
+	freelist_t *fl;
+	void *cell;
+
+	allocator = g_second_allocator != NULL? g_second_allocator: g_allocator;
+	fl = &allocator->freelist[type];
+	if (fl->head == NULL) {
+		fl->miss++;
+
+		return pool_alloc_allocator (allocator, size);
+	}
+
+	cell = fl->head;
+	fl->head = *((void **) cell);
+	fl->size--;
+	fl->hit++;
+
+	return cell;
+}
+
+void
+pool_freelist_free (freelist_type_t type, void *bl)
+{
+	freelist_t *fl;
+
+	/* Cells of a second allocator are not owned by this thread, and
+	 * cells of adopted or shared heaps are not owned by g_allocator. */
+	if (g_second_allocator != NULL || !pool_is_pool_cell (g_allocator, bl)) {
+		pool_free (bl);
+
+		return;
+	}
+
+	fl = &g_allocator->freelist[type];
+	if (fl->size >= FREELIST_MAX_SIZE) {
+		pool_free_allocator (g_allocator, bl);
+
+		return;
+	}
+
+	*((void **) bl) = fl->head;
+	fl->head = bl;
+	fl->size++;
+}
+
+void
+pool_get_stats (pool_stats_t *stats)
+{
+	stats->alloc = g_allocator->alloc_count;
+	stats->free = g_allocator->free_count;
+	stats->large_alloc = g_allocator->large_count;
+	for (int i = 0; i < FREELIST_NUM; i++) {
+		stats->freelist_size[i] = g_allocator->freelist[i].size;
+		stats->freelist_hit[i] = g_allocator->freelist[i].hit;
+		stats->freelist_miss[i] = g_allocator->freelist[i].miss;
+	}
+}
+
 static int
 pool_add_cycle (list_t *list, void *data)
 {
@@ -486,7 +564,126 @@ pool_free_list (list_t *list, void *data)
 void
 pool_free_all ()
 {
-	list_foreach (g_allocator->pool_list, pool_free_list, NULL);
+	pool_free_all_allocator (g_allocator);
+}
+
+/* Drop all pages from the tables and the page hash, which is left
+ * empty without walking all buckets. */
+static void
+pool_clear_tables (allocator_t *allocator)
+{
+	list_t *l;
+
+	for (int i = 0; i <= MAX_CELL_SIZE / 8; i++) {
+		for (l = allocator->page_table[i]; l != NULL; l = LIST_NEXT (l)) {
+			allocator->page_hash[PAGE_HASH (l)] = NULL;
+		}
+		for (l = allocator->full_table[i]; l != NULL; l = LIST_NEXT (l)) {
+			allocator->page_hash[PAGE_HASH (l)] = NULL;
+		}
+		allocator->page_table[i] = NULL;
+		allocator->full_table[i] = NULL;
+	}
+}
+
+void
+pool_free_all_allocator (allocator_t *allocator)
+{
+	pool_clear_tables (allocator);
+	for (int i = 0; i < FREELIST_NUM; i++) {
+		allocator->freelist[i].head = NULL;
+		allocator->freelist[i].size = 0;
+	}
+	list_foreach (allocator->pool_list, pool_free_list, NULL);
+	allocator->pool_list = NULL;
+}
+
+/* Put list a in front of list b, both are null-terminated. */
+static list_t *
+pool_list_concat (list_t *a, list_t *b)
+{
+	list_t *tail;
+
+	if (a == NULL) {
+		return b;
+	}
+	if (b == NULL) {
+		return a;
+	}
+
+	for (tail = a; tail->next != NULL; tail = tail->next);
+	tail->next = b;
+	b->prev = tail;
+
+	return a;
+}
+
+/* Take over all pages of another allocator, whose thread must not use
+ * it anymore. Cells allocated from it are owned by this thread then, so
+ * objects can be handed over without copying them. */
+void
+pool_adopt_allocator (allocator_t *from)
+{
+	allocator_t *to;
+	list_t *l;
+	list_t *next;
+
+	to = g_allocator;
+	for (l = from->pool_list; l != NULL; l = next) {
+		pool_t *pool;
+
+		next = LIST_NEXT (l);
+		pool = (pool_t *) l;
+		pool->adopted = 1;
+		if (pool->used <= 0) {
+			from->pool_list = list_remove (from->pool_list, l);
+			free ((void *) pool);
+		}
+	}
+	/* Prefer own pools for new pages. */
+	to->pool_list = pool_list_concat (to->pool_list, from->pool_list);
+	from->pool_list = NULL;
+	/* Pages in use are exactly the hashed ones, rehashing them is much
+	 * cheaper than walking all buckets. */
+	for (int i = 0; i <= MAX_CELL_SIZE / 8; i++) {
+		for (l = from->page_table[i]; l != NULL; l = LIST_NEXT (l)) {
+			from->page_hash[PAGE_HASH (l)] = NULL;
+			UNUSED (pool_page_hash_add (to, (page_t *) l));
+		}
+		for (l = from->full_table[i]; l != NULL; l = LIST_NEXT (l)) {
+			from->page_hash[PAGE_HASH (l)] = NULL;
+			UNUSED (pool_page_hash_add (to, (page_t *) l));
+		}
+		to->page_table[i] = pool_list_concat (from->page_table[i], to->page_table[i]);
+		to->full_table[i] = pool_list_concat (from->full_table[i], to->full_table[i]);
+		from->page_table[i] = NULL;
+		from->full_table[i] = NULL;
+	}
+
+	to->alloc_count += from->alloc_count;
+	to->free_count += from->free_count;
+	to->large_count += from->large_count;
+
+	/* Cached cells are still allocated in their pages. */
+	for (int i = 0; i < FREELIST_NUM; i++) {
+		void *cell;
+		void *next;
+
+		for (cell = from->freelist[i].head; cell != NULL; cell = next) {
+			next = *((void **) cell);
+			if (to->freelist[i].size >= FREELIST_MAX_SIZE) {
+				pool_free_allocator (to, cell);
+				continue;
+			}
+			*((void **) cell) = to->freelist[i].head;
+			to->freelist[i].head = cell;
+			to->freelist[i].size++;
+		}
+		from->freelist[i].head = NULL;
+		from->freelist[i].size = 0;
+	}
+
+	pool_allocator_free (from);
 }
 
 void
@@ -503,11 +700,32 @@ pool_set_allocator (allocator_t *allocator)
 	}
 }
 
+/* Pooled worker threads switch to the allocator of each task. */
+void
+pool_reset_allocator (allocator_t *allocator)
+{
+	g_allocator = allocator;
+}
+
 allocator_t *
 pool_make_new_allocator ()
 {
 	allocator_t *allocator;
 
+	_thread_mutex_lock (&g_spare_lock);
+	allocator = g_spare_allocator;
+	if (allocator != NULL) {
+		g_spare_allocator = (allocator_t *) allocator->pool_list;
+		g_spare_allocator_num--;
+	}
+	_thread_mutex_unlock (&g_spare_lock);
+
+	if (allocator != NULL) {
+		allocator->pool_list = NULL;
+
+		return allocator;
+	}
+
 	allocator = calloc (1, sizeof (allocator_t));
 	if (allocator == NULL) {
 		fatal_error ("out of memory.");
@@ -516,15 +734,32 @@ pool_make_new_allocator ()
 	return allocator;
 }
 
+/* The allocator must hold no pages, as after pool_free_all_allocator or
+ * pool_adopt_allocator. */
 void
 pool_allocator_free (allocator_t *allocator)
 {
+	memset ((void *) allocator->freelist, 0, sizeof (allocator->freelist));
+	allocator->alloc_count = 0;
+	allocator->free_count = 0;
+	allocator->large_count = 0;
+
+	_thread_mutex_lock (&g_spare_lock);
+	if (g_spare_allocator_num < SPARE_ALLOCATOR_NUM) {
+		allocator->pool_list = (list_t *) g_spare_allocator;
+		g_spare_allocator = allocator;
+		g_spare_allocator_num++;
+		allocator = NULL;
+	}
+	_thread_mutex_unlock (&g_spare_lock);
+
 	free ((void *) allocator);
 }
 
 void
 pool_init ()
 {
+	_thread_mutex_init (&g_spare_lock);
 	g_allocator = calloc (1, sizeof (allocator_t));
 	if (g_allocator == NULL) {
 		fatal_error ("out of memory.");
@@ -29,12 +29,43 @@
 #define MAX_CELL_SIZE 512
 #define PAGE_HASH_BUCKET 196613
 
+/* Object kinds that are recycled through their own freelists. */
+typedef enum freelist_type_e
+{
+	FREELIST_INT,
+	FREELIST_DOUBLE,
+	FREELIST_STR,
+	FREELIST_NUM
+} freelist_type_t;
+
+typedef struct freelist_s
+{
+	void *head; /* Cells are chained through their first word. */
+	size_t size;
+	size_t hit;
+	size_t miss;
+} freelist_t;
+
+typedef struct pool_stats_s
+{
+	size_t alloc;
+	size_t free;
+	size_t large_alloc; /* Requests served by system malloc. */
+	size_t freelist_size[FREELIST_NUM];
+	size_t freelist_hit[FREELIST_NUM];
+	size_t freelist_miss[FREELIST_NUM];
+} pool_stats_t;
+
 typedef struct allocator_s
 {
     list_t *pool_list; /* All pools. */
     list_t *page_table[MAX_CELL_SIZE / 8 + 1]; /* Page table for quick access. */
     list_t *full_table[MAX_CELL_SIZE / 8 + 1]; /* All full pages. */
     list_t *page_hash[PAGE_HASH_BUCKET];
+    freelist_t freelist[FREELIST_NUM]; /* Per-thread, since allocators are. */
+    size_t alloc_count;
+    size_t free_count;
+    size_t large_count;
 } allocator_t;
 
 void *
@@ -55,18 +86,36 @@ pool_free (void *bl);
 void
 pool_free_allocator (allocator_t *allocator, void *bl);
 
+void *
+pool_freelist_alloc (freelist_type_t type, size_t size);
+
+void
+pool_freelist_free (freelist_type_t type, void *bl);
+
+void
+pool_get_stats (pool_stats_t *stats);
+
 void
 pool_recycle ();
 
 void
 pool_free_all ();
 
+void
+pool_free_all_allocator (allocator_t *allocator);
+
+void
+pool_adopt_allocator (allocator_t *from);
+
 void
 pool_set_second_allocator (allocator_t *allocator);
 
 void
 pool_set_allocator (allocator_t *allocator);
 
+void
+pool_reset_allocator (allocator_t *allocator);
+
 allocator_t *
 pool_make_new_allocator ();
 
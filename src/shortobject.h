@@ -42,4 +42,7 @@ shortobject_new (short val, void *udata);
 short
 shortobject_get_value (object_t *obj);
 
+void
+shortobject_init ();
+
 #endif /* SHORTOBJECT_H */
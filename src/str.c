@@ -21,10 +21,17 @@
 #include <stdio.h>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "str.h"
 #include "pool.h"
 #include "error.h"
 
+/* Same as isspace () in the C locale. */
+#define STR_IS_SPACE(c) ((c)==' '||(unsigned int)((unsigned char)(c)-'\t')<5)
+
 str_t *
 str_new (const char *s, size_t len)
 {
@@ -112,14 +119,157 @@ str_pos (str_t *str, integer_value_t pos)
 	return '\0';
 }
 
+/* The mem* functions of libc pick their SSE2/AVX2 versions at load
+ * time, so comparing and searching lean on them. */
 int
 str_cmp (str_t *str1, str_t *str2)
 {
+	size_t len;
+	int res;
+
 	if (str1 == str2) {
 		return 0;
 	}
 
-	return strcmp (str1->s, str2->s);
+	len = str1->len < str2->len? str1->len: str2->len;
+	res = memcmp (str1->s, str2->s, len);
+	if (res != 0 || str1->len == str2->len) {
+		return res;
+	}
+
+	/* A prefix is the smaller, like strcmp () does it. */
+	return str1->len < str2->len? -(int) (unsigned char) str2->s[len]:
+		(int) (unsigned char) str1->s[len];
+}
+
+int
+str_equal (str_t *str1, str_t *str2)
+{
+	return str1 == str2 || (str1->len == str2->len &&
+		memcmp (str1->s, str2->s, str1->len) == 0);
+}
+
+int
+str_starts_with (str_t *str, str_t *prefix)
+{
+	return str->len >= prefix->len && memcmp (str->s, prefix->s, prefix->len) == 0;
+}
+
+/* Position of sub in str at or after from, -1 if missing. */
+integer_value_t
+str_find (str_t *str, str_t *sub, size_t from)
+{
+	const char *p;
+	const char *last;
+
+	if (from > str->len || sub->len > str->len - from) {
+		return -1;
+	}
+	if (sub->len == 0) {
+		return (integer_value_t) from;
+	}
+
+	p = str->s + from;
+	last = str->s + str->len - sub->len;
+	while (p <= last) {
+		p = (const char *) memchr (p, sub->s[0], (size_t) (last - p) + 1);
+		if (p == NULL) {
+			return -1;
+		}
+		if (memcmp (p + 1, sub->s + 1, sub->len - 1) == 0) {
+			return (integer_value_t) (p - str->s);
+		}
+		p++;
+	}
+
+	return -1;
+}
+
+/* Occurrences of sub that don't overlap, an empty one is found
+ * between every two chars. */
+size_t
+str_count (str_t *str, str_t *sub)
+{
+	size_t n;
+	integer_value_t pos;
+
+	if (sub->len == 0) {
+		return str->len + 1;
+	}
+
+	n = 0;
+	pos = 0;
+	while ((pos = str_find (str, sub, (size_t) pos)) != -1) {
+		n++;
+		pos += (integer_value_t) sub->len;
+	}
+
+	return n;
+}
+
+/* Replace all occurrences of from, which is not empty. */
+str_t *
+str_replace (str_t *str, str_t *from, str_t *to)
+{
+	size_t n;
+	size_t start;
+	integer_value_t pos;
+	str_t *res;
+	char *p;
+
+	n = str_count (str, from);
+	res = str_empty_str_new (str->len - n * from->len + n * to->len);
+
+	p = res->s;
+	start = 0;
+	while ((pos = str_find (str, from, start)) != -1) {
+		memcpy (p, str->s + start, (size_t) pos - start);
+		p += (size_t) pos - start;
+		memcpy (p, to->s, to->len);
+		p += to->len;
+		start = (size_t) pos + from->len;
+	}
+	memcpy (p, str->s + start, str->len - start);
+
+	return res;
+}
+
+/* Position of the first char at or after from which is a space if
+ * space is set, or is not one otherwise. str->len if there is none. */
+size_t
+str_scan_space (str_t *str, size_t from, int space)
+{
+	size_t i;
+
+	i = from;
+#ifdef __SSE2__
+	for (; i + 16 <= str->len; i += 16) {
+		__m128i v;
+		__m128i t;
+		__m128i m;
+		int mask;
+
+		/* ' ' or one of \t \n \v \f \r, which are 9 to 13. */
+		v = _mm_loadu_si128 ((const __m128i *) (str->s + i));
+		t = _mm_sub_epi8 (v, _mm_set1_epi8 ('\t'));
+		m = _mm_cmpeq_epi8 (_mm_min_epu8 (t, _mm_set1_epi8 (4)), t);
+		m = _mm_or_si128 (m, _mm_cmpeq_epi8 (v, _mm_set1_epi8 (' ')));
+		mask = _mm_movemask_epi8 (m);
+		if (!space) {
+			mask = ~mask & 0xffff;
+		}
+		if (mask != 0) {
+			return i + (size_t) __builtin_ctz ((unsigned int) mask);
+		}
+	}
+#endif
+	for (; i < str->len; i++) {
+		if ((STR_IS_SPACE (str->s[i]) != 0) == (space != 0)) {
+			return i;
+		}
+	}
+
+	return str->len;
 }
 
 int
@@ -54,4 +54,22 @@ str_cmp (str_t *str1, str_t *str2);
 int
 str_cmp_c_str (str_t *str, const char *s);
 
+int
+str_equal (str_t *str1, str_t *str2);
+
+int
+str_starts_with (str_t *str, str_t *prefix);
+
+integer_value_t
+str_find (str_t *str, str_t *sub, size_t from);
+
+size_t
+str_count (str_t *str, str_t *sub);
+
+str_t *
+str_replace (str_t *str, str_t *from, str_t *to);
+
+size_t
+str_scan_space (str_t *str, size_t from, int space);
+
 #endif /* STR_H */
@@ -0,0 +1,220 @@
+/*
+ * strhash.c
+ * This file is part of koa
+ *
+ * Copyright (C) 2018 - Gordon Li
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "strhash.h"
+
+#define HASH_M 0xc6a4a7935bd1e995
+
+/* Murmurhash2. */
+uint64_t
+strhash_murmur (const char *s, size_t len, unsigned int seed)
+{
+	const uint8_t *start;
+	const uint8_t *end;
+	uint64_t m;
+	int r;
+	uint64_t h;
+
+	start = (const uint8_t *) s;
+	end = start + (len - (len & 7));
+
+	m = HASH_M;
+	r = 47;
+	h = seed ^ (len * m);
+
+	while (start != end) {
+		uint64_t k;
+
+		k = *((uint64_t *) start);
+		k *= m;
+		k ^= k >> r;
+		k *= m;
+		h ^= k;
+		h *= m;
+
+		start += 8;
+	}
+
+	switch (len & 7) {
+		case 7:
+			h ^= (uint64_t) start[6] << 48;
+		case 6:
+			h ^= (uint64_t) start[5] << 40;
+		case 5:
+			h ^= (uint64_t) start[4] << 32;
+		case 4:
+			h ^= (uint64_t) start[3] << 24;
+		case 3:
+			h ^= (uint64_t) start[2] << 16;
+		case 2:
+			h ^= (uint64_t) start[1] << 8;
+		case 1:
+			h ^= (uint64_t) start[0];
+			h *= m;
+	}
+
+	h ^= h >> r;
+	h *= m;
+	h ^= h >> r;
+
+	return h;
+}
+
+static const uint64_t g_wyhash_secret[4] =
+{
+	0x2d358dccaa6c78a5ULL,
+	0x8bb84b93962eacc9ULL,
+	0x4b33a62ed433d4a3ULL,
+	0x4d5a2da51de1aa47ULL
+};
+
+/* The 128-bit product of a and b, low half in a and high half in b. */
+static inline void
+strhash_wymum (uint64_t *a, uint64_t *b)
+{
+#ifdef __SIZEOF_INT128__
+	unsigned __int128 r;
+
+	r = (unsigned __int128) *a * *b;
+	*a = (uint64_t) r;
+	*b = (uint64_t) (r >> 64);
+#else
+	uint64_t ha;
+	uint64_t hb;
+	uint64_t la;
+	uint64_t lb;
+	uint64_t rh;
+	uint64_t rm0;
+	uint64_t rm1;
+	uint64_t rl;
+	uint64_t lo;
+	uint64_t t;
+	uint64_t c;
+
+	ha = *a >> 32;
+	hb = *b >> 32;
+	la = (uint32_t) *a;
+	lb = (uint32_t) *b;
+	rh = ha * hb;
+	rm0 = ha * lb;
+	rm1 = hb * la;
+	rl = la * lb;
+	t = rl + (rm0 << 32);
+	c = t < rl;
+	lo = t + (rm1 << 32);
+	c += lo < t;
+	*a = lo;
+	*b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t
+strhash_wymix (uint64_t a, uint64_t b)
+{
+	strhash_wymum (&a, &b);
+
+	return a ^ b;
+}
+
+static inline uint64_t
+strhash_wyr8 (const uint8_t *p)
+{
+	uint64_t v;
+
+	memcpy (&v, p, 8);
+
+	return v;
+}
+
+static inline uint64_t
+strhash_wyr4 (const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy (&v, p, 4);
+
+	return v;
+}
+
+/* Wyhash, final version 4. It takes 8 or 16 bytes per multiply and
+ * runs three independent lanes over long strs. */
+uint64_t
+strhash_wyhash (const char *s, size_t len, unsigned int seed)
+{
+	const uint8_t *p;
+	const uint64_t *secret;
+	uint64_t h;
+	uint64_t a;
+	uint64_t b;
+
+	p = (const uint8_t *) s;
+	secret = g_wyhash_secret;
+	h = (uint64_t) seed ^ strhash_wymix ((uint64_t) seed ^ secret[0], secret[1]);
+	if (len <= 16) {
+		if (len >= 4) {
+			a = (strhash_wyr4 (p) << 32) | strhash_wyr4 (p + ((len >> 3) << 2));
+			b = (strhash_wyr4 (p + len - 4) << 32) |
+				strhash_wyr4 (p + len - 4 - ((len >> 3) << 2));
+		}
+		else if (len > 0) {
+			a = ((uint64_t) p[0] << 16) | ((uint64_t) p[len >> 1] << 8) | p[len - 1];
+			b = 0;
+		}
+		else {
+			a = 0;
+			b = 0;
+		}
+	}
+	else {
+		size_t i;
+
+		i = len;
+		if (i >= 48) {
+			uint64_t h1;
+			uint64_t h2;
+
+			h1 = h;
+			h2 = h;
+			do {
+				h = strhash_wymix (strhash_wyr8 (p) ^ secret[1], strhash_wyr8 (p + 8) ^ h);
+				h1 = strhash_wymix (strhash_wyr8 (p + 16) ^ secret[2], strhash_wyr8 (p + 24) ^ h1);
+				h2 = strhash_wymix (strhash_wyr8 (p + 32) ^ secret[3], strhash_wyr8 (p + 40) ^ h2);
+				p += 48;
+				i -= 48;
+			} while (i >= 48);
+			h ^= h1 ^ h2;
+		}
+		while (i > 16) {
+			h = strhash_wymix (strhash_wyr8 (p) ^ secret[1], strhash_wyr8 (p + 8) ^ h);
+			p += 16;
+			i -= 16;
+		}
+		a = strhash_wyr8 (p + i - 16);
+		b = strhash_wyr8 (p + i - 8);
+	}
+
+	a ^= secret[1];
+	b ^= h;
+	strhash_wymum (&a, &b);
+
+	return strhash_wymix (a ^ secret[0] ^ len, b ^ secret[1]);
+}
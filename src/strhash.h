@@ -0,0 +1,33 @@
+/*
+ * strhash.h
+ * This file is part of koa
+ *
+ * Copyright (C) 2018 - Gordon Li
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STRHASH_H
+#define STRHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint64_t
+strhash_murmur (const char *s, size_t len, unsigned int seed);
+
+uint64_t
+strhash_wyhash (const char *s, size_t len, unsigned int seed);
+
+#endif /* STRHASH_H */
@@ -0,0 +1,222 @@
+/*
+ * strhash_check.c
+ * This file is part of koa
+ *
+ * Copyright (C) 2018 - Gordon Li
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Checks the str hashes: known answers, distribution and avalanche,
+ * then prints their throughput. Run by make check. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "strhash.h"
+
+#define DIST_KEYS (1 << 20)
+#define DIST_BUCKETS (1 << 16)
+#define DIST_MAX_CHI2 1.1 /* Per degree of freedom, 1.0 is ideal. */
+#define AVALANCHE_ROUNDS 2000
+#define AVALANCHE_LEN 24
+#define BENCH_BYTES 50000000L
+
+typedef uint64_t (*hash_fun_t) (const char *s, size_t len, unsigned int seed);
+
+/* Reference vectors of wyhash final4, message i is hashed with seed i. */
+static const char *g_messages[] =
+{
+	"",
+	"a",
+	"abc",
+	"message digest",
+	"abcdefghijklmnopqrstuvwxyz",
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789",
+	"12345678901234567890123456789012345678901234567890123456789012345678901234567890"
+};
+
+static const uint64_t g_wyhash_vectors[] =
+{
+	0x93228a4de0eec5a2ULL,
+	0xc5bac3db178713c4ULL,
+	0xa97f2f7b1d9b3314ULL,
+	0x786d1f1df3801df4ULL,
+	0xdca5a8138ad37c87ULL,
+	0xb9e734f117cfaf70ULL,
+	0x6cc5eab49a92d617ULL
+};
+
+static unsigned int g_buckets[DIST_BUCKETS];
+
+static int
+check_vectors ()
+{
+	int failed;
+
+	failed = 0;
+	for (size_t i = 0; i < sizeof (g_messages) / sizeof (g_messages[0]); i++) {
+		uint64_t h;
+
+		h = strhash_wyhash (g_messages[i], strlen (g_messages[i]), (unsigned int) i);
+		if (h != g_wyhash_vectors[i]) {
+			printf ("FAIL: wyhash vector %zu: %016llx, expected %016llx\n", i,
+					(unsigned long long) h, (unsigned long long) g_wyhash_vectors[i]);
+			failed = 1;
+		}
+	}
+
+	return failed;
+}
+
+/* Chi-squared of sequential keys like "key_123" over buckets taken
+ * from shift bits up, divided by the degrees of freedom. */
+static double
+dist_chi2 (hash_fun_t fun, int shift)
+{
+	char key[32];
+	double expected;
+	double chi2;
+
+	memset (g_buckets, 0, sizeof (g_buckets));
+	for (int i = 0; i < DIST_KEYS; i++) {
+		int len;
+
+		len = sprintf (key, "key_%d", i);
+		g_buckets[(fun (key, (size_t) len, 7) >> shift) & (DIST_BUCKETS - 1)]++;
+	}
+
+	expected = (double) DIST_KEYS / DIST_BUCKETS;
+	chi2 = 0;
+	for (int i = 0; i < DIST_BUCKETS; i++) {
+		chi2 += (g_buckets[i] - expected) * (g_buckets[i] - expected) / expected;
+	}
+
+	return chi2 / (DIST_BUCKETS - 1);
+}
+
+/* Average number of output bits flipped by flipping one input bit,
+ * 32 is ideal. */
+static double
+avalanche (hash_fun_t fun)
+{
+	char s[AVALANCHE_LEN];
+	double total;
+	long trials;
+
+	srand (1);
+	total = 0;
+	trials = 0;
+	for (int i = 0; i < AVALANCHE_ROUNDS; i++) {
+		uint64_t h;
+
+		for (int j = 0; j < AVALANCHE_LEN; j++) {
+			s[j] = (char) rand ();
+		}
+		h = fun (s, AVALANCHE_LEN, 1);
+		for (int bit = 0; bit < AVALANCHE_LEN * 8; bit++) {
+			s[bit / 8] ^= (char) (1 << (bit % 8));
+			total += __builtin_popcountll (h ^ fun (s, AVALANCHE_LEN, 1));
+			s[bit / 8] ^= (char) (1 << (bit % 8));
+			trials++;
+		}
+	}
+
+	return total / (double) trials;
+}
+
+static double
+now ()
+{
+	struct timespec t;
+
+	clock_gettime (CLOCK_MONOTONIC, &t);
+
+	return (double) t.tv_sec + (double) t.tv_nsec * 1e-9;
+}
+
+/* GB/s hashing len bytes at a time, each start depends on the last
+ * hash so calls can't be overlapped or dropped. */
+static double
+bench (hash_fun_t fun, const char *data, size_t len)
+{
+	long n;
+	uint64_t acc;
+	double start;
+
+	n = BENCH_BYTES / (long) len;
+	acc = 0;
+	start = now ();
+	for (long i = 0; i < n; i++) {
+		acc += fun (data + (acc & 63), len, 7);
+		__asm__ volatile ("" : "+r" (acc));
+	}
+
+	return (double) n * (double) len / (now () - start) / 1e9;
+}
+
+int
+main ()
+{
+	static const size_t lens[] = {5, 16, 32, 128, 1024};
+	static const struct
+	{
+		const char *name;
+		hash_fun_t fun;
+	} hashes[] =
+	{
+		{"wyhash", strhash_wyhash},
+		{"murmur", strhash_murmur}
+	};
+	char *data;
+	int failed;
+
+	failed = check_vectors ();
+
+	for (size_t i = 0; i < sizeof (hashes) / sizeof (hashes[0]); i++) {
+		double low;
+		double high;
+		double bits;
+
+		low = dist_chi2 (hashes[i].fun, 0);
+		high = dist_chi2 (hashes[i].fun, 48);
+		bits = avalanche (hashes[i].fun);
+		printf ("%s: chi2/df low bits %.3f, high bits %.3f, avalanche %.2f/64\n",
+				hashes[i].name, low, high, bits);
+		if (low > DIST_MAX_CHI2 || high > DIST_MAX_CHI2 || bits < 31.5 || bits > 32.5) {
+			printf ("FAIL: %s is poorly distributed.\n", hashes[i].name);
+			failed = 1;
+		}
+	}
+
+	data = (char *) malloc (4096);
+	if (data == NULL) {
+		return 1;
+	}
+	for (int i = 0; i < 4096; i++) {
+		data[i] = (char) (i * 7);
+	}
+	for (size_t i = 0; i < sizeof (lens) / sizeof (lens[0]); i++) {
+		printf ("len %4zu:", lens[i]);
+		for (size_t j = 0; j < sizeof (hashes) / sizeof (hashes[0]); j++) {
+			printf (" %s %.2f GB/s", hashes[j].name, bench (hashes[j].fun, data, lens[i]));
+		}
+		printf ("\n");
+	}
+	free (data);
+
+	return failed;
+}
@@ -20,9 +20,12 @@
 
 #include <stdbool.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <string.h>
 
+#include "config.h"
 #include "strobject.h"
+#include "strhash.h"
 #include "pool.h"
 #include "error.h"
 #include "thread.h"
@@ -30,23 +33,56 @@
 #include "charobject.h"
 #include "intobject.h"
 #include "uint64object.h"
+#include "vecobject.h"
 
-#define HASED(x) (((strobject_t*)(x))->hashed)
-#define HASH_HANDLE(x) (((strobject_t *)(x))->hn)
+#ifdef HAVE_PTHREAD_H
+#include "thread_pthread.h"
+#else
+#endif
+
+#define INTERNED(x) (((strobject_t*)(x))->interned)
+
+/* Strs this short keep their chars right after the object, all str
+ * objects are this large so that they share one freelist. */
+#define INLINE_LENGTH 22
+#define STROBJECT_SIZE (sizeof(strobject_t)+sizeof(str_t)+INLINE_LENGTH+1)
+#define STROBJECT_INLINE(x) ((str_t*)((strobject_t*)(x)+1))
 
 #define DUMP_HEAD_LENGTH 6
 #define DUMP_TAIL_LENGTH 2
-#define INTERNAL_STR_LENGTH 5
-#define HASH_M 0xc6a4a7935bd1e995
-#define INTERNAL_HASH_SIZE 4096
+#define INTERN_MIN_SIZE 4096
+
+/* Appending to a str this long starts a buffer, so that building a str
+ * piece by piece doesn't copy it all each time. */
+#define BUILDER_MIN_LENGTH 64
+
+/* States of a strbuf, see strobject_builder_store. */
+#define BUILDER_NEW 1
+#define BUILDER_BOUND 2
+
+/* Interned strs live as long as the process and are shared by all
+ * threads, the table only grows. */
+typedef struct intern_table_s
+{
+	object_t **slots;
+	size_t mask;
+	size_t size;
+	_thread_mutex_t lock;
+} intern_table_t;
 
-static __thread hash_t *g_internal_hash;
+static intern_table_t g_intern;
 
 static unsigned int g_internal_hash_seed;
 
+/* The empty str and all single chars, shared by every thread. */
+static object_t *g_small_str[UCHAR_MAX + 2];
+
 static str_t *g_dump_head;
 static str_t *g_dump_tail;
 
+static size_t strobject_length (object_t *obj);
+static const char *strobject_chars (object_t *obj);
+
 /* Object ops. */
 static void strobject_op_free (object_t *obj);
 static void strobject_op_print (object_t *obj);
@@ -55,7 +91,7 @@ static object_t *strobject_op_add (object_t *obj1, object_t *obj2);
 static object_t *strobject_op_eq (object_t *obj1, object_t *obj2);
 static object_t *strobject_op_cmp (object_t *obj1, object_t *obj2);
 static object_t *strobject_op_index (object_t *obj1, object_t *obj2);
-static object_t *strobject_op_hash (object_t *obj);
+static uint64_t strobject_op_hash (object_t *obj);
 static object_t *strobject_op_binary (object_t *obj);
 static object_t *strobject_op_len (object_t *obj);
 
@@ -89,15 +125,174 @@ static object_opset_t g_object_ops =
 	strobject_op_len /* Len. */
 };
 
+static strbuf_t *
+strobject_buf_new (size_t cap)
+{
+	strbuf_t *buf;
+
+	buf = (strbuf_t *) pool_alloc (sizeof (strbuf_t));
+	if (buf == NULL) {
+		fatal_error ("out of memory.");
+	}
+
+	buf->str = (str_t *) pool_alloc (sizeof (str_t) + cap + 1);
+	if (buf->str == NULL) {
+		fatal_error ("out of memory.");
+	}
+	buf->str->len = 0;
+	buf->str->s[0] = '\0';
+	buf->cap = cap;
+	buf->ref = 0;
+
+	return buf;
+}
+
+static void
+strobject_buf_release (strbuf_t *buf)
+{
+	if (--buf->ref > 0) {
+		return;
+	}
+
+	str_free (buf->str);
+	pool_free ((void *) buf);
+}
+
+/* Make room for len more chars, doubling the buffer. */
+static void
+strobject_buf_reserve (strbuf_t *buf, size_t len)
+{
+	str_t *str;
+	size_t cap;
+
+	if (buf->str->len + len <= buf->cap) {
+		return;
+	}
+
+	cap = buf->cap << 1;
+	if (cap < buf->str->len + len) {
+		cap = buf->str->len + len;
+	}
+
+	str = (str_t *) pool_alloc (sizeof (str_t) + cap + 1);
+	if (str == NULL) {
+		fatal_error ("out of memory.");
+	}
+	memcpy ((void *) str, (void *) buf->str, sizeof (str_t) + buf->str->len + 1);
+	str_free (buf->str);
+	buf->str = str;
+	buf->cap = cap;
+}
+
+/* Chars already there may be appended again, so they are fetched
+ * after the buffer is grown. */
+static void
+strobject_buf_append (strbuf_t *buf, object_t *piece)
+{
+	const char *s;
+	size_t len;
+
+	len = strobject_length (piece);
+	strobject_buf_reserve (buf, len);
+	s = strobject_chars (piece);
+	memmove ((void *) (buf->str->s + buf->str->len), (void *) s, len);
+	buf->str->len += len;
+	buf->str->s[buf->str->len] = '\0';
+}
+
+/* Only the str ending at the end of its buffer may append in place,
+ * the chars of the others are never touched. */
+static int
+strobject_buf_tail (strobject_t *obj)
+{
+	return obj->buf != NULL && obj->len == obj->buf->str->len;
+}
+
+static strobject_t *
+strobject_alloc ()
+{
+	strobject_t *obj;
+
+	obj = (strobject_t *) pool_freelist_alloc (FREELIST_STR, STROBJECT_SIZE);
+	if (obj == NULL) {
+		fatal_error ("out of memory.");
+	}
+
+	OBJECT_NEW_INIT (obj, OBJECT_TYPE_STR);
+
+	obj->val = NULL;
+	obj->buf = NULL;
+	obj->len = 0;
+	obj->interned = 0;
+	obj->builder = 0;
+	obj->str_hash = 0;
+
+	return obj;
+}
+
+/* Point val to the inline str, chars are left to the caller. */
+static str_t *
+strobject_inline (strobject_t *obj, size_t len)
+{
+	str_t *str;
+
+	str = STROBJECT_INLINE (obj);
+	str->len = len;
+	str->s[len] = '\0';
+	obj->val = str;
+
+	return str;
+}
+
+static object_t *
+strobject_buf_obj_new (strbuf_t *buf)
+{
+	strobject_t *obj;
+
+	obj = strobject_alloc ();
+	obj->buf = buf;
+	obj->len = buf->str->len;
+	buf->ref++;
+
+	return (object_t *) obj;
+}
+
+/* Give a str made from a buffer its own str_t. The last str of a
+ * buffer just takes it. */
+static void
+strobject_flatten (strobject_t *obj)
+{
+	strbuf_t *buf;
+
+	buf = obj->buf;
+	if (obj->len <= INLINE_LENGTH) {
+		memcpy ((void *) strobject_inline (obj, obj->len)->s, (void *) buf->str->s, obj->len);
+		strobject_buf_release (buf);
+	}
+	else if (strobject_buf_tail (obj) && buf->ref == 1) {
+		obj->val = buf->str;
+		pool_free ((void *) buf);
+	}
+	else {
+		obj->val = str_new (buf->str->s, obj->len);
+		strobject_buf_release (buf);
+	}
+	obj->buf = NULL;
+}
+
 /* Free. */
 void
 strobject_op_free (object_t *obj)
 {
-	/* If it's an interned str, delete it. */
-	if (thread_is_main_thread () && str_len (strobject_get_value (obj)) <= INTERNAL_STR_LENGTH && HASED (obj)) {
-		hash_fast_remove (g_internal_hash, HASH_HANDLE (obj));
+	strobject_t *ob;
+
+	ob = (strobject_t *) obj;
+	if (ob->buf != NULL) {
+		strobject_buf_release (ob->buf);
+	}
+	else if (ob->val != STROBJECT_INLINE (ob)) {
+		str_free (ob->val);
 	}
-	str_free (strobject_get_value (obj));
 }
 
 /* Print. */
@@ -144,9 +339,37 @@ strobject_op_add (object_t *obj1, object_t *obj2)
 	str_t *cated;
 	str_t *s1;
 	str_t *s2;
+	strobject_t *ob1;
+	strbuf_t *buf;
+
+	/* s = s + piece appends to the buffer of s. */
+	ob1 = (strobject_t *) obj1;
+	if (strobject_buf_tail (ob1)) {
+		strobject_buf_append (ob1->buf, obj2);
+
+		return strobject_buf_obj_new (ob1->buf);
+	}
+	if (strobject_length (obj1) >= BUILDER_MIN_LENGTH) {
+		buf = strobject_buf_new ((strobject_length (obj1) + strobject_length (obj2)) << 1);
+		strobject_buf_append (buf, obj1);
+		strobject_buf_append (buf, obj2);
+
+		return strobject_buf_obj_new (buf);
+	}
 
 	s1 = strobject_get_value (obj1);
 	s2 = strobject_get_value (obj2);
+	if (str_len (s1) + str_len (s2) <= INLINE_LENGTH) {
+		strobject_t *obj;
+		str_t *str;
+
+		obj = strobject_alloc ();
+		str = strobject_inline (obj, str_len (s1) + str_len (s2));
+		memcpy ((void *) str->s, (void *) str_c_str (s1), str_len (s1));
+		memcpy ((void *) (str->s + str_len (s1)), (void *) str_c_str (s2), str_len (s2));
+
+		return (object_t *) obj;
+	}
 	cated = str_concat (s1, s2);
 	if (cated == NULL) {
 		return NULL;
@@ -168,9 +391,12 @@ strobject_op_eq (object_t *obj1, object_t *obj2)
 
 	s1 = strobject_get_value (obj1);
 	if (OBJECT_TYPE (obj2) == OBJECT_TYPE_STR) {
+		if (INTERNED (obj1) && INTERNED (obj2)) {
+			return boolobject_new (false, NULL);
+		}
 		s2 = strobject_get_value (obj2);
 
-		return boolobject_new (str_cmp (s1, s2) == 0, NULL);
+		return boolobject_new (str_equal (s1, s2), NULL);
 	}
 
 	return boolobject_new (false, NULL);
@@ -213,76 +439,17 @@ strobject_op_index (object_t *obj1, object_t *obj2)
 	return charobject_new (str_pos (s, pos), NULL);
 }
 
-/* Murmurhash2. */
-static uint64_t
-strobject_murmur (const char *s, size_t len, unsigned int seed)
-{
-	const uint8_t *start;
-	const uint8_t *end;
-	uint64_t m;
-	int r;
-	uint64_t h;
-
-	start = (const uint8_t *) s;
-	end = start + (len - (len & 7));
-
-	m = HASH_M;
-	r = 47;
-	h = seed ^ (len * m);
-
-	while (start != end) {
-		uint64_t k;
-
-		k = *((uint64_t *) start);
-		k *= m;
-		k ^= k >> r;
-		k *= m;
-		h ^= k;
-		h *= m;
-
-		start += 8;
-	}
-
-	switch (len & 7) {
-		case 7:
-			h ^= (uint64_t) start[6] << 48;
-		case 6:
-			h ^= (uint64_t) start[5] << 40;
-		case 5:
-			h ^= (uint64_t) start[4] << 32;
-		case 4:
-			h ^= (uint64_t) start[3] << 24;
-		case 3:
-			h ^= (uint64_t) start[2] << 16;
-		case 2:
-			h ^= (uint64_t) start[1] << 8;
-		case 1:
-			h ^= (uint64_t) start[0];
-			h *= m;
-	}
-
-	h ^= h >> r;
-	h *= m;
-	h ^= h >> r;
-
-	return h;
-}
+#ifdef STR_HASH_MURMUR
+#define STR_HASH(s,len,seed) strhash_murmur((s),(len),(seed))
+#else
+#define STR_HASH(s,len,seed) strhash_wyhash((s),(len),(seed))
+#endif
 
 /* Hash. */
-static object_t *
-strobject_op_hash(object_t *obj)
+static uint64_t
+strobject_op_hash (object_t *obj)
 {
-	if (OBJECT_DIGEST (obj) == 0) {
-		str_t *str;
-
-		str = strobject_get_value (obj);
-
-		OBJECT_DIGEST (obj) = strobject_murmur (str_c_str (str),
-												str_len (str),
-												g_internal_hash_seed);
-	}
-
-	return uint64object_new (OBJECT_DIGEST (obj), NULL);
+	return strobject_get_hash (obj);
 }
 
 /* Binary. */
@@ -312,13 +479,7 @@ strobject_op_binary (object_t *obj)
 static object_t *
 strobject_op_len (object_t *obj)
 {
-	str_t *str;
-	size_t len;
-
-	str = strobject_get_value (obj);
-	len = str_len (str);
-
-	return uint64object_new ((uint64_t) len, NULL);
+	return uint64object_new ((uint64_t) strobject_length (obj), NULL);
 }
 
 object_t *
@@ -384,17 +545,6 @@ strobject_load_buf (const char **buf, size_t *len)
 	return obj;
 }
 
-static uint64_t
-strobject_digest_fun (void *obj)
-{
-	str_t *str;
-
-	str = strobject_get_value (obj);
-
-	return strobject_murmur (str_c_str (str), str_len (str),
-							 g_internal_hash_seed);
-}
-
 object_t *
 strobject_new (const char *val, size_t len, int no_hash, void *udata)
 {
@@ -404,122 +554,298 @@ strobject_new (const char *val, size_t len, int no_hash, void *udata)
 		val = "";
 	}
 
-	/* If len is small, this object gonna be interned. */
-	if (thread_is_main_thread () && len <= INTERNAL_STR_LENGTH && !no_hash) {
-		obj = (strobject_t *) hash_test (g_internal_hash, (void *) val,
-			strobject_murmur (val, len, g_internal_hash_seed));
-		if (obj != NULL) {
-			return (object_t *) obj;
-		}
+	if (len <= 1 && !no_hash && g_small_str[0] != NULL) {
+		return g_small_str[len == 0? 0: (unsigned char) *val + 1];
 	}
 
-	obj = (strobject_t *) pool_alloc (sizeof (strobject_t));
-	if (obj == NULL) {
-		fatal_error ("out of memory.");
-	}
+	/* Only names and constants of code are interned, they are never
+	 * freed. Strs made at run time come and go. */
+	obj = strobject_alloc ();
+	if (len <= INLINE_LENGTH) {
+		memcpy ((void *) strobject_inline (obj, len)->s, (void *) val, len);
 
-	OBJECT_NEW_INIT (obj, OBJECT_TYPE_STR, udata);
-	OBJECT_DIGEST_FUN (obj) = strobject_digest_fun;
+		return (object_t *) obj;
+	}
 
-	obj->hn = NULL;
-	obj->hashed = 0;
-	obj->str_hash = 0;
 	obj->val = str_new (val, len);
 	if (obj->val == NULL) {
-		pool_free ((void *) obj);
+		pool_freelist_free (FREELIST_STR, (void *) obj);
 
 		return NULL;
 	}
 
-	/* Add to internal hash. */
-	if (thread_is_main_thread () && len <= INTERNAL_STR_LENGTH && !no_hash) {
-		void *hn;
+	return (object_t *) obj;
+}
 
-		hn = hash_add (g_internal_hash, (void *) obj);
-		if (hn == NULL) {
-			object_free ((object_t *) obj);
-			error ("failed to hash interned str object.");
+object_t *
+strobject_str_new (str_t *val, void *udata)
+{
+	strobject_t *obj;
 
-			return NULL;
-		}
+	obj = strobject_alloc ();
+	obj->val = val;
 
-		obj->hn = hn;
-		obj->hashed = 1;
-		object_ref ((object_t *) obj);
+	return (object_t *) obj;
+}
+
+/* Move the interned strs to a table twice as large, the lock is held. */
+static void
+strobject_intern_grow ()
+{
+	object_t **slots;
+	size_t mask;
+
+	mask = (g_intern.mask << 1) | 1;
+	slots = (object_t **) calloc (mask + 1, sizeof (object_t *));
+	if (slots == NULL) {
+		fatal_error ("out of memory.");
 	}
 
-	return (object_t *) obj;
+	for (size_t i = 0; i <= g_intern.mask; i++) {
+		object_t *obj;
+		size_t j;
+
+		obj = g_intern.slots[i];
+		if (obj == NULL) {
+			continue;
+		}
+		j = (size_t) ((strobject_t *) obj)->str_hash & mask;
+		while (slots[j] != NULL) {
+			j = (j + 1) & mask;
+		}
+		slots[j] = obj;
+	}
+
+	free ((void *) g_intern.slots);
+	g_intern.slots = slots;
+	g_intern.mask = mask;
 }
 
-object_t *
-strobject_str_new (str_t *val, void *udata)
+/* The interned str is one malloced block holding the object, its str
+ * and the chars. It is never freed. */
+static object_t *
+strobject_intern_make (const char *val, size_t len, uint64_t hash)
 {
 	strobject_t *obj;
+	str_t *str;
 
-	obj = (strobject_t *) pool_alloc (sizeof (strobject_t));
+	obj = (strobject_t *) malloc (sizeof (strobject_t) + sizeof (str_t) + len + 1);
 	if (obj == NULL) {
 		fatal_error ("out of memory.");
 	}
 
-	OBJECT_NEW_INIT (obj, OBJECT_TYPE_STR, udata);
-	OBJECT_DIGEST_FUN (obj) = strobject_digest_fun;
+	OBJECT_NEW_INIT (obj, OBJECT_TYPE_STR);
 
-	obj->hn = NULL;
-	obj->hashed = 0;
-	obj->str_hash = 0;
-	obj->val = val;
+	str = (str_t *) (obj + 1);
+	str->len = len;
+	memcpy ((void *) str->s, (void *) val, len);
+	str->s[len] = '\0';
+	obj->val = str;
+	obj->buf = NULL;
+	obj->len = 0;
+	obj->builder = 0;
+	obj->interned = 1;
+	obj->str_hash = hash;
+	object_freeze ((object_t *) obj);
 
 	return (object_t *) obj;
 }
 
+/* The one str of this value shared by the whole process, compared with
+ * other interned strs by address. */
+object_t *
+strobject_intern (const char *val, size_t len)
+{
+	uint64_t hash;
+	size_t i;
+	object_t *obj;
+
+	if (val == NULL) {
+		val = "";
+	}
+
+	hash = STR_HASH (val, len, g_internal_hash_seed);
+
+	_thread_mutex_lock (&g_intern.lock);
+	i = (size_t) hash & g_intern.mask;
+	while ((obj = g_intern.slots[i]) != NULL) {
+		str_t *str;
+
+		str = strobject_get_value (obj);
+		if (((strobject_t *) obj)->str_hash == hash && str_len (str) == len &&
+			memcmp ((void *) str_c_str (str), (void *) val, len) == 0) {
+			_thread_mutex_unlock (&g_intern.lock);
+
+			return obj;
+		}
+		i = (i + 1) & g_intern.mask;
+	}
+
+	obj = strobject_intern_make (val, len, hash);
+	g_intern.slots[i] = obj;
+	/* Keep the table at most half full. */
+	if (++g_intern.size > (g_intern.mask >> 1)) {
+		strobject_intern_grow ();
+	}
+	_thread_mutex_unlock (&g_intern.lock);
+
+	return obj;
+}
+
+object_t *
+strobject_intern_obj (object_t *obj)
+{
+	str_t *str;
+
+	if (INTERNED (obj)) {
+		return obj;
+	}
+
+	str = strobject_get_value (obj);
+
+	return strobject_intern (str_c_str (str), str_len (str));
+}
+
 str_t *
 strobject_get_value (object_t *obj)
 {
 	strobject_t *ob;
 
 	ob = (strobject_t *) obj;
+	if (ob->val == NULL) {
+		strobject_flatten (ob);
+	}
 
 	return ob->val;
 }
 
-/* For hash table. */
-static uint64_t
-strobject_hash_fun (void *data)
+/* Length and chars without flattening. */
+static size_t
+strobject_length (object_t *obj)
 {
-	object_t *obj;
-	str_t *str;
-	size_t len;
-	unsigned int seed;
+	strobject_t *ob;
 
-	obj = (object_t *) data;
-	str = strobject_get_value (obj);
-	len = str_len (str);
-	seed = g_internal_hash_seed;
+	ob = (strobject_t *) obj;
 
-	return strobject_murmur (str_c_str (str), len, seed);
+	return ob->val == NULL? ob->len: str_len (ob->val);
 }
 
-static int
-strobject_test_fun (void *value, void *hd)
+static const char *
+strobject_chars (object_t *obj)
+{
+	strobject_t *ob;
+
+	ob = (strobject_t *) obj;
+
+	return ob->val == NULL? str_c_str (ob->buf->str): str_c_str (ob->val);
+}
+
+object_t *
+strobject_builder_new ()
 {
 	object_t *obj;
 
-	obj = (object_t *) value;
+	obj = strobject_buf_obj_new (strobject_buf_new (BUILDER_MIN_LENGTH));
+	((strobject_t *) obj)->builder = BUILDER_NEW;
 
-	return (int) str_cmp_c_str (strobject_get_value (obj),
-		(const char *) hd) == 0;
+	return obj;
 }
 
-static void
-strobject_cleanup_fun (void *value)
+/* Append piece to a str made by strobject_builder_new, in place. */
+int
+strobject_builder_append (object_t *obj, object_t *piece)
+{
+	strobject_t *ob;
+
+	ob = (strobject_t *) obj;
+	if (!ob->builder) {
+		error ("only a strbuf can be appended to.");
+
+		return 0;
+	}
+
+	/* Read since, or the buffer went on without it. */
+	if (!strobject_buf_tail (ob)) {
+		strbuf_t *buf;
+
+		buf = strobject_buf_new (strobject_length (obj) << 1);
+		strobject_buf_append (buf, obj);
+		strobject_op_free (obj);
+		ob->val = NULL;
+		ob->buf = buf;
+		buf->ref++;
+	}
+
+	strobject_buf_append (ob->buf, piece);
+	ob->len = ob->buf->str->len;
+	ob->str_hash = 0;
+	OBJECT_DIGEST (obj) = 0;
+
+	return 1;
+}
+
+/* A strbuf belongs to the variable it is first stored to. Stored
+ * anywhere else, it gives a new str of what it holds so far, so that
+ * appending never changes a str seen through another name. */
+object_t *
+strobject_builder_store (object_t *obj, int to_var)
+{
+	strobject_t *ob;
+
+	ob = (strobject_t *) obj;
+	if (!OBJECT_IS_STR (obj) || !ob->builder) {
+		return obj;
+	}
+	if (to_var && ob->builder == BUILDER_NEW) {
+		ob->builder = BUILDER_BOUND;
+
+		return obj;
+	}
+
+	return strobject_copy (obj);
+}
+
+int
+strobject_is_builder (object_t *obj)
 {
-	object_free (value);
+	return OBJECT_IS_STR (obj) && ((strobject_t *) obj)->builder;
+}
+
+/* The str built so far, the builder starts over empty. */
+object_t *
+strobject_builder_finish (object_t *obj)
+{
+	strobject_t *ob;
+	object_t *res;
+
+	ob = (strobject_t *) obj;
+	if (!ob->builder) {
+		error ("only a strbuf can be finished.");
+
+		return NULL;
+	}
+
+	if (strobject_buf_tail (ob)) {
+		res = strobject_buf_obj_new (ob->buf);
+	}
+	else {
+		res = strobject_copy (obj);
+	}
+
+	strobject_op_free (obj);
+	ob->val = NULL;
+	ob->buf = strobject_buf_new (BUILDER_MIN_LENGTH);
+	ob->buf->ref++;
+	ob->len = 0;
+	ob->str_hash = 0;
+	OBJECT_DIGEST (obj) = 0;
+
+	return res;
 }
 
 uint64_t
 strobject_get_hash (object_t *obj)
 {
-	str_t *str;
 	strobject_t *str_obj;
 
 	str_obj = (strobject_t *) obj;
@@ -527,10 +853,8 @@ strobject_get_hash (object_t *obj)
 		return str_obj->str_hash;
 	}
 
-	str = strobject_get_value (obj);
-
-	str_obj->str_hash = strobject_murmur (str_c_str (str), str_len (str),
-										  g_internal_hash_seed);
+	str_obj->str_hash = STR_HASH (strobject_chars (obj), strobject_length (obj),
+								  g_internal_hash_seed);
 
 	return str_obj->str_hash;
 }
@@ -538,34 +862,110 @@ strobject_get_hash (object_t *obj)
 int
 strobject_equal (object_t *obj1, object_t *obj2)
 {
-	str_t *str1;
-	str_t *str2;
+	size_t len;
 
-	str1 = strobject_get_value (obj1);
-	str2 = strobject_get_value (obj2);
+	if (obj1 == obj2) {
+		return 1;
+	}
+	/* There is only one interned str of each value. */
+	if (INTERNED (obj1) && INTERNED (obj2)) {
+		return 0;
+	}
+
+	len = strobject_length (obj1);
 
-	return str_cmp (str1, str2) == 0;
+	return len == strobject_length (obj2) &&
+		memcmp ((void *) strobject_chars (obj1), (void *) strobject_chars (obj2), len) == 0;
 }
 
-const char *
-strobject_c_str (object_t *obj)
+static int
+strobject_split_push (object_t *vec, const char *s, size_t len)
 {
-	return str_c_str (strobject_get_value (obj));
+	object_t *piece;
+
+	piece = strobject_new (s, len, 1, NULL);
+	if (piece == NULL) {
+		return 0;
+	}
+	if (!vecobject_append (vec, piece)) {
+		object_free (piece);
+
+		return 0;
+	}
+
+	return 1;
 }
 
+/* Split obj by sep into a vec of strs. Without sep it is split by
+ * runs of spaces, which are dropped from both ends. */
 object_t *
-strobject_copy (object_t *obj)
+strobject_split (object_t *obj, object_t *sep)
 {
-	str_t *new_str;
-	const char *c_str;
+	str_t *str;
+	object_t *res;
+	size_t start;
 
-	c_str = strobject_c_str (obj);
-	new_str = str_new (c_str, strlen (c_str));
-	if (new_str == NULL) {
+	str = strobject_get_value (obj);
+	res = vecobject_new (0, NULL);
+	if (res == NULL) {
 		return NULL;
 	}
 
-	return strobject_str_new (new_str, NULL);
+	start = 0;
+	if (sep == NULL) {
+		while ((start = str_scan_space (str, start, 0)) < str_len (str)) {
+			size_t end;
+
+			end = str_scan_space (str, start, 1);
+			if (!strobject_split_push (res, str_c_str (str) + start, end - start)) {
+				object_free (res);
+
+				return NULL;
+			}
+			start = end;
+		}
+	}
+	else {
+		str_t *s;
+		integer_value_t pos;
+
+		s = strobject_get_value (sep);
+		if (str_len (s) == 0) {
+			object_free (res);
+			error ("empty separator.");
+
+			return NULL;
+		}
+		while ((pos = str_find (str, s, start)) != -1) {
+			if (!strobject_split_push (res, str_c_str (str) + start, (size_t) pos - start)) {
+				object_free (res);
+
+				return NULL;
+			}
+			start = (size_t) pos + str_len (s);
+		}
+		if (!strobject_split_push (res, str_c_str (str) + start, str_len (str) - start)) {
+			object_free (res);
+
+			return NULL;
+		}
+	}
+
+	return res;
+}
+
+const char *
+strobject_c_str (object_t *obj)
+{
+	return str_c_str (strobject_get_value (obj));
+}
+
+/* Copies are made for other threads too, often with another allocator
+ * current, so the source is read as it is and never flattened. */
+object_t *
+strobject_copy (object_t *obj)
+{
+	return strobject_new (strobject_chars (obj), strobject_length (obj), 1, NULL);
 }
 
 void
@@ -575,18 +975,28 @@ strobject_init ()
 		return;
 	}
 
-	g_internal_hash = hash_new (INTERNAL_HASH_SIZE,
-								strobject_hash_fun,
-								strobject_test_fun,
-								strobject_cleanup_fun);
-	if (g_internal_hash == NULL) {
-		fatal_error ("failed to init str internal hash.");
+	object_register_opset (OBJECT_TYPE_STR, &g_object_ops);
+
+	g_intern.slots = (object_t **) calloc (INTERN_MIN_SIZE, sizeof (object_t *));
+	if (g_intern.slots == NULL) {
+		fatal_error ("failed to init str intern table.");
 	}
+	g_intern.mask = INTERN_MIN_SIZE - 1;
+	g_intern.size = 0;
+	_thread_mutex_init (&g_intern.lock);
 
 	if (g_internal_hash_seed == 0) {
 		g_internal_hash_seed = random () & ((~(unsigned int) 0));
 	}
 
+	g_small_str[0] = strobject_intern ("", 0);
+	for (int i = 0; i <= UCHAR_MAX; i++) {
+		char c;
+
+		c = (char) i;
+		g_small_str[i + 1] = strobject_intern (&c, 1);
+	}
+
 	/* Make dump head and tail. */
 	g_dump_head = str_new ("<str \"", DUMP_HEAD_LENGTH);
 	if (g_dump_head == NULL) {
@@ -26,12 +26,22 @@
 #include "str.h"
 #include "hash.h"
 
+/* Chars appended by concatenation, shared by the strs made from it. */
+typedef struct strbuf_s
+{
+	str_t *str; /* Always terminated. */
+	size_t cap;
+	int ref;
+} strbuf_t;
+
 typedef struct strobject_s
 {
 	object_head_t head;
-	str_t *val;
-	void *hn; /* For quick dehash. */
-	int hashed;
+	str_t *val; /* NULL until a str made from buf is read. */
+	strbuf_t *buf;
+	size_t len; /* Chars of buf in this str. */
+	int interned;
+	int builder; /* Made by strbuf (), appended in place, never hashed. */
 	uint64_t str_hash;
 } strobject_t;
 
@@ -47,6 +57,27 @@ strobject_new (const char *val, size_t len, int no_hash, void *udata);
 object_t *
 strobject_str_new (str_t *val, void *udata);
 
+object_t *
+strobject_intern (const char *val, size_t len);
+
+object_t *
+strobject_builder_new ();
+
+int
+strobject_builder_append (object_t *obj, object_t *piece);
+
+object_t *
+strobject_builder_finish (object_t *obj);
+
+object_t *
+strobject_builder_store (object_t *obj, int to_var);
+
+int
+strobject_is_builder (object_t *obj);
+
+object_t *
+strobject_intern_obj (object_t *obj);
+
 str_t *
 strobject_get_value (object_t *obj);
 
@@ -56,6 +87,9 @@ strobject_get_hash (object_t *obj);
 int
 strobject_equal (object_t *obj1, object_t *obj2);
 
+object_t *
+strobject_split (object_t *obj, object_t *sep);
+
 const char *
 strobject_c_str (object_t *obj);
 
@@ -24,6 +24,7 @@
 #include "structobject.h"
 #include "pool.h"
 #include "gc.h"
+#include "global.h"
 #include "error.h"
 #include "thread.h"
 #include "compound.h"
@@ -41,7 +42,7 @@ static void structobject_op_free (object_t *obj);
 static void structobject_op_print (object_t *obj);
 static object_t *structobject_op_dump (object_t *obj);
 static object_t *structobject_op_eq (object_t *obj1, object_t *obj2);
-static object_t *structobject_op_hash (object_t *obj);
+static uint64_t structobject_op_hash (object_t *obj);
 static object_t *structobject_op_binary (object_t *obj);
 
 static object_opset_t g_object_ops =
@@ -172,14 +173,10 @@ structobject_op_eq (object_t *obj1, object_t *obj2)
 }
 
 /* Hash. */
-static object_t *
-structobject_op_hash(object_t *obj)
+static uint64_t
+structobject_op_hash (object_t *obj)
 {
-	if (OBJECT_DIGEST (obj) == 0) {
-		OBJECT_DIGEST (obj) = object_address_hash ((void *) obj);
-	}
-
-	return uint64object_new (OBJECT_DIGEST (obj), NULL);
+	return object_address_hash ((void *) obj);
 }
 
 /* Binary. */
@@ -223,12 +220,6 @@ structobject_op_binary (object_t *obj)
 	return temp;
 }
 
-static uint64_t
-structobject_digest_fun (void *obj)
-{
-	return object_address_hash (obj);
-}
-
 object_t *
 structobject_load_binary (object_type_t type, FILE *f)
 {
@@ -264,17 +255,16 @@ structobject_load_binary (object_type_t type, FILE *f)
 		object_ref (obj);
 	}
 
-	struct_obj = (structobject_t *) pool_alloc (sizeof (structobject_t));
+	struct_obj = (structobject_t *) gc_alloc (sizeof (structobject_t));
 	if (struct_obj == NULL) {
 		fatal_error ("out of memory.");
 	}
 
-	OBJECT_NEW_INIT (struct_obj, type, NULL);
-	OBJECT_DIGEST_FUN (struct_obj) = structobject_digest_fun;
+	OBJECT_NEW_INIT (struct_obj, type);
 
 	struct_obj->members = members;
 
-	gc_track ((void *) struct_obj);
+	gc_maybe_track ((void *) struct_obj);
 
 	return (object_t *) struct_obj;
 }
@@ -318,17 +308,16 @@ structobject_load_buf (object_type_t type, const char **buf, size_t *len)
 		object_ref (obj);
 	}
 
-	struct_obj = (structobject_t *) pool_alloc (sizeof (structobject_t));
+	struct_obj = (structobject_t *) gc_alloc (sizeof (structobject_t));
 	if (struct_obj == NULL) {
 		fatal_error ("out of memory.");
 	}
 
-	OBJECT_NEW_INIT (struct_obj, type, NULL);
-	OBJECT_DIGEST_FUN (struct_obj) = structobject_digest_fun;
+	OBJECT_NEW_INIT (struct_obj, type);
 
 	struct_obj->members = members;
 
-	gc_track ((void *) struct_obj);
+	gc_maybe_track ((void *) struct_obj);
 
 	return (object_t *) struct_obj;
 }
@@ -341,17 +330,16 @@ structobject_new (code_t *code, object_type_t type, void *udata)
 	vec_t *members;
 	size_t size;
 
-	obj = (structobject_t *) pool_alloc (sizeof (structobject_t));
+	obj = (structobject_t *) gc_alloc (sizeof (structobject_t));
 	if (obj == NULL) {
 		fatal_error ("out of memory.");
 	}
 
-	OBJECT_NEW_INIT (obj, type, udata);
-	OBJECT_DIGEST_FUN (obj) = structobject_digest_fun;
+	OBJECT_NEW_INIT (obj, type);
 
 	meta = code_get_struct (code, type);
 	if (meta == NULL) {
-		pool_free ((void *) obj);
+		gc_free ((void *) obj);
 		error ("struct meta not found.");
 
 		return NULL;
@@ -375,7 +363,7 @@ structobject_new (code_t *code, object_type_t type, void *udata)
 		object_ref (member);
 	}
 
-	gc_track ((void *) obj);
+	gc_maybe_track ((void *) obj);
 
 	return (object_t *) obj;
 }
@@ -392,7 +380,6 @@ structobject_traverse (object_t *obj, traverse_f fun, void *udata)
 		object_t *field;
 
 		field = (object_t *) vec_pos (members, i);
-		object_traverse (field, fun, udata);
 		if (fun (field, udata) > 0) {
 			object_t *dummy;
 
@@ -460,6 +447,8 @@ structobject_store_member (object_t *obj, object_t *name,
 		}
 	}
 
+	gc_write_barrier ((void *) obj, (void *) value);
+	GLOBAL_WRITE_BARRIER (obj);
 	prev = (object_t *) vec_set (members, pos, (void *) value);
 	object_ref (value);
 	if (prev != NULL) {
@@ -486,14 +475,13 @@ structobject_copy (object_t *obj)
 		return NULL;
 	}
 
-	new_obj = (structobject_t *) pool_alloc (sizeof (structobject_t));
+	new_obj = (structobject_t *) gc_alloc (sizeof (structobject_t));
 	if (new_obj == NULL) {
 		vec_free (new_members);
 		fatal_error ("out of memory.");
 	}
 
-	OBJECT_NEW_INIT (new_obj, OBJECT_TYPE (obj), OBJECT_UDATA (obj));
-	OBJECT_DIGEST_FUN (new_obj) = structobject_digest_fun;
+	OBJECT_NEW_INIT (new_obj, OBJECT_TYPE (obj));
 
 	for (integer_value_t i = 0; i < (integer_value_t) size; i++) {
 		object_t *new_field;
@@ -513,7 +501,7 @@ structobject_copy (object_t *obj)
 
 	new_obj->members = new_members;
 
-	gc_track ((void *) new_obj);
+	gc_maybe_track ((void *) new_obj);
 
 	return (object_t *) new_obj;
 }
@@ -525,6 +513,8 @@ structobject_init ()
 		return;
 	}
 
+	object_register_opset (OBJECT_TYPE_STRUCT, &g_object_ops);
+
 	/* Make dump objects. */
 	g_dump_head = strobject_new ("<struct {", strlen ("<struct {"), 1, NULL);
 	if (g_dump_head == NULL) {
@@ -0,0 +1,609 @@
+/*
+ * sync.c
+ * This file is part of koa
+ *
+ * Copyright (C) 2018 - Gordon Li
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <limits.h>
+#include <stdatomic.h>
+
+#include "sync.h"
+#include "handle.h"
+#include "thread.h"
+#include "error.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_PTHREAD_H
+#include "thread_pthread.h"
+#else
+#endif
+
+/* Rounds of spinning before a lock parks the thread. Most critical
+ * sections in scripts are short, so the owner is likely to be done by
+ * then, spinning is pointless on a single cpu though. */
+#define SYNC_SPIN 100
+
+/* Mutex states. */
+#define MUTEX_FREE 0
+#define MUTEX_LOCKED 1
+#define MUTEX_CONTENDED 2 /* Locked, and someone may be parked. */
+
+/* Rwlock state is the number of readers, or RWLOCK_WRITER. */
+#define RWLOCK_WRITER -1
+
+typedef struct sync_mutex_s
+{
+	_Atomic int state;
+} sync_mutex_t;
+
+typedef struct sync_rwlock_s
+{
+	_Atomic int state;
+	_Atomic int waiters;
+} sync_rwlock_t;
+
+typedef struct sync_cond_s
+{
+	_Atomic int seq; /* Bumped by every signal. */
+	_Atomic int waiters;
+} sync_cond_t;
+
+typedef struct sync_atomic_s
+{
+	object_type_t type;
+	union
+	{
+		_Atomic int i;
+		_Atomic long l;
+	};
+} sync_atomic_t;
+
+static int g_spin = -1;
+
+static int
+sync_spin ()
+{
+	if (g_spin < 0) {
+		g_spin = _thread_cpu_count () > 1? SYNC_SPIN: 0;
+	}
+
+	return g_spin;
+}
+
+static void
+sync_park (_Atomic int *addr, int val)
+{
+	thread_block_begin ();
+	_thread_futex_wait (addr, val);
+	thread_block_end ();
+}
+
+static void *
+sync_find (long id, handle_kind_t kind, const char *name)
+{
+	handle_kind_t found;
+	void *ptr;
+
+	ptr = handle_get (id, &found);
+	if (found != kind) {
+		error ("invalid %s: %ld.", name, id);
+
+		return NULL;
+	}
+
+	return ptr;
+}
+
+static sync_atomic_t *
+sync_find_atomic (long id)
+{
+	handle_kind_t kind;
+	void *ptr;
+
+	ptr = handle_get (id, &kind);
+	if (kind != HANDLE_ATOMIC_INT && kind != HANDLE_ATOMIC_LONG) {
+		error ("invalid atomic: %ld.", id);
+
+		return NULL;
+	}
+
+	return (sync_atomic_t *) ptr;
+}
+
+/* Locks are not pinned by the ops on them, that would cost more than
+ * the ops themselves, so like with pthreads it is up to the script not
+ * to free one that someone else still uses. Only the misuse that can be
+ * seen here is refused. */
+static int
+sync_free (long id, handle_kind_t kind, const char *name, int busy)
+{
+	if (busy) {
+		error ("freeing a %s that is in use.", name);
+
+		return 0;
+	}
+
+	return handle_release (id, kind);
+}
+
+static long
+sync_new (handle_kind_t kind, size_t size)
+{
+	void *ptr;
+	long id;
+
+	ptr = calloc (1, size);
+	if (ptr == NULL) {
+		fatal_error ("out of memory.");
+	}
+
+	id = handle_new (kind, ptr, free);
+	if (id == 0L) {
+		free (ptr);
+	}
+
+	return id;
+}
+
+static void
+mutex_acquire (sync_mutex_t *mutex)
+{
+	int expected;
+	int c;
+
+	expected = MUTEX_FREE;
+	if (atomic_compare_exchange_strong (&mutex->state, &expected, MUTEX_LOCKED)) {
+		return;
+	}
+
+	for (int i = sync_spin (); i > 0; i--) {
+		_thread_cpu_relax ();
+		expected = MUTEX_FREE;
+		if (atomic_load_explicit (&mutex->state, memory_order_relaxed) == MUTEX_FREE
+			&& atomic_compare_exchange_weak (&mutex->state, &expected, MUTEX_LOCKED)) {
+			return;
+		}
+	}
+
+	/* Once contended, the lock stays marked as such until released, so
+	 * the owner knows someone has to be woken up. */
+	c = atomic_exchange (&mutex->state, MUTEX_CONTENDED);
+	while (c != MUTEX_FREE) {
+		sync_park (&mutex->state, MUTEX_CONTENDED);
+		c = atomic_exchange (&mutex->state, MUTEX_CONTENDED);
+	}
+}
+
+static int
+mutex_release (sync_mutex_t *mutex)
+{
+	int c;
+
+	c = atomic_exchange (&mutex->state, MUTEX_FREE);
+	if (c == MUTEX_FREE) {
+		error ("unlocking a mutex that is not locked.");
+
+		return 0;
+	}
+	if (c == MUTEX_CONTENDED) {
+		_thread_futex_wake (&mutex->state, 1);
+	}
+
+	return 1;
+}
+
+long
+sync_mutex_new ()
+{
+	return sync_new (HANDLE_MUTEX, sizeof (sync_mutex_t));
+}
+
+int
+sync_mutex_lock (long id)
+{
+	sync_mutex_t *mutex;
+
+	mutex = (sync_mutex_t *) sync_find (id, HANDLE_MUTEX, "mutex");
+	if (mutex == NULL) {
+		return 0;
+	}
+
+	mutex_acquire (mutex);
+
+	return 1;
+}
+
+int
+sync_mutex_trylock (long id, bool *locked)
+{
+	sync_mutex_t *mutex;
+	int expected;
+
+	mutex = (sync_mutex_t *) sync_find (id, HANDLE_MUTEX, "mutex");
+	if (mutex == NULL) {
+		return 0;
+	}
+
+	expected = MUTEX_FREE;
+	*locked = atomic_compare_exchange_strong (&mutex->state, &expected, MUTEX_LOCKED);
+
+	return 1;
+}
+
+int
+sync_mutex_unlock (long id)
+{
+	sync_mutex_t *mutex;
+
+	mutex = (sync_mutex_t *) sync_find (id, HANDLE_MUTEX, "mutex");
+	if (mutex == NULL) {
+		return 0;
+	}
+
+	return mutex_release (mutex);
+}
+
+int
+sync_mutex_free (long id)
+{
+	sync_mutex_t *mutex;
+
+	mutex = (sync_mutex_t *) sync_find (id, HANDLE_MUTEX, "mutex");
+	if (mutex == NULL) {
+		return 0;
+	}
+
+	return sync_free (id, HANDLE_MUTEX, "mutex",
+					  atomic_load (&mutex->state) != MUTEX_FREE);
+}
+
+long
+sync_rwlock_new ()
+{
+	return sync_new (HANDLE_RWLOCK, sizeof (sync_rwlock_t));
+}
+
+/* Readers and writers park on the state itself, waiters tells unlockers
+ * whether a wakeup is needed at all. */
+static void
+rwlock_wait (sync_rwlock_t *rwlock, int state)
+{
+	atomic_fetch_add (&rwlock->waiters, 1);
+	sync_park (&rwlock->state, state);
+	atomic_fetch_sub (&rwlock->waiters, 1);
+}
+
+int
+sync_rwlock_rdlock (long id)
+{
+	sync_rwlock_t *rwlock;
+	int spin;
+	int s;
+
+	rwlock = (sync_rwlock_t *) sync_find (id, HANDLE_RWLOCK, "rwlock");
+	if (rwlock == NULL) {
+		return 0;
+	}
+
+	spin = sync_spin ();
+	s = atomic_load (&rwlock->state);
+	for (;;) {
+		if (s != RWLOCK_WRITER) {
+			if (atomic_compare_exchange_weak (&rwlock->state, &s, s + 1)) {
+				return 1;
+			}
+			continue;
+		}
+		if (spin > 0) {
+			spin--;
+			_thread_cpu_relax ();
+		}
+		else {
+			rwlock_wait (rwlock, s);
+		}
+		s = atomic_load (&rwlock->state);
+	}
+}
+
+int
+sync_rwlock_wrlock (long id)
+{
+	sync_rwlock_t *rwlock;
+	int spin;
+	int s;
+
+	rwlock = (sync_rwlock_t *) sync_find (id, HANDLE_RWLOCK, "rwlock");
+	if (rwlock == NULL) {
+		return 0;
+	}
+
+	spin = sync_spin ();
+	for (;;) {
+		s = 0;
+		if (atomic_compare_exchange_weak (&rwlock->state, &s, RWLOCK_WRITER)) {
+			return 1;
+		}
+		if (s == 0) {
+			continue;
+		}
+		if (spin > 0) {
+			spin--;
+			_thread_cpu_relax ();
+		}
+		else {
+			rwlock_wait (rwlock, s);
+		}
+	}
+}
+
+int
+sync_rwlock_unlock (long id)
+{
+	sync_rwlock_t *rwlock;
+	int s;
+
+	rwlock = (sync_rwlock_t *) sync_find (id, HANDLE_RWLOCK, "rwlock");
+	if (rwlock == NULL) {
+		return 0;
+	}
+
+	s = atomic_load (&rwlock->state);
+	for (;;) {
+		if (s == 0) {
+			error ("unlocking a rwlock that is not locked.");
+
+			return 0;
+		}
+		if (atomic_compare_exchange_weak (&rwlock->state, &s,
+										  s == RWLOCK_WRITER? 0: s - 1)) {
+			break;
+		}
+	}
+
+	/* Only a free lock can let anyone else in. */
+	if ((s == RWLOCK_WRITER || s == 1) && atomic_load (&rwlock->waiters) > 0) {
+		_thread_futex_wake (&rwlock->state, INT_MAX);
+	}
+
+	return 1;
+}
+
+int
+sync_rwlock_free (long id)
+{
+	sync_rwlock_t *rwlock;
+
+	rwlock = (sync_rwlock_t *) sync_find (id, HANDLE_RWLOCK, "rwlock");
+	if (rwlock == NULL) {
+		return 0;
+	}
+
+	return sync_free (id, HANDLE_RWLOCK, "rwlock",
+					  atomic_load (&rwlock->state) != 0 || atomic_load (&rwlock->waiters) > 0);
+}
+
+long
+sync_cond_new ()
+{
+	return sync_new (HANDLE_COND, sizeof (sync_cond_t));
+}
+
+int
+sync_cond_wait (long id, long mutex_id)
+{
+	sync_cond_t *cond;
+	sync_mutex_t *mutex;
+	int seq;
+
+	cond = (sync_cond_t *) sync_find (id, HANDLE_COND, "cond");
+	if (cond == NULL) {
+		return 0;
+	}
+	mutex = (sync_mutex_t *) sync_find (mutex_id, HANDLE_MUTEX, "mutex");
+	if (mutex == NULL) {
+		return 0;
+	}
+
+	/* A signal sent after the mutex is released changes seq, so the
+	 * wait returns at once instead of missing it. Wakeups may be
+	 * spurious, callers check their condition in a loop. */
+	seq = atomic_load (&cond->seq);
+	if (!mutex_release (mutex)) {
+		return 0;
+	}
+	atomic_fetch_add (&cond->waiters, 1);
+	sync_park (&cond->seq, seq);
+	atomic_fetch_sub (&cond->waiters, 1);
+	mutex_acquire (mutex);
+
+	return 1;
+}
+
+int
+sync_cond_signal (long id)
+{
+	sync_cond_t *cond;
+
+	cond = (sync_cond_t *) sync_find (id, HANDLE_COND, "cond");
+	if (cond == NULL) {
+		return 0;
+	}
+
+	atomic_fetch_add (&cond->seq, 1);
+	_thread_futex_wake (&cond->seq, 1);
+
+	return 1;
+}
+
+int
+sync_cond_broadcast (long id)
+{
+	sync_cond_t *cond;
+
+	cond = (sync_cond_t *) sync_find (id, HANDLE_COND, "cond");
+	if (cond == NULL) {
+		return 0;
+	}
+
+	atomic_fetch_add (&cond->seq, 1);
+	_thread_futex_wake (&cond->seq, INT_MAX);
+
+	return 1;
+}
+
+int
+sync_cond_free (long id)
+{
+	sync_cond_t *cond;
+
+	cond = (sync_cond_t *) sync_find (id, HANDLE_COND, "cond");
+	if (cond == NULL) {
+		return 0;
+	}
+
+	return sync_free (id, HANDLE_COND, "cond", atomic_load (&cond->waiters) > 0);
+}
+
+long
+sync_atomic_new (object_type_t type, integer_value_t val)
+{
+	sync_atomic_t *atom;
+	long id;
+
+	id = sync_new (type == OBJECT_TYPE_INT? HANDLE_ATOMIC_INT: HANDLE_ATOMIC_LONG,
+				   sizeof (sync_atomic_t));
+	if (id == 0L) {
+		return 0L;
+	}
+
+	atom = sync_find_atomic (id);
+	atom->type = type;
+	if (type == OBJECT_TYPE_INT) {
+		atomic_store (&atom->i, (int) val);
+	}
+	else {
+		atomic_store (&atom->l, (long) val);
+	}
+
+	return id;
+}
+
+object_t *
+sync_atomic_load (long id)
+{
+	sync_atomic_t *atom;
+
+	atom = sync_find_atomic (id);
+	if (atom == NULL) {
+		return NULL;
+	}
+
+	if (atom->type == OBJECT_TYPE_INT) {
+		return object_new_integer (atomic_load (&atom->i), OBJECT_TYPE_INT);
+	}
+
+	return object_new_integer (atomic_load (&atom->l), OBJECT_TYPE_LONG);
+}
+
+int
+sync_atomic_store (long id, integer_value_t val)
+{
+	sync_atomic_t *atom;
+
+	atom = sync_find_atomic (id);
+	if (atom == NULL) {
+		return 0;
+	}
+
+	if (atom->type == OBJECT_TYPE_INT) {
+		atomic_store (&atom->i, (int) val);
+	}
+	else {
+		atomic_store (&atom->l, (long) val);
+	}
+
+	return 1;
+}
+
+object_t *
+sync_atomic_add (long id, integer_value_t delta)
+{
+	sync_atomic_t *atom;
+
+	atom = sync_find_atomic (id);
+	if (atom == NULL) {
+		return NULL;
+	}
+
+	/* Gives the new value, like += would. Overflow wraps around. */
+	if (atom->type == OBJECT_TYPE_INT) {
+		unsigned int old;
+
+		old = (unsigned int) atomic_fetch_add (&atom->i, (int) delta);
+
+		return object_new_integer ((int) (old + (unsigned int) delta), OBJECT_TYPE_INT);
+	}
+	else {
+		unsigned long old;
+
+		old = (unsigned long) atomic_fetch_add (&atom->l, (long) delta);
+
+		return object_new_integer ((long) (old + (unsigned long) delta), OBJECT_TYPE_LONG);
+	}
+}
+
+int
+sync_atomic_cas (long id, integer_value_t expected, integer_value_t desired, bool *swapped)
+{
+	sync_atomic_t *atom;
+
+	atom = sync_find_atomic (id);
+	if (atom == NULL) {
+		return 0;
+	}
+
+	if (atom->type == OBJECT_TYPE_INT) {
+		int e = (int) expected;
+
+		*swapped = atomic_compare_exchange_strong (&atom->i, &e, (int) desired);
+	}
+	else {
+		long e = (long) expected;
+
+		*swapped = atomic_compare_exchange_strong (&atom->l, &e, (long) desired);
+	}
+
+	return 1;
+}
+
+int
+sync_atomic_free (long id)
+{
+	sync_atomic_t *atom;
+
+	atom = sync_find_atomic (id);
+	if (atom == NULL) {
+		return 0;
+	}
+
+	return sync_free (id, atom->type == OBJECT_TYPE_INT? HANDLE_ATOMIC_INT: HANDLE_ATOMIC_LONG,
+					  "atomic", 0);
+}
@@ -0,0 +1,92 @@
+/*
+ * sync.h
+ * This file is part of koa
+ *
+ * Copyright (C) 2018 - Gordon Li
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SYNC_H
+#define SYNC_H
+
+#include <stdbool.h>
+
+#include "koa.h"
+#include "object.h"
+
+long
+sync_mutex_new ();
+
+int
+sync_mutex_lock (long id);
+
+int
+sync_mutex_trylock (long id, bool *locked);
+
+int
+sync_mutex_unlock (long id);
+
+int
+sync_mutex_free (long id);
+
+long
+sync_rwlock_new ();
+
+int
+sync_rwlock_rdlock (long id);
+
+int
+sync_rwlock_wrlock (long id);
+
+int
+sync_rwlock_unlock (long id);
+
+int
+sync_rwlock_free (long id);
+
+long
+sync_cond_new ();
+
+int
+sync_cond_wait (long id, long mutex);
+
+int
+sync_cond_signal (long id);
+
+int
+sync_cond_broadcast (long id);
+
+int
+sync_cond_free (long id);
+
+long
+sync_atomic_new (object_type_t type, integer_value_t val);
+
+object_t *
+sync_atomic_load (long id);
+
+int
+sync_atomic_store (long id, integer_value_t val);
+
+object_t *
+sync_atomic_add (long id, integer_value_t delta);
+
+int
+sync_atomic_cas (long id, integer_value_t expected, integer_value_t desired, bool *swapped);
+
+int
+sync_atomic_free (long id);
+
+#endif /* SYNC_H */
@@ -20,6 +20,8 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <stdatomic.h>
+#include <time.h>
 
 #include "thread.h"
 #include "pool.h"
@@ -27,16 +29,18 @@
 #include "dict.h"
 #include "object.h"
 #include "intobject.h"
+#include "longobject.h"
 #include "ulongobject.h"
 #include "uint64object.h"
 #include "strobject.h"
 #include "vecobject.h"
+#include "nullobject.h"
 #include "dictobject.h"
 #include "interpreter.h"
 #include "error.h"
 #include "gc.h"
 #include "builtin.h"
-
+#include "global.h"
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
@@ -47,82 +51,549 @@
 #else
 #endif
 
+#define MAX_POOL_SIZE 64
+
+#define CHUNK_TIME 200000L /* Nanoseconds a chunk of parallel work should take. */
+
+typedef enum thread_state_e
+{
+	THREAD_STATE_QUEUED, /* Waiting for a worker. */
+	THREAD_STATE_RUNNING,
+	THREAD_STATE_DONE /* The heap is left for the joining thread. */
+} thread_state_t;
+
+typedef enum parallel_kind_e
+{
+	PARALLEL_MAP,
+	PARALLEL_FOR,
+	PARALLEL_REDUCE
+} parallel_kind_t;
+
+/* A loop shared by a number of tasks, which claim chunks of it until
+ * it runs out. */
+typedef struct parallel_job_s
+{
+	parallel_kind_t kind;
+	code_t *code;
+	vec_t *items; /* Only read, the caller is blocked meanwhile. */
+	integer_value_t start; /* The first index of pfor. */
+	size_t size;
+	object_t *init; /* If set, the whole reduction is a single chunk starting from it. */
+	object_t **results; /* Left in the heaps of tasks. */
+	int tasks;
+	_Atomic size_t next;
+	_Atomic long item_cost; /* Average nanoseconds per item. */
+	_Atomic int failed;
+} parallel_job_t;
+
 typedef struct thread_context_s
 {
+	list_t link; /* In the queue of a worker. */
 	code_t *code;
 	object_t *args;
-	char *ret_binary;
-	size_t ret_len;
-	dict_t *main_global;
+	object_t *ret;
+	list_t tracked; /* Containers tracked by the child when it exits. */
+	global_snapshot_t *globals;
 	allocator_t *allocator;
-	_Atomic char done;
+	long th; /* The dedicated thread, 0 if run by the pool. */
+	thread_state_t state;
+	int detached; /* Nobody will join, clean up on exit. */
+	int cancelled;
+	parallel_job_t *job; /* Run chunks of it instead of code. */
 } thread_context_t;
 
+typedef struct worker_s
+{
+	_thread_mutex_t lock;
+	list_t tasks; /* Taken from the front by the owner, stolen from the back. */
+} worker_t;
+
+/* Tasks created by the main thread are run by a fixed set of workers,
+ * so they don't pay for a thread and its setup each. */
+typedef struct thread_pool_s
+{
+	worker_t *workers; /* MAX_POOL_SIZE slots, the first size are running. */
+	_Atomic int size;
+	long pending; /* Tasks in all queues. */
+	int idle; /* Workers waiting for tasks. */
+	int blocked; /* Workers blocked in the middle of a task. */
+	_thread_mutex_t lock; /* Also guards the state of all contexts. */
+	_thread_cond_t work_cond;
+	_thread_cond_t done_cond;
+	_Atomic unsigned int next;
+} thread_pool_t;
+
 static __thread object_t *g_thread_context; /* Store all child thread context, long->uint64. */
 
 static __thread int g_is_main_thread;
 
+static __thread worker_t *g_worker; /* Set if this is a worker of the pool. */
+
 static int g_thread_init_done;
 
+static thread_pool_t g_pool;
+
+static _Atomic long g_thread_id;
+
+static void
+thread_release_heap (thread_context_t *context)
+{
+	pool_free_all_allocator (context->allocator);
+	pool_allocator_free (context->allocator);
+	context->allocator = NULL;
+}
+
+static object_t *
+thread_own_result (object_t *ret_value)
+{
+	/* Frozen constants can be used anywhere, others belong to us. */
+	if (OBJECT_CONST (ret_value) && !OBJECT_FROZEN (ret_value)) {
+		ret_value = object_copy (ret_value);
+		if (ret_value != NULL) {
+			object_ref (ret_value);
+		}
+	}
+
+	return ret_value;
+}
+
+static object_t *
+thread_job_arg (object_t *obj)
+{
+	if (OBJECT_IS_NULL (obj)) {
+		return nullobject_new (NULL);
+	}
+
+	return object_copy (obj);
+}
+
+/* Call the code of job with args, which are in reverse order, and
+ * leave the result in our heap. */
+static object_t *
+thread_job_call (parallel_job_t *job, dict_t *global, object_t **args, size_t n)
+{
+	object_t *args_obj;
+	object_t *ret_value;
+	vec_t *v;
+
+	args_obj = vecobject_new (n, NULL);
+	if (args_obj == NULL) {
+		for (size_t i = 0; i < n; i++) {
+			object_unref (args[i]);
+		}
+
+		return NULL;
+	}
+
+	v = vecobject_get_value (args_obj);
+	for (size_t i = 0; i < n; i++) {
+		/* Refs of args are moved into the vec. */
+		object_unref (vec_set (v, (integer_value_t) i, (void *) args[i]));
+	}
+
+	ret_value = NULL;
+	interpreter_execute_thread (job->code, args_obj, global, &ret_value);
+	if (ret_value == NULL) {
+		return NULL;
+	}
+
+	return thread_own_result (ret_value);
+}
+
+static int
+thread_job_run_chunk (parallel_job_t *job, dict_t *global, size_t begin, size_t end)
+{
+	object_t *args[2];
+	object_t *acc;
+	size_t first;
+
+	switch (job->kind) {
+		case PARALLEL_MAP:
+			for (size_t i = begin; i < end; i++) {
+				args[0] = thread_job_arg ((object_t *) vec_pos (job->items, (integer_value_t) i));
+				if (args[0] == NULL) {
+					return 0;
+				}
+				object_ref (args[0]);
+				job->results[i] = thread_job_call (job, global, args, 1);
+				if (job->results[i] == NULL) {
+					return 0;
+				}
+			}
+			break;
+		case PARALLEL_FOR:
+			for (size_t i = begin; i < end; i++) {
+				object_t *ret_value;
+
+				args[0] = longobject_new (job->start + (integer_value_t) i, NULL);
+				object_ref (args[0]);
+				ret_value = thread_job_call (job, global, args, 1);
+				if (ret_value == NULL) {
+					return 0;
+				}
+				object_unref (ret_value);
+			}
+			break;
+		case PARALLEL_REDUCE:
+			/* Without an init, a chunk starts from its first item, and
+			 * partial results are folded later. */
+			first = begin;
+			if (job->init != NULL) {
+				acc = thread_job_arg (job->init);
+			}
+			else {
+				acc = thread_job_arg ((object_t *) vec_pos (job->items, (integer_value_t) begin++));
+			}
+			if (acc == NULL) {
+				return 0;
+			}
+			object_ref (acc);
+			for (size_t i = begin; i < end; i++) {
+				args[0] = thread_job_arg ((object_t *) vec_pos (job->items, (integer_value_t) i));
+				if (args[0] == NULL) {
+					object_unref (acc);
+
+					return 0;
+				}
+				object_ref (args[0]);
+				args[1] = acc;
+				/* The vec takes over our ref, hold the acc till it returns. */
+				object_ref (acc);
+				acc = thread_job_call (job, global, args, 2);
+				object_unref (args[1]);
+				if (acc == NULL) {
+					return 0;
+				}
+			}
+			job->results[first] = acc;
+			break;
+		default:
+			break;
+	}
+
+	return 1;
+}
+
+static size_t
+thread_job_chunk (parallel_job_t *job)
+{
+	size_t left;
+	size_t chunk;
+	long cost;
+
+	if (job->init != NULL) {
+		return job->size;
+	}
+
+	/* The first chunks are single items, to learn what one costs. */
+	cost = atomic_load (&job->item_cost);
+	if (cost <= 0) {
+		return 1;
+	}
+
+	chunk = (size_t) (CHUNK_TIME / cost);
+	left = job->size - atomic_load (&job->next);
+	/* Keep enough chunks for the others towards the end. */
+	if (chunk > left / (size_t) (2 * job->tasks)) {
+		chunk = left / (size_t) (2 * job->tasks);
+	}
+
+	return chunk > 0? chunk: 1;
+}
+
+static void
+thread_job_run (parallel_job_t *job, dict_t *global)
+{
+	for (;;) {
+		struct timespec start;
+		struct timespec now;
+		size_t chunk;
+		size_t begin;
+		size_t end;
+		long cost;
+		long prev;
+
+		chunk = thread_job_chunk (job);
+		begin = atomic_fetch_add (&job->next, chunk);
+		if (begin >= job->size || atomic_load (&job->failed)) {
+			break;
+		}
+		end = begin + chunk < job->size? begin + chunk: job->size;
+
+		clock_gettime (CLOCK_MONOTONIC, &start);
+		if (!thread_job_run_chunk (job, global, begin, end)) {
+			atomic_store (&job->failed, 1);
+			break;
+		}
+		clock_gettime (CLOCK_MONOTONIC, &now);
+
+		cost = ((now.tv_sec - start.tv_sec) * 1000000000L +
+				(now.tv_nsec - start.tv_nsec)) / (long) (end - begin);
+		if (cost <= 0) {
+			cost = 1;
+		}
+		prev = atomic_load (&job->item_cost);
+		atomic_store (&job->item_cost, prev > 0? (prev * 3 + cost) / 4: cost);
+	}
+}
+
+static void
+thread_run (thread_context_t *context)
+{
+	object_t *ret_value;
+	dict_t *global;
+	int cancelled;
+	int detached;
+
+	/* Made on the first child, most tasks have none. */
+	g_thread_context = NULL;
+	global = global_thread_enter (context->globals);
+
+	_thread_mutex_lock (&g_pool.lock);
+	cancelled = context->cancelled;
+	context->state = THREAD_STATE_RUNNING;
+	_thread_mutex_unlock (&g_pool.lock);
+
+	ret_value = NULL;
+	if (!cancelled && context->job != NULL) {
+		thread_job_run (context->job, global);
+	}
+	else if (!cancelled) {
+		interpreter_execute_thread (context->code, context->args, global, &ret_value);
+		if (ret_value != NULL) {
+			ret_value = thread_own_result (ret_value);
+		}
+	}
+
+	if (g_thread_context != NULL) {
+		object_free (g_thread_context);
+	}
+	global_thread_leave ();
+	global_snapshot_release (context->globals);
+
+	/* Instead of dumping the returned object, leave the whole heap to
+	 * the joining thread, which adopts it as is. */
+	context->ret = ret_value;
+	gc_handoff (&context->tracked);
+	if (ret_value == NULL && context->job == NULL) {
+		thread_release_heap (context);
+	}
+
+	_thread_mutex_lock (&g_pool.lock);
+	context->state = THREAD_STATE_DONE;
+	detached = context->detached;
+	_thread_cond_broadcast (&g_pool.done_cond);
+	_thread_mutex_unlock (&g_pool.lock);
+
+	if (detached) {
+		if (context->allocator != NULL) {
+			thread_release_heap (context);
+		}
+		free ((void *) context);
+	}
+}
+
 static void *
 thread_func (void *arg)
 {
 	thread_context_t *context;
-	object_t *ret_value;
-	object_t *ret_binary;
-	str_t *ret_str;
 
 	context = (thread_context_t *) arg;
 	pool_set_allocator (context->allocator);
-
-	/* Init gc. */
 	gc_init ();
-	/* Init builtin. */
 	builtin_init ();
 
-	g_thread_context = dictobject_new (NULL);
+	thread_run (context);
+
+	return NULL;
+}
+
+static thread_context_t *
+thread_pool_take (worker_t *worker)
+{
+	thread_context_t *context;
+	int index;
+	int size;
+
+	context = NULL;
+	index = (int) (worker - g_pool.workers);
+	size = atomic_load (&g_pool.size);
+	for (int i = 0; i < size && context == NULL; i++) {
+		worker_t *victim;
 
-	interpreter_execute_thread (context->code, context->args, context->main_global, &ret_value);
+		victim = &g_pool.workers[(index + i) % size];
+		_thread_mutex_lock (&victim->lock);
+		if (!LIST_IS_SINGLE (&victim->tasks)) {
+			list_t *l;
 
-	/* Dump the returned object to binary. */
-	ret_binary = NULL;
-	if (ret_value != NULL) {
-		ret_binary = object_binary (ret_value);
+			l = i == 0? LIST_NEXT (&victim->tasks): LIST_PREV (&victim->tasks);
+			UNUSED (list_remove (NULL, l));
+			context = (thread_context_t *) l;
+		}
+		_thread_mutex_unlock (&victim->lock);
 	}
-	if (ret_binary != NULL) {
-		ret_str = strobject_get_value (ret_binary);
-		context->ret_len = str_len (ret_str);
-		context->ret_binary = (char *) malloc (context->ret_len);
-		if (context->ret_binary == NULL) {
-			fatal_error ("out of memory.");
+
+	if (context != NULL) {
+		_thread_mutex_lock (&g_pool.lock);
+		g_pool.pending--;
+		_thread_mutex_unlock (&g_pool.lock);
+	}
+
+	return context;
+}
+
+static void *
+thread_worker_func (void *arg)
+{
+	worker_t *worker;
+
+	worker = (worker_t *) arg;
+	g_worker = worker;
+	/* Once per worker, gc_handoff leaves the gc clean after each task. */
+	gc_init ();
+	builtin_init ();
+	for (;;) {
+		thread_context_t *context;
+
+		context = thread_pool_take (worker);
+		if (context == NULL) {
+			_thread_mutex_lock (&g_pool.lock);
+			g_pool.idle++;
+			while (g_pool.pending <= 0) {
+				_thread_cond_wait (&g_pool.work_cond, &g_pool.lock);
+			}
+			g_pool.idle--;
+			_thread_mutex_unlock (&g_pool.lock);
+
+			continue;
 		}
-		memcpy (context->ret_binary, str_c_str (ret_str), context->ret_len);
-		object_free (ret_binary);
-		object_unref (ret_value);
+
+		/* Each task brings its own heap. */
+		pool_reset_allocator (context->allocator);
+		thread_run (context);
 	}
 
-	object_free (g_thread_context);
+	return NULL;
+}
 
-	pool_free_all ();
+/* Should be called with the pool lock held, or before the pool is shared. */
+static int
+thread_pool_grow ()
+{
+	worker_t *worker;
+	long th;
+	int size;
 
-	pool_allocator_free (context->allocator);
-	context->allocator = NULL;
+	size = atomic_load (&g_pool.size);
+	if (size >= MAX_POOL_SIZE) {
+		return 0;
+	}
+
+	worker = &g_pool.workers[size];
+	_thread_mutex_init (&worker->lock);
+	LIST_SET_SINGLE (&worker->tasks);
+	th = _thread_create (thread_worker_func, (void *) worker);
+	if (th == 0) {
+		return 0;
+	}
+	UNUSED (_thread_detach (th));
+
+	/* Thieves may look into the new queue from now on. */
+	atomic_store (&g_pool.size, size + 1);
+
+	return 1;
+}
+
+static int
+thread_pool_start ()
+{
+	int size;
+
+	size = g_pool.size > 0? g_pool.size: _thread_cpu_count ();
+	if (size > MAX_POOL_SIZE) {
+		size = MAX_POOL_SIZE;
+	}
+	if (size < 1) {
+		size = 1;
+	}
+
+	g_pool.workers = (worker_t *) calloc (MAX_POOL_SIZE, sizeof (worker_t));
+	if (g_pool.workers == NULL) {
+		fatal_error ("out of memory.");
+	}
+
+	g_pool.size = 0;
+	_thread_mutex_lock (&g_pool.lock);
+	for (int i = 0; i < size; i++) {
+		if (!thread_pool_grow ()) {
+			_thread_mutex_unlock (&g_pool.lock);
+			error ("failed to start thread pool.");
+
+			return 0;
+		}
+	}
+	_thread_mutex_unlock (&g_pool.lock);
+
+	return 1;
+}
+
+static void
+thread_pool_submit (thread_context_t *context)
+{
+	worker_t *worker;
 
-	context->done = 1;
+	worker = &g_pool.workers[g_pool.next++ % (unsigned int) atomic_load (&g_pool.size)];
+	_thread_mutex_lock (&worker->lock);
+	UNUSED (list_append (&worker->tasks, LIST (context)));
+	_thread_mutex_unlock (&worker->lock);
 
-	return (void *) context;
+	_thread_mutex_lock (&g_pool.lock);
+	g_pool.pending++;
+	if (g_pool.idle == 0 && g_pool.blocked > 0) {
+		UNUSED (thread_pool_grow ());
+	}
+	_thread_cond_signal (&g_pool.work_cond);
+	_thread_mutex_unlock (&g_pool.lock);
 }
 
 static int
 thread_gc_untrack_fun (object_t *obj, void *data)
 {
-	if (CONTAINER_TYPE (obj)) {
+	/* Traversing is shallow, so walk down by hand. */
+	if (gc_is_tracked ((void *) obj)) {
 		gc_untrack ((void *) obj);
+		object_traverse (obj, thread_gc_untrack_fun, data);
 	}
 
 	return 0;
 }
 
+static thread_context_t *
+thread_find_context (long th, object_t **th_obj)
+{
+	object_t *context_obj;
+
+	*th_obj = ulongobject_new (th, NULL);
+	context_obj = g_thread_context != NULL? object_index (g_thread_context, *th_obj): NULL;
+	/* A missing key gives null. */
+	if (context_obj == NULL || OBJECT_TYPE (context_obj) != OBJECT_TYPE_UINT64) {
+		error ("the target thread is not a direct child: %ld.", th);
+		object_free (*th_obj);
+
+		return NULL;
+	}
+
+	return (thread_context_t *) uint64object_get_value (context_obj);
+}
+
+static void
+thread_forget_context (object_t *th_obj)
+{
+	object_ref (th_obj);
+	UNUSED (dictobject_remove (g_thread_context, th_obj));
+	object_unref (th_obj);
+}
+
 long
 thread_create (code_t *code, object_t *args)
 {
@@ -143,7 +614,6 @@ thread_create (code_t *code, object_t *args)
 	}
 
 	context->code = code;
-	context->main_global = interpreter_get_main_global ();
 	/* Make a new allocator, it is passed to the child thread. */
 	context->allocator = pool_make_new_allocator ();
 	if (context->allocator == NULL) {
@@ -173,20 +643,36 @@ thread_create (code_t *code, object_t *args)
 	/* Recover allocator. */
 	pool_set_second_allocator (NULL);
 
-	/* Spawn child thread and store context. */
-	th = _thread_create (thread_func, (void *) context);
-	if (th == 0) {
-		free ((void *) context->allocator);
-		free ((void *) context);
+	context->globals = global_snapshot_acquire ();
 
-		return 0L;
+	/* Workers may block in joining their own children, which could starve
+	 * the pool, so only the main thread submits to it. */
+	if (thread_is_main_thread () &&
+		(g_pool.workers != NULL || thread_pool_start ())) {
+		context->state = THREAD_STATE_QUEUED;
+		thread_pool_submit (context);
+	}
+	else {
+		context->state = THREAD_STATE_RUNNING;
+		context->th = _thread_create (thread_func, (void *) context);
+		if (context->th == 0) {
+			global_snapshot_release (context->globals);
+			thread_release_heap (context);
+			free ((void *) context);
+
+			return 0L;
+		}
 	}
+
+	/* Handles are not reused, unlike thread ids. */
+	th = ++g_thread_id;
 	th_obj = ulongobject_new (th, NULL);
 	context_obj = uint64object_new ((uint64_t) context, NULL);
+	if (g_thread_context == NULL) {
+		g_thread_context = dictobject_new (NULL);
+	}
 	UNUSED (object_ipindex (g_thread_context, th_obj, context_obj));
 
-	context->done = 0;
-
 	return th;
 }
 
@@ -194,54 +680,201 @@ object_t *
 thread_join (long th)
 {
 	object_t *th_obj;
-	object_t *context_obj;
 	object_t *return_obj;
 	thread_context_t *context;
-	int status;
-
-	th_obj = ulongobject_new (th, NULL);
-	context_obj = object_index (g_thread_context, th_obj);
-	if (context_obj == NULL) {
-		error ("the target thread is not a direct child: %ld.", th);
 
+	context = thread_find_context (th, &th_obj);
+	if (context == NULL) {
 		return NULL;
 	}
 
 	/* Wait for child thread to exit. */
-	status = _thread_join (th);
-	if (status != 0) {
-		error ("failed to join child: %ld.", th);
-		object_free (th_obj);
+	if (context->th != 0) {
+		if (_thread_join (context->th) != 0) {
+			error ("failed to join child: %ld.", th);
+			object_free (th_obj);
 
-		return NULL;
+			return NULL;
+		}
+	}
+	else {
+		_thread_mutex_lock (&g_pool.lock);
+		while (context->state != THREAD_STATE_DONE) {
+			_thread_cond_wait (&g_pool.done_cond, &g_pool.lock);
+		}
+		_thread_mutex_unlock (&g_pool.lock);
 	}
 
 	return_obj = NULL;
-	context = (thread_context_t *) uint64object_get_value (context_obj);
-	if (context->ret_binary != NULL) {
-		const char *buf;
-		size_t len;
+	if (context->ret != NULL) {
+		pool_adopt_allocator (context->allocator);
+		context->allocator = NULL;
+		gc_adopt (&context->tracked);
 
-		buf = context->ret_binary;
-		len = context->ret_len;
-		return_obj = object_load_buf (&buf, &len);
-		free ((void *) context->ret_binary);
+		/* The reference of the child is dropped, as if it is new. */
+		return_obj = context->ret;
+		object_unref_without_free (return_obj);
 	}
 
-	object_ref (th_obj);
-	UNUSED (dictobject_remove (g_thread_context, th_obj));
-	pool_free ((void *) context);
-	object_unref (th_obj);
+	thread_forget_context (th_obj);
+	free ((void *) context);
 
 	return return_obj;
 }
 
+/* Look up the contexts of a number of children, for waiting on them
+ * together. */
+static thread_context_t **
+thread_find_contexts (long *ths, size_t n)
+{
+	thread_context_t **contexts;
+	object_t *th_obj;
+
+	contexts = (thread_context_t **) calloc (n, sizeof (thread_context_t *));
+	if (contexts == NULL) {
+		fatal_error ("out of memory.");
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		contexts[i] = thread_find_context (ths[i], &th_obj);
+		if (contexts[i] == NULL) {
+			free ((void *) contexts);
+
+			return NULL;
+		}
+		object_free (th_obj);
+	}
+
+	return contexts;
+}
+
+long
+thread_wait_any (long *ths, size_t n)
+{
+	thread_context_t **contexts;
+	long th;
+
+	if (n == 0) {
+		error ("no thread to wait for.");
+
+		return 0L;
+	}
+
+	contexts = thread_find_contexts (ths, n);
+	if (contexts == NULL) {
+		return 0L;
+	}
+
+	/* Every child announces its end on done_cond, whether it is run by
+	 * the pool or by its own thread. The finished one is still to be
+	 * joined, which no longer blocks. */
+	th = 0L;
+	_thread_mutex_lock (&g_pool.lock);
+	while (th == 0L) {
+		for (size_t i = 0; i < n; i++) {
+			if (contexts[i]->state == THREAD_STATE_DONE) {
+				th = ths[i];
+				break;
+			}
+		}
+		if (th == 0L) {
+			_thread_cond_wait (&g_pool.done_cond, &g_pool.lock);
+		}
+	}
+	_thread_mutex_unlock (&g_pool.lock);
+
+	free ((void *) contexts);
+
+	return th;
+}
+
+int
+thread_wait_all (long *ths, size_t n, long timeout)
+{
+	thread_context_t **contexts;
+	struct timespec deadline;
+	size_t done;
+	int in_time;
+
+	/* All of no children are done already. */
+	if (n == 0) {
+		return 1;
+	}
+
+	contexts = thread_find_contexts (ths, n);
+	if (contexts == NULL) {
+		return -1;
+	}
+
+	/* Timeout is in milliseconds, a negative one waits forever. */
+	if (timeout >= 0) {
+		clock_gettime (CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += timeout / 1000 + (deadline.tv_nsec + timeout % 1000 * 1000000L) / 1000000000L;
+		deadline.tv_nsec = (deadline.tv_nsec + timeout % 1000 * 1000000L) % 1000000000L;
+	}
+
+	/* Children never go back from done, so those seen done are skipped. */
+	done = 0;
+	in_time = 1;
+	_thread_mutex_lock (&g_pool.lock);
+	for (;;) {
+		while (done < n && contexts[done]->state == THREAD_STATE_DONE) {
+			done++;
+		}
+		if (done == n || !in_time) {
+			break;
+		}
+		if (timeout >= 0) {
+			in_time = _thread_cond_timedwait (&g_pool.done_cond, &g_pool.lock, &deadline);
+		}
+		else {
+			_thread_cond_wait (&g_pool.done_cond, &g_pool.lock);
+		}
+	}
+	_thread_mutex_unlock (&g_pool.lock);
+
+	free ((void *) contexts);
+
+	return done == n;
+}
+
 object_t *
 thread_detach (long th)
 {
+	object_t *th_obj;
+	thread_context_t *context;
 	int status;
+	int done;
+
+	context = thread_find_context (th, &th_obj);
+	if (context == NULL) {
+		return NULL;
+	}
+
+	status = 0;
+	if (context->th != 0) {
+		status = _thread_detach (context->th);
+		if (status != 0) {
+			object_free (th_obj);
+
+			return intobject_new (status, NULL);
+		}
+	}
+
+	_thread_mutex_lock (&g_pool.lock);
+	done = context->state == THREAD_STATE_DONE;
+	context->detached = 1;
+	_thread_mutex_unlock (&g_pool.lock);
 
-	status = _thread_detach (th);
+	/* If the child has already finished, its heap is left to us. */
+	if (done) {
+		if (context->allocator != NULL) {
+			thread_release_heap (context);
+		}
+		free ((void *) context);
+	}
+
+	thread_forget_context (th_obj);
 
 	return intobject_new (status, NULL);
 }
@@ -249,13 +882,335 @@ thread_detach (long th)
 object_t *
 thread_cancel (long th)
 {
+	object_t *th_obj;
+	thread_context_t *context;
 	int status;
 
-	status = _thread_cancel (th);
+	context = thread_find_context (th, &th_obj);
+	if (context == NULL) {
+		return NULL;
+	}
+	object_free (th_obj);
+
+	if (context->th != 0) {
+		status = _thread_cancel (context->th);
+	}
+	else {
+		/* Tasks of the pool can only be cancelled before they start. */
+		_thread_mutex_lock (&g_pool.lock);
+		status = context->state == THREAD_STATE_QUEUED? 0: -1;
+		if (status == 0) {
+			context->cancelled = 1;
+		}
+		_thread_mutex_unlock (&g_pool.lock);
+	}
 
 	return intobject_new (status, NULL);
 }
 
+/* Run the chunks of job on a number of tasks, and take over their heaps,
+ * where the results are left. */
+static int
+thread_parallel_run (parallel_job_t *job)
+{
+	thread_context_t **contexts;
+	int pooled;
+	int tasks;
+	int started;
+
+	pooled = thread_is_main_thread () && (g_pool.workers != NULL || thread_pool_start ());
+	tasks = pooled? atomic_load (&g_pool.size): _thread_cpu_count ();
+	if (job->init != NULL || tasks < 1) {
+		tasks = 1;
+	}
+	if (tasks > MAX_POOL_SIZE) {
+		tasks = MAX_POOL_SIZE;
+	}
+	if ((size_t) tasks > job->size) {
+		tasks = (int) job->size;
+	}
+	job->tasks = tasks;
+
+	contexts = (thread_context_t **) calloc ((size_t) tasks, sizeof (thread_context_t *));
+	if (contexts == NULL) {
+		fatal_error ("out of memory.");
+	}
+
+	started = 0;
+	for (int i = 0; i < tasks; i++) {
+		thread_context_t *context;
+
+		context = (thread_context_t *) calloc (1, sizeof (thread_context_t));
+		if (context == NULL) {
+			fatal_error ("out of memory.");
+		}
+		context->code = job->code;
+		context->job = job;
+		context->allocator = pool_make_new_allocator ();
+		if (context->allocator == NULL) {
+			free ((void *) context);
+			break;
+		}
+		context->globals = global_snapshot_acquire ();
+
+		if (pooled) {
+			context->state = THREAD_STATE_QUEUED;
+			thread_pool_submit (context);
+		}
+		else {
+			context->state = THREAD_STATE_RUNNING;
+			context->th = _thread_create (thread_func, (void *) context);
+			if (context->th == 0) {
+				global_snapshot_release (context->globals);
+				thread_release_heap (context);
+				free ((void *) context);
+				break;
+			}
+		}
+		contexts[started++] = context;
+	}
+
+	for (int i = 0; i < started; i++) {
+		thread_context_t *context;
+
+		context = contexts[i];
+		if (context->th != 0) {
+			UNUSED (_thread_join (context->th));
+		}
+		else {
+			_thread_mutex_lock (&g_pool.lock);
+			while (context->state != THREAD_STATE_DONE) {
+				_thread_cond_wait (&g_pool.done_cond, &g_pool.lock);
+			}
+			_thread_mutex_unlock (&g_pool.lock);
+		}
+
+		pool_adopt_allocator (context->allocator);
+		gc_adopt (&context->tracked);
+		free ((void *) context);
+	}
+	free ((void *) contexts);
+
+	/* Chunks could be left if not all tasks got started. */
+	if (started < tasks && atomic_load (&job->next) < job->size) {
+		atomic_store (&job->failed, 1);
+	}
+	if (started == 0) {
+		error ("failed to start parallel tasks.");
+
+		return 0;
+	}
+
+	return !atomic_load (&job->failed);
+}
+
+static void
+thread_parallel_free_results (parallel_job_t *job)
+{
+	for (size_t i = 0; i < job->size; i++) {
+		if (job->results[i] != NULL) {
+			object_unref (job->results[i]);
+		}
+	}
+	free ((void *) job->results);
+}
+
+object_t *
+thread_parallel_map (code_t *code, object_t *vec)
+{
+	parallel_job_t job;
+	object_t *res;
+	vec_t *v;
+
+	memset ((void *) &job, 0, sizeof (parallel_job_t));
+	job.kind = PARALLEL_MAP;
+	job.code = code;
+	job.items = vecobject_get_value (vec);
+	job.size = vec_size (job.items);
+	if (job.size == 0) {
+		return vecobject_new (0, NULL);
+	}
+
+	job.results = (object_t **) calloc (job.size, sizeof (object_t *));
+	if (job.results == NULL) {
+		fatal_error ("out of memory.");
+	}
+
+	if (!thread_parallel_run (&job)) {
+		thread_parallel_free_results (&job);
+		error ("failed to run pmap.");
+
+		return NULL;
+	}
+
+	res = vecobject_new (job.size, NULL);
+	if (res == NULL) {
+		thread_parallel_free_results (&job);
+
+		return NULL;
+	}
+
+	/* Refs of results are moved into the vec. */
+	v = vecobject_get_value (res);
+	for (size_t i = 0; i < job.size; i++) {
+		object_unref (vec_set (v, (integer_value_t) i, (void *) job.results[i]));
+	}
+	free ((void *) job.results);
+	gc_maybe_track ((void *) res);
+
+	return res;
+}
+
+int
+thread_parallel_for (code_t *code, integer_value_t start, integer_value_t end)
+{
+	parallel_job_t job;
+
+	if (end <= start) {
+		return 1;
+	}
+
+	memset ((void *) &job, 0, sizeof (parallel_job_t));
+	job.kind = PARALLEL_FOR;
+	job.code = code;
+	job.start = start;
+	job.size = (size_t) (end - start);
+
+	if (!thread_parallel_run (&job)) {
+		error ("failed to run pfor.");
+
+		return 0;
+	}
+
+	return 1;
+}
+
+object_t *
+thread_parallel_reduce (code_t *code, object_t *vec, object_t *init)
+{
+	parallel_job_t job;
+	object_t *partials;
+	object_t *res;
+	size_t n;
+
+	memset ((void *) &job, 0, sizeof (parallel_job_t));
+	job.kind = PARALLEL_REDUCE;
+	job.code = code;
+	job.items = vecobject_get_value (vec);
+	job.size = vec_size (job.items);
+	if (job.size == 0) {
+		return thread_job_arg (init);
+	}
+
+	/* Chunks are reduced on their own first, the func has to be
+	 * associative. */
+	job.results = (object_t **) calloc (job.size, sizeof (object_t *));
+	if (job.results == NULL) {
+		fatal_error ("out of memory.");
+	}
+
+	if (!thread_parallel_run (&job)) {
+		thread_parallel_free_results (&job);
+		error ("failed to run preduce.");
+
+		return NULL;
+	}
+
+	n = 0;
+	for (size_t i = 0; i < job.size; i++) {
+		n += job.results[i] != NULL;
+	}
+	partials = vecobject_new (n, NULL);
+	if (partials == NULL) {
+		thread_parallel_free_results (&job);
+
+		return NULL;
+	}
+	n = 0;
+	for (size_t i = 0; i < job.size; i++) {
+		if (job.results[i] != NULL) {
+			object_unref (vec_set (vecobject_get_value (partials),
+								   (integer_value_t) n++, (void *) job.results[i]));
+		}
+	}
+	free ((void *) job.results);
+
+	/* Then the partial results are folded in order, starting from init. */
+	memset ((void *) &job, 0, sizeof (parallel_job_t));
+	job.kind = PARALLEL_REDUCE;
+	job.code = code;
+	job.items = vecobject_get_value (partials);
+	job.size = n;
+	job.init = init;
+	job.results = &res;
+	res = NULL;
+
+	if (!thread_parallel_run (&job)) {
+		if (res != NULL) {
+			object_unref (res);
+		}
+		object_free (partials);
+		error ("failed to run preduce.");
+
+		return NULL;
+	}
+	object_free (partials);
+
+	/* The reference of the task is dropped, as if it is new. */
+	object_unref_without_free (res);
+
+	return res;
+}
+
+/* A task that waits for another one, e.g. on a chan, could keep the
+ * only free worker from running it, so the pool makes up for blocked
+ * workers while there is queued work. */
+void
+thread_block_begin ()
+{
+	if (g_worker == NULL) {
+		return;
+	}
+
+	_thread_mutex_lock (&g_pool.lock);
+	g_pool.blocked++;
+	if (g_pool.pending > 0 && g_pool.idle == 0) {
+		UNUSED (thread_pool_grow ());
+	}
+	_thread_mutex_unlock (&g_pool.lock);
+}
+
+void
+thread_block_end ()
+{
+	if (g_worker == NULL) {
+		return;
+	}
+
+	_thread_mutex_lock (&g_pool.lock);
+	g_pool.blocked--;
+	_thread_mutex_unlock (&g_pool.lock);
+}
+
+int
+thread_set_pool_size (long size)
+{
+	if (size < 1 || size > MAX_POOL_SIZE) {
+		error ("thread pool size should be between 1 and %d.", MAX_POOL_SIZE);
+
+		return 0;
+	}
+	if (g_pool.workers != NULL) {
+		error ("thread pool size should be set before starting any thread.");
+
+		return 0;
+	}
+
+	g_pool.size = (int) size;
+
+	return 1;
+}
+
 void
 thread_set_main_thread ()
 {
@@ -275,6 +1230,9 @@ thread_init ()
 	object_set_const (g_thread_context);
 	if (!g_thread_init_done) {
 		_thread_init ();
+		_thread_mutex_init (&g_pool.lock);
+		_thread_cond_init (&g_pool.work_cond);
+		_thread_cond_init (&g_pool.done_cond);
 		g_thread_init_done = 1;
 	}
 }
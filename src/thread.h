@@ -31,12 +31,36 @@ thread_create (code_t *code, object_t *args);
 object_t *
 thread_join (long tr);
 
+long
+thread_wait_any (long *trs, size_t n);
+
+int
+thread_wait_all (long *trs, size_t n, long timeout);
+
 object_t *
 thread_detach (long tr);
 
 object_t *
 thread_cancel (long tr);
 
+object_t *
+thread_parallel_map (code_t *code, object_t *vec);
+
+int
+thread_parallel_for (code_t *code, integer_value_t start, integer_value_t end);
+
+object_t *
+thread_parallel_reduce (code_t *code, object_t *vec, object_t *init);
+
+void
+thread_block_begin ();
+
+void
+thread_block_end ();
+
+int
+thread_set_pool_size (long size);
+
 void
 thread_set_main_thread ();
 
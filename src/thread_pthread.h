@@ -22,11 +22,24 @@
 #define THREAD_PTHREAD_H
 
 #include <pthread.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <stdatomic.h>
+
+#ifdef HAVE_LINUX_FUTEX_H
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
 
 #include "koa.h"
 #include "error.h"
 
-static unsigned long int
+typedef pthread_mutex_t _thread_mutex_t;
+typedef pthread_cond_t _thread_cond_t;
+
+static inline unsigned long int
 _thread_create (void *(*func)(void *), void *arg)
 {
 	pthread_t th;
@@ -40,24 +53,135 @@ _thread_create (void *(*func)(void *), void *arg)
 	return (unsigned long int) th;
 }
 
-static int
+static inline int
 _thread_join (long th)
 {
 	return pthread_join ((pthread_t) th, NULL);
 }
 
-static int
+static inline int
 _thread_detach (long th) {
 	return pthread_detach ((pthread_t) th);
 }
 
-static int
+static inline int
 _thread_cancel (long th)
 {
     return pthread_cancel ((pthread_t) th);
 }
 
-static void
+static inline void
+_thread_mutex_init (_thread_mutex_t *mutex)
+{
+	if (pthread_mutex_init (mutex, NULL) != 0) {
+		fatal_error ("failed to init mutex.");
+	}
+}
+
+static inline void
+_thread_mutex_lock (_thread_mutex_t *mutex)
+{
+	pthread_mutex_lock (mutex);
+}
+
+static inline void
+_thread_mutex_unlock (_thread_mutex_t *mutex)
+{
+	pthread_mutex_unlock (mutex);
+}
+
+static inline void
+_thread_mutex_destroy (_thread_mutex_t *mutex)
+{
+	pthread_mutex_destroy (mutex);
+}
+
+static inline void
+_thread_cond_init (_thread_cond_t *cond)
+{
+	if (pthread_cond_init (cond, NULL) != 0) {
+		fatal_error ("failed to init condition variable.");
+	}
+}
+
+static inline void
+_thread_cond_destroy (_thread_cond_t *cond)
+{
+	pthread_cond_destroy (cond);
+}
+
+static inline void
+_thread_cond_wait (_thread_cond_t *cond, _thread_mutex_t *mutex)
+{
+	pthread_cond_wait (cond, mutex);
+}
+
+/* Returns 0 if deadline, in CLOCK_REALTIME, passes first. */
+static inline int
+_thread_cond_timedwait (_thread_cond_t *cond, _thread_mutex_t *mutex,
+						const struct timespec *deadline)
+{
+	return pthread_cond_timedwait (cond, mutex, deadline) != ETIMEDOUT;
+}
+
+static inline void
+_thread_cond_signal (_thread_cond_t *cond)
+{
+	pthread_cond_signal (cond);
+}
+
+static inline void
+_thread_cond_broadcast (_thread_cond_t *cond)
+{
+	pthread_cond_broadcast (cond);
+}
+
+/* Sleep while *addr still equals val, wakeups may be spurious. Without
+ * futexes we can only give up the cpu and let the caller retry. */
+static inline void
+_thread_futex_wait (_Atomic int *addr, int val)
+{
+#ifdef HAVE_LINUX_FUTEX_H
+	syscall (SYS_futex, (int *) addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+#else
+	if (atomic_load (addr) == val) {
+		sched_yield ();
+	}
+#endif
+}
+
+static inline void
+_thread_futex_wake (_Atomic int *addr, int n)
+{
+#ifdef HAVE_LINUX_FUTEX_H
+	syscall (SYS_futex, (int *) addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+#else
+	(void) addr;
+	(void) n;
+#endif
+}
+
+static inline void
+_thread_cpu_relax ()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause ();
+#elif defined(__aarch64__)
+	__asm__ __volatile__ ("yield");
+#endif
+}
+
+static inline int
+_thread_cpu_count ()
+{
+	long n;
+
+	n = sysconf (_SC_NPROCESSORS_ONLN);
+
+	return n > 0? (int) n: 1;
+}
+
+static inline void
 _thread_init ()
 {
 #if defined(_AIX) && defined(__GNUC__)
@@ -42,4 +42,7 @@ ucharobject_new (unsigned char val, void *udata);
 unsigned char
 ucharobject_get_value (object_t *obj);
 
+void
+ucharobject_init ();
+
 #endif /* UCHAROBJECT_H */
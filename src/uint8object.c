@@ -24,6 +24,7 @@
 #include "uint8object.h"
 #include "pool.h"
 #include "error.h"
+#include "thread.h"
 #include "boolobject.h"
 #include "intobject.h"
 #include "uint64object.h"
@@ -51,7 +52,7 @@ static object_t *uint8object_op_lshift (object_t *obj1, object_t *obj2);
 static object_t *uint8object_op_rshift (object_t *obj1, object_t *obj2);
 static object_t *uint8object_op_eq (object_t *obj1, object_t *obj2);
 static object_t *uint8object_op_cmp (object_t *obj1, object_t *obj2);
-static object_t *uint8object_op_hash (object_t *obj);
+static uint64_t uint8object_op_hash (object_t *obj);
 static object_t *uint8object_op_binary (object_t *obj);
 
 static object_opset_t g_object_ops =
@@ -159,7 +160,6 @@ uint8object_op_mul (object_t *obj1, object_t *obj2)
 	return uint8object_new (val1 * val2, NULL);
 }
 
-
 /* Division. */
 static object_t *
 uint8object_op_div (object_t *obj1, object_t *obj2)
@@ -311,14 +311,10 @@ uint8object_op_cmp (object_t *obj1, object_t *obj2)
 }
 
 /* Hash. */
-static object_t *
-uint8object_op_hash(object_t *obj)
+static uint64_t
+uint8object_op_hash (object_t *obj)
 {
-	if (OBJECT_DIGEST (obj) == 0) {
-		OBJECT_DIGEST (obj) = object_integer_hash (object_get_integer (obj));
-	}
-
-	return uint64object_new (OBJECT_DIGEST (obj), NULL);
+	return object_integer_hash (object_get_integer (obj));
 }
 
 /* Binary. */
@@ -361,12 +357,6 @@ uint8object_load_buf (const char **buf, size_t *len)
 	return uint8object_new (val, NULL);
 }
 
-static uint64_t
-uint8object_digest_fun (void *obj)
-{
-	return object_integer_hash (object_get_integer ((object_t *) obj));
-}
-
 object_t *
 uint8object_new (uint8_t val, void *udata)
 {
@@ -377,8 +367,7 @@ uint8object_new (uint8_t val, void *udata)
 		fatal_error ("out of memory.");
 	}
 
-	OBJECT_NEW_INIT (obj, OBJECT_TYPE_UINT8, udata);
-	OBJECT_DIGEST_FUN (obj) = uint8object_digest_fun;
+	OBJECT_NEW_INIT (obj, OBJECT_TYPE_UINT8);
 
 	obj->val = val;
 
@@ -394,3 +383,13 @@ uint8object_get_value (object_t *obj)
 
 	return ob->val;
 }
+
+void
+uint8object_init ()
+{
+	if (!thread_is_main_thread ()) {
+		return;
+	}
+
+	object_register_opset (OBJECT_TYPE_UINT8, &g_object_ops);
+}
@@ -42,4 +42,7 @@ uint8object_new (uint8_t val, void *udata);
 uint8_t
 uint8object_get_value (object_t *obj);
 
+void
+uint8object_init ();
+
 #endif /* UINT8OBJECT_H */
@@ -42,4 +42,7 @@ uintobject_new (unsigned int val, void *udata);
 unsigned int
 uintobject_get_value (object_t *obj);
 
+void
+uintobject_init ();
+
 #endif /* UINTOBJECT_H */
@@ -42,4 +42,7 @@ ulongobject_new (unsigned long int val, void *udata);
 unsigned long int
 ulongobject_get_value (object_t *obj);
 
+void
+ulongobject_init ();
+
 #endif /* ULONGOBJECT_H */
@@ -24,6 +24,7 @@
 #include "unionobject.h"
 #include "pool.h"
 #include "gc.h"
+#include "global.h"
 #include "error.h"
 #include "thread.h"
 #include "compound.h"
@@ -41,7 +42,7 @@ static void unionobject_op_free (object_t *obj);
 static void unionobject_op_print (object_t *obj);
 static object_t *unionobject_op_dump (object_t *obj);
 static object_t *unionobject_op_eq (object_t *obj1, object_t *obj2);
-static object_t *unionobject_op_hash (object_t *obj);
+static uint64_t unionobject_op_hash (object_t *obj);
 static object_t *unionobject_op_binary (object_t *obj);
 
 static object_opset_t g_object_ops =
@@ -154,14 +155,10 @@ unionobject_op_eq (object_t *obj1, object_t *obj2)
 }
 
 /* Hash. */
-static object_t *
-unionobject_op_hash(object_t *obj)
+static uint64_t
+unionobject_op_hash (object_t *obj)
 {
-	if (OBJECT_DIGEST (obj) == 0) {
-		OBJECT_DIGEST (obj) = object_address_hash ((void *) obj);
-	}
-
-	return uint64object_new (OBJECT_DIGEST (obj), NULL);
+	return object_address_hash ((void *) obj);
 }
 
 /* Binary. */
@@ -178,12 +175,6 @@ unionobject_op_binary (object_t *obj)
 	return object_binary (object_get_default (OBJECT_TYPE_VOID, NULL));
 }
 
-static uint64_t
-unionobject_digest_fun (void *obj)
-{
-	return object_address_hash (obj);
-}
-
 object_t *
 unionobject_load_binary (object_type_t type, FILE *f)
 {
@@ -195,13 +186,12 @@ unionobject_load_binary (object_type_t type, FILE *f)
 		return NULL;
 	}
 
-	union_obj = (unionobject_t *) pool_alloc (sizeof (unionobject_t));
+	union_obj = (unionobject_t *) gc_alloc (sizeof (unionobject_t));
 	if (union_obj == NULL) {
 		fatal_error ("out of memory.");
 	}
 
-	OBJECT_NEW_INIT (union_obj, type, NULL);
-	OBJECT_DIGEST_FUN (union_obj) = unionobject_digest_fun;
+	OBJECT_NEW_INIT (union_obj, type);
 
 	if (OBJECT_IS_DUMMY (value_obj)) {
 		object_free (value_obj);
@@ -212,7 +202,7 @@ unionobject_load_binary (object_type_t type, FILE *f)
 		object_ref (value_obj);
 	}
 
-	gc_track ((void *) union_obj);
+	gc_maybe_track ((void *) union_obj);
 
 	return (object_t *) union_obj;
 }
@@ -228,13 +218,12 @@ unionobject_load_buf (object_type_t type, const char **buf, size_t *len)
 		return NULL;
 	}
 
-	union_obj = (unionobject_t *) pool_alloc (sizeof (unionobject_t));
+	union_obj = (unionobject_t *) gc_alloc (sizeof (unionobject_t));
 	if (union_obj == NULL) {
 		fatal_error ("out of memory.");
 	}
 
-	OBJECT_NEW_INIT (union_obj, type, NULL);
-	OBJECT_DIGEST_FUN (union_obj) = unionobject_digest_fun;
+	OBJECT_NEW_INIT (union_obj, type);
 
 	if (OBJECT_IS_DUMMY (value_obj)) {
 		object_free (value_obj);
@@ -245,7 +234,7 @@ unionobject_load_buf (object_type_t type, const char **buf, size_t *len)
 		object_ref (value_obj);
 	}
 
-	gc_track ((void *) union_obj);
+	gc_maybe_track ((void *) union_obj);
 
 	return (object_t *) union_obj;
 }
@@ -256,17 +245,16 @@ unionobject_new (code_t *code, object_type_t type, void *udata)
 	unionobject_t *obj;
 	compound_t *meta;
 
-	obj = (unionobject_t *) pool_alloc (sizeof (unionobject_t));
+	obj = (unionobject_t *) gc_alloc (sizeof (unionobject_t));
 	if (obj == NULL) {
 		fatal_error ("out of memory.");
 	}
 
-	OBJECT_NEW_INIT (obj, type, udata);
-	OBJECT_DIGEST_FUN (obj) = unionobject_digest_fun;
+	OBJECT_NEW_INIT (obj, type);
 
 	meta = code_get_union (code, type);
 	if (meta == NULL) {
-		pool_free ((void *) obj);
+		gc_free ((void *) obj);
 		error ("union meta not found.");
 
 		return NULL;
@@ -274,7 +262,7 @@ unionobject_new (code_t *code, object_type_t type, void *udata)
 
 	obj->value = NULL;
 
-	gc_track ((void *) obj);
+	gc_maybe_track ((void *) obj);
 
 	return (object_t *) obj;
 }
@@ -362,6 +350,8 @@ unionobject_store_member (object_t *obj, object_t *name,
 
 	union_obj = (unionobject_t *) obj;
 	prev = (object_t *) union_obj->value;
+	gc_write_barrier ((void *) obj, (void *) value);
+	GLOBAL_WRITE_BARRIER (obj);
 	if (OBJECT_TYPE (value) == target_type) {
 		union_obj->value = value;
 		object_ref (value);
@@ -392,17 +382,16 @@ unionobject_copy (object_t *obj)
 	object_t *new_value;
 
 	old_obj = (unionobject_t *) obj;
-	new_obj = (unionobject_t *) pool_alloc (sizeof (unionobject_t));
+	new_obj = (unionobject_t *) gc_alloc (sizeof (unionobject_t));
 	if (new_obj == NULL) {
 		fatal_error ("out of memory.");
 	}
 
-	OBJECT_NEW_INIT (new_obj, OBJECT_TYPE (obj), OBJECT_UDATA (obj));
-	OBJECT_DIGEST_FUN (new_obj) = unionobject_digest_fun;
+	OBJECT_NEW_INIT (new_obj, OBJECT_TYPE (obj));
 
 	new_value = object_copy ((object_t *) old_obj->value);
 	if (new_value == NULL) {
-		pool_free ((void *) new_obj);
+		gc_free ((void *) new_obj);
 
 		return NULL;
 	}
@@ -410,7 +399,7 @@ unionobject_copy (object_t *obj)
 	new_obj->value = new_value;
 	object_ref (new_value);
 
-	gc_track ((void *) new_obj);
+	gc_maybe_track ((void *) new_obj);
 
 	return (object_t *) new_obj;
 }
@@ -422,6 +411,8 @@ unionobject_init ()
 		return;
 	}
 
+	object_register_opset (OBJECT_TYPE_UNION, &g_object_ops);
+
 	/* Make dump objects. */
 	g_dump_head = strobject_new ("<union <", strlen ("<union <"), 1, NULL);
 	if (g_dump_head == NULL) {
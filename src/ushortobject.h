@@ -42,4 +42,7 @@ ushortobject_new (unsigned short int val, void *udata);
 unsigned short int
 ushortobject_get_value (object_t *obj);
 
+void
+ushortobject_init ();
+
 #endif /* USHORTOBJECT_H */
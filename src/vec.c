@@ -30,6 +30,33 @@
 
 #define MAX_VEC_SIZE INT_MAX
 
+/* Slot of the item at pos. */
+static inline size_t
+vec_slot (vec_t *vec, size_t pos)
+{
+	size_t slot;
+
+	slot = vec->head + pos;
+
+	return slot >= vec->allocated? slot - vec->allocated: slot;
+}
+
+/* Copy all items to v in order. */
+static void
+vec_copy_out (vec_t *vec, void **v)
+{
+	size_t first;
+
+	first = vec->allocated - vec->head;
+	if (first >= vec->size) {
+		memcpy ((void *) v, (void *) (vec->v + vec->head), vec->size * sizeof (void *));
+	}
+	else {
+		memcpy ((void *) v, (void *) (vec->v + vec->head), first * sizeof (void *));
+		memcpy ((void *) (v + first), (void *) vec->v, (vec->size - first) * sizeof (void *));
+	}
+}
+
 vec_t *
 vec_new (size_t size)
 {
@@ -52,6 +79,7 @@ vec_new (size_t size)
 
 	vec->size = size;
 	vec->allocated = req;
+	vec->head = 0;
 	vec->v = (void **) pool_calloc (req, sizeof (void *));
 	if (vec->v == NULL) {
 		pool_free ((void *) vec);
@@ -94,10 +122,8 @@ vec_concat (vec_t *vec1, vec_t *vec2)
 	}
 
 	new_vec = vec_new (new_size);
-	memcpy ((void *) new_vec->v, (void *) vec1->v,
-			vec1->size * sizeof (void *));
-	memcpy ((void *) new_vec->v + vec1->size, (void *) vec2->v,
-			vec2->size * sizeof (void *));
+	vec_copy_out (vec1, new_vec->v);
+	vec_copy_out (vec2, new_vec->v + vec1->size);
 
 	return new_vec;
 }
@@ -106,7 +132,7 @@ void *
 vec_pos (vec_t *vec, integer_value_t pos)
 {
 	if (pos >= 0 && pos < vec->size) {
-		return vec->v[pos];
+		return vec->v[vec_slot (vec, (size_t) pos)];
 	}
 
 	return NULL;
@@ -118,8 +144,11 @@ vec_set (vec_t *vec, integer_value_t pos, void *data)
 	if (pos >= 0 && pos < vec->size) {
 		void *prev;
 
-		prev = vec->v[pos];
-		vec->v[pos] = data;
+		size_t slot;
+
+		slot = vec_slot (vec, (size_t) pos);
+		prev = vec->v[slot];
+		vec->v[slot] = data;
 
 		return prev;
 	}
@@ -159,10 +188,11 @@ vec_check_and_resize (vec_t *vec, size_t req)
 			fatal_error ("out of memory.");
 		}
 
-		memcpy (new_v, vec->v, vec->size * sizeof (void *));
+		vec_copy_out (vec, new_v);
 		pool_free ((void *) vec->v);
 		vec->v = new_v;
 		vec->allocated = new_req;
+		vec->head = 0;
 
 		return 1;
 	}
@@ -170,28 +200,67 @@ vec_check_and_resize (vec_t *vec, size_t req)
 	return 1;
 }
 
+/* Appending and popping at either end move no other items. */
 int
 vec_push_back (vec_t *vec, void *data)
 {
-	return vec_insert (vec, vec->size, data);
+	if (vec->size == vec->allocated && vec_check_and_resize (vec, vec->size + 1) == 0) {
+		return 0;
+	}
+
+	vec->v[vec_slot (vec, vec->size)] = data;
+	vec->size++;
+
+	return 1;
 }
 
 int
 vec_pop_back (vec_t *vec)
 {
-	return vec_remove (vec, (integer_value_t) vec->size - 1);
+	if (vec->size == 0) {
+		error ("invalid vec pos for removing.");
+
+		return 0;
+	}
+
+	vec->size--;
+	if (vec->size < vec->allocated / 4) {
+		return vec_check_and_resize (vec, vec->size);
+	}
+
+	return 1;
 }
 
 int
 vec_push_front (vec_t *vec, void *data)
 {
-	return vec_insert (vec, 0, data);
+	if (vec->size == vec->allocated && vec_check_and_resize (vec, vec->size + 1) == 0) {
+		return 0;
+	}
+
+	vec->head = vec->head == 0? vec->allocated - 1: vec->head - 1;
+	vec->v[vec->head] = data;
+	vec->size++;
+
+	return 1;
 }
 
 int
 vec_pop_front (vec_t *vec)
 {
-	return vec_remove (vec, (integer_value_t) 0);
+	if (vec->size == 0) {
+		error ("invalid vec pos for removing.");
+
+		return 0;
+	}
+
+	vec->head = vec_slot (vec, 1);
+	vec->size--;
+	if (vec->size < vec->allocated / 4) {
+		return vec_check_and_resize (vec, vec->size);
+	}
+
+	return 1;
 }
 
 void *
@@ -202,7 +271,7 @@ vec_first (vec_t *vec)
 		return NULL;
 	}
 
-	return vec->v[0];
+	return vec->v[vec->head];
 }
 
 void *
@@ -213,7 +282,7 @@ vec_last (vec_t *vec)
 		return NULL;
 	}
 
-	return vec->v[vec->size - 1];
+	return vec->v[vec_slot (vec, vec->size - 1)];
 }
 
 /* Int is enough. */
@@ -221,13 +290,16 @@ size_t
 vec_find (vec_t *vec, void *data, vec_find_f ff)
 {
 	for (size_t i = 0; i < vec->size; i++) {
+		void *item;
+
+		item = vec->v[vec_slot (vec, i)];
 		if (ff == NULL) {
-			if (vec->v[i] == data) {
+			if (item == data) {
 				return i;
 			}
 		}
 		else {
-			if (ff (vec->v[i], data)) {
+			if (ff (item, data)) {
 				return i;
 			}
 		}
@@ -236,6 +308,7 @@ vec_find (vec_t *vec, void *data, vec_find_f ff)
 	return -1;
 }
 
+/* Items on the shorter side of pos are moved. */
 int
 vec_insert (vec_t *vec, integer_value_t pos, void *data)
 {
@@ -246,15 +319,23 @@ vec_insert (vec_t *vec, integer_value_t pos, void *data)
 	}
 
 	/* Need resizing? */
-	if (vec_check_and_resize (vec, vec->size + 1) == 0) {
+	if (vec->size == vec->allocated && vec_check_and_resize (vec, vec->size + 1) == 0) {
 		return 0;
 	}
 
-	for (size_t i = vec->size; i > (size_t) pos; i--) {
-		vec->v[i] = vec->v[i - 1];
+	if ((size_t) pos < vec->size - (size_t) pos) {
+		vec->head = vec->head == 0? vec->allocated - 1: vec->head - 1;
+		for (size_t i = 0; i < (size_t) pos; i++) {
+			vec->v[vec_slot (vec, i)] = vec->v[vec_slot (vec, i + 1)];
+		}
+	}
+	else {
+		for (size_t i = vec->size; i > (size_t) pos; i--) {
+			vec->v[vec_slot (vec, i)] = vec->v[vec_slot (vec, i - 1)];
+		}
 	}
 
-	vec->v[pos] = data;
+	vec->v[vec_slot (vec, (size_t) pos)] = data;
 	vec->size++;
 
 	return 1;
@@ -263,40 +344,35 @@ vec_insert (vec_t *vec, integer_value_t pos, void *data)
 int
 vec_remove (vec_t *vec, integer_value_t pos)
 {
-	void *to_del;
-
 	if (pos < 0 || pos >= vec->size) {
 		error ("invalid vec pos for removing.");
 
 		return 0;
 	}
 
-	to_del = vec->v[pos];
-	/* Do not use memcpy even for moving forward. */
-	for (size_t i = (size_t) pos; i < vec->size; i++) {
-		vec->v[i] = vec->v[i + 1];
+	if ((size_t) pos < vec->size - 1 - (size_t) pos) {
+		for (size_t i = (size_t) pos; i > 0; i--) {
+			vec->v[vec_slot (vec, i)] = vec->v[vec_slot (vec, i - 1)];
+		}
+		vec->head = vec_slot (vec, 1);
 	}
-
-	if (vec_check_and_resize (vec, vec->size - 1) == 0) {
-		/* Rollback. */
-		for (size_t i = vec->size - 1; i > (size_t) pos; i--) {
-			vec->v[i] = vec->v[i - 1];
+	else {
+		for (size_t i = (size_t) pos; i + 1 < vec->size; i++) {
+			vec->v[vec_slot (vec, i)] = vec->v[vec_slot (vec, i + 1)];
 		}
-		vec->v[pos] = to_del;
-
-		return 0;
 	}
 
 	vec->size--;
 
-	return 1;
+	/* Shrinking never fails. */
+	return vec_check_and_resize (vec, vec->size);
 }
 
 void
 vec_foreach (vec_t *vec, vec_foreach_f ff, void *udata)
 {
 	for (size_t i = 0; i < vec->size; i++) {
-		if (ff (vec->v[i], udata) > 0) {
+		if (ff (vec->v[vec_slot (vec, i)], udata) > 0) {
 			return;
 		}
 	}
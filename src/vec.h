@@ -28,9 +28,11 @@
 typedef int (*vec_find_f) (void *a, void *b);
 typedef int (*vec_foreach_f) (void *data, void *udata);
 
+/* A ring buffer, items start at head and may wrap around. */
 typedef struct vec_s {
 	size_t size;
 	size_t allocated;
+	size_t head;
 	void **v;
 } vec_t;
 
@@ -18,10 +18,12 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <string.h>
+#include <stdint.h>
 
 #include "vecobject.h"
 #include "pool.h"
 #include "gc.h"
+#include "global.h"
 #include "error.h"
 #include "thread.h"
 #include "nullobject.h"
@@ -42,7 +44,7 @@ static object_t *vecobject_op_eq (object_t *obj1, object_t *obj2);
 static object_t *vecobject_op_index (object_t *obj1, object_t *obj2);
 static object_t *vecobject_op_ipindex (object_t *obj1,
 									   object_t *obj2, object_t *obj3);
-static object_t *vecobject_op_hash (object_t *obj);
+static uint64_t vecobject_op_hash (object_t *obj);
 static object_t *vecobject_op_binary (object_t *obj);
 static object_t *vecobject_op_len (object_t *obj);
 
@@ -244,6 +246,8 @@ vecobject_op_ipindex (object_t *obj1, object_t *obj2, object_t *obj3)
 		return NULL;
 	}
 
+	gc_write_barrier ((void *) obj1, (void *) obj3);
+	GLOBAL_WRITE_BARRIER (obj1);
 	prev = (object_t *) vec_set (v, pos, obj3);
 	object_ref (obj3);
 	object_unref (prev);
@@ -252,14 +256,10 @@ vecobject_op_ipindex (object_t *obj1, object_t *obj2, object_t *obj3)
 }
 
 /* Hash. */
-static object_t *
-vecobject_op_hash(object_t *obj)
+static uint64_t
+vecobject_op_hash (object_t *obj)
 {
-	if (OBJECT_DIGEST (obj) == 0) {
-		OBJECT_DIGEST (obj) = object_address_hash ((void *) obj);
-	}
-
-	return uint64object_new (OBJECT_DIGEST (obj), NULL);
+	return object_address_hash ((void *) obj);
 }
 
 /* Binary. */
@@ -417,28 +417,21 @@ vecobject_empty_init (vecobject_t *obj)
 	return 1;
 }
 
-static uint64_t
-vecobject_digest_fun (void *obj)
-{
-	return object_address_hash (obj);
-}
-
 object_t *
 vecobject_new (size_t len, void *udata)
 {
 	vecobject_t *obj;
 
-	obj = (vecobject_t *) pool_alloc (sizeof (vecobject_t));
+	obj = (vecobject_t *) gc_alloc (sizeof (vecobject_t));
 	if (obj == NULL) {
 		fatal_error ("out of memory.");
 	}
 
-	OBJECT_NEW_INIT (obj, OBJECT_TYPE_VEC, udata);
-	OBJECT_DIGEST_FUN (obj) = vecobject_digest_fun;
+	OBJECT_NEW_INIT (obj, OBJECT_TYPE_VEC);
 
 	obj->val = vec_new (len);
 	if (obj->val == NULL) {
-		pool_free ((void *) obj);
+		gc_free ((void *) obj);
 
 		return NULL;
 	}
@@ -450,8 +443,6 @@ vecobject_new (size_t len, void *udata)
 		return NULL;
 	}
 
-	gc_track ((void *) obj);
-
 	return (object_t *) obj;
 }
 
@@ -460,17 +451,16 @@ vecobject_vec_new (vec_t *val, void *udata)
 {
 	vecobject_t *obj;
 
-	obj = (vecobject_t *) pool_alloc (sizeof (vecobject_t));
+	obj = (vecobject_t *) gc_alloc (sizeof (vecobject_t));
 	if (obj == NULL) {
 		fatal_error ("out of memory.");
 	}
 
-	OBJECT_NEW_INIT (obj, OBJECT_TYPE_VEC, udata);
-	OBJECT_DIGEST_FUN (obj) = vecobject_digest_fun;
+	OBJECT_NEW_INIT (obj, OBJECT_TYPE_VEC);
 
 	obj->val = val;
 
-	gc_track ((void *) obj);
+	gc_maybe_track ((void *) obj);
 
 	return (object_t *) obj;
 }
@@ -487,25 +477,37 @@ vecobject_get_value (object_t *obj)
 
 void
 vecobject_traverse (object_t *obj, traverse_f fun, void *udata)
+{
+	size_t pos;
+
+	pos = 0;
+	UNUSED (vecobject_traverse_slice (obj, fun, udata, &pos, SIZE_MAX));
+}
+
+/* Visits at most n elements from *pos on, and gives 1 once the end is
+ * reached. The vec may change between two slices. */
+int
+vecobject_traverse_slice (object_t *obj, traverse_f fun, void *udata, size_t *pos, size_t n)
 {
 	vec_t *vec;
 	size_t size;
 
 	vec = vecobject_get_value (obj);
 	size = vec_size (vec);
-	for (integer_value_t i = 0; i < (integer_value_t) size; i++) {
+	for (; n > 0 && *pos < size; n--, (*pos)++) {
 		object_t *element;
 
-		element = (object_t *) vec_pos (vec, i);
-		object_traverse (element, fun, udata);
+		element = (object_t *) vec_pos (vec, (integer_value_t) *pos);
 		if (fun (element, udata) > 0) {
 			object_t *dummy;
 
 			dummy = object_get_default (OBJECT_TYPE_VOID, NULL);
-			vec_set (vec, i, dummy);
+			vec_set (vec, (integer_value_t) *pos, dummy);
 			object_ref (dummy);
 		}
 	}
+
+	return *pos >= size;
 }
 
 int
@@ -513,6 +515,8 @@ vecobject_append (object_t *obj, object_t *element)
 {
 	vec_t *vec;
 
+	gc_write_barrier ((void *) obj, (void *) element);
+	GLOBAL_WRITE_BARRIER (obj);
 	vec = vecobject_get_value (obj);
 	if (vec_push_back (vec, (void *) element) == 0) {
 		return 0;
@@ -528,6 +532,8 @@ vecobject_remove (object_t *obj, integer_value_t pos)
 {
 	vec_t *vec;
 
+	gc_remove_barrier ((void *) obj);
+	GLOBAL_WRITE_BARRIER (obj);
 	vec = vecobject_get_value (obj);
 	return vec_remove (vec, pos);
 }
@@ -572,6 +578,8 @@ vecobject_init ()
 		return;
 	}
 
+	object_register_opset (OBJECT_TYPE_VEC, &g_object_ops);
+
 	/* Make dump objects. */
 	g_dump_head = strobject_new ("<vec [", strlen ("<vec ["), 1, NULL);
 	if (g_dump_head == NULL) {
@@ -49,6 +49,9 @@ vecobject_get_value (object_t *obj);
 void
 vecobject_traverse (object_t *obj, traverse_f fun, void *udata);
 
+int
+vecobject_traverse_slice (object_t *obj, traverse_f fun, void *udata, size_t *pos, size_t n);
+
 int
 vecobject_append (object_t *obj, object_t *element);
 
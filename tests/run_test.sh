@@ -0,0 +1,28 @@
+#!/bin/sh
+# Run a koa script and compare what it prints with the .exp file next
+# to it. The script is run from a scratch dir, since koa leaves the
+# compiled .b file beside it. It is run twice, the second run loads the
+# .b file.
+
+script=$1
+exp=${script%.k}.exp
+koa=${KOA:-../src/koa}
+case $koa in
+	/*) ;;
+	*) koa=`pwd`/$koa ;;
+esac
+
+dir=`mktemp -d` || exit 99
+trap 'rm -rf "$dir"' EXIT
+cp "$script" "$dir/test.k" || exit 99
+
+for run in 1 2; do
+	(cd "$dir" && "$koa" test.k) > "$dir/out" 2>&1
+	status=$?
+	if [ $status -ne 0 ]; then
+		cat "$dir/out"
+		echo "exit status of run $run: $status"
+		exit 1
+	fi
+	diff -u "$exp" "$dir/out" || exit 1
+done